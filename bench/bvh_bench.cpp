@@ -0,0 +1,202 @@
+// Checks every query of the bounding volume hierarchy against a brute force scan over the same boxes, and times both.
+// The boxes are units scattered over a square map. After the first round a tenth of them move every round and the tree is refit,
+// so the queries are also checked on trees that have been refit and partly rebuilt.
+//
+// usage: bvh_bench [rounds]
+
+#include "../src/bvh.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+const float MAP_SIZE = 2000.0f;
+const unsigned int OBJECT_COUNTS[] = { 1000, 10000, 100000 };
+const unsigned int QUERIES_PER_ROUND = 200;
+const float PROXIMITY_RADIUS = 10.0f;
+
+struct BenchTimes {
+    double bvh;
+    double brute;
+};
+
+std::mt19937 bench_random(1);
+
+void bench_box(glm::vec3 center, glm::vec3* bounds_min, glm::vec3* bounds_max) {
+    std::uniform_real_distribution<float> size(0.5f, 2.0f);
+    glm::vec3 extents = glm::vec3(size(bench_random), size(bench_random), size(bench_random));
+    *bounds_min = center - extents;
+    *bounds_max = center + extents;
+}
+
+glm::vec3 bench_position() {
+    std::uniform_real_distribution<float> position(-MAP_SIZE / 2.0f, MAP_SIZE / 2.0f);
+
+    return glm::vec3(position(bench_random), 0.0f, position(bench_random));
+}
+
+double bench_elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void brute_frustum(const Bvh& bvh, const CullFrustum& frustum, std::vector<unsigned int>* items) {
+    items->clear();
+    for (unsigned int i = 0; i < bvh.item_min.size(); i++) {
+        if (cull_frustum_box(frustum, bvh.item_min[i], bvh.item_max[i])) {
+            items->push_back(i);
+        }
+    }
+}
+
+void brute_box(const Bvh& bvh, glm::vec3 bounds_min, glm::vec3 bounds_max, std::vector<unsigned int>* items) {
+    items->clear();
+    for (unsigned int i = 0; i < bvh.item_min.size(); i++) {
+        const glm::vec3& item_min = bvh.item_min[i];
+        const glm::vec3& item_max = bvh.item_max[i];
+        if (item_min.x <= bounds_max.x && item_max.x >= bounds_min.x && item_min.y <= bounds_max.y && item_max.y >= bounds_min.y && item_min.z <= bounds_max.z && item_max.z >= bounds_min.z) {
+            items->push_back(i);
+        }
+    }
+}
+
+bool brute_ray(const Bvh& bvh, glm::vec3 origin, glm::vec3 direction, float max_distance, float* distance) {
+    glm::vec3 inverse_direction = 1.0f / direction;
+    bool hit = false;
+    *distance = max_distance;
+    for (unsigned int i = 0; i < bvh.item_min.size(); i++) {
+        glm::vec3 t0 = (bvh.item_min[i] - origin) * inverse_direction;
+        glm::vec3 t1 = (bvh.item_max[i] - origin) * inverse_direction;
+        glm::vec3 t_near = glm::min(t0, t1);
+        glm::vec3 t_far = glm::max(t0, t1);
+        float enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+        float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, *distance));
+        if (enter <= exit) {
+            *distance = enter;
+            hit = true;
+        }
+    }
+
+    return hit;
+}
+
+// runs one round of every query, returning false on the first mismatch
+bool bench_round(const Bvh& bvh, BenchTimes* frustum_times, BenchTimes* box_times, BenchTimes* ray_times) {
+    std::vector<unsigned int> bvh_items;
+    std::vector<unsigned int> brute_items;
+    std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+    std::uniform_real_distribution<float> height(20.0f, 200.0f);
+
+    for (unsigned int query = 0; query < QUERIES_PER_ROUND; query++) {
+        // a strategy camera looking down at a random part of the map
+        glm::vec3 target = bench_position();
+        glm::vec3 eye = target + glm::vec3(std::cos(angle(bench_random)) * 100.0f, height(bench_random), std::sin(angle(bench_random)) * 100.0f);
+        CullFrustum frustum;
+        cull_frustum_extract(&frustum, glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 400.0f) * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bvh_query_frustum(bvh, frustum, &bvh_items);
+        frustum_times->bvh += bench_elapsed(start);
+        start = std::chrono::steady_clock::now();
+        brute_frustum(bvh, frustum, &brute_items);
+        frustum_times->brute += bench_elapsed(start);
+        std::sort(bvh_items.begin(), bvh_items.end());
+        if (bvh_items != brute_items) {
+            printf("error: frustum query found %zu items, brute force found %zu\n", bvh_items.size(), brute_items.size());
+            return false;
+        }
+
+        // everything near a random unit, the way proximity checks around a selected unit would ask
+        unsigned int unit = std::uniform_int_distribution<unsigned int>(0, bvh.item_min.size() - 1)(bench_random);
+        glm::vec3 near_min = bvh.item_min[unit] - glm::vec3(PROXIMITY_RADIUS);
+        glm::vec3 near_max = bvh.item_max[unit] + glm::vec3(PROXIMITY_RADIUS);
+        start = std::chrono::steady_clock::now();
+        bvh_query_box(bvh, near_min, near_max, &bvh_items);
+        box_times->bvh += bench_elapsed(start);
+        start = std::chrono::steady_clock::now();
+        brute_box(bvh, near_min, near_max, &brute_items);
+        box_times->brute += bench_elapsed(start);
+        std::sort(bvh_items.begin(), bvh_items.end());
+        if (bvh_items != brute_items) {
+            printf("error: box query found %zu items, brute force found %zu\n", bvh_items.size(), brute_items.size());
+            return false;
+        }
+
+        // a pick from the camera towards the ground, which may miss everything
+        glm::vec3 direction = glm::normalize(bench_position() - eye);
+        unsigned int bvh_item;
+        float bvh_distance;
+        float brute_distance;
+        start = std::chrono::steady_clock::now();
+        bool bvh_hit = bvh_query_ray(bvh, eye, direction, 1000.0f, &bvh_item, &bvh_distance);
+        ray_times->bvh += bench_elapsed(start);
+        start = std::chrono::steady_clock::now();
+        bool brute_hit = brute_ray(bvh, eye, direction, 1000.0f, &brute_distance);
+        ray_times->brute += bench_elapsed(start);
+        // items can tie for nearest, so only whether something was hit and how far away it was have to agree
+        if (bvh_hit != brute_hit || (bvh_hit && bvh_distance != brute_distance)) {
+            printf("error: ray query %s at %f, brute force %s at %f\n", bvh_hit ? "hit" : "missed", bvh_hit ? bvh_distance : 0.0f, brute_hit ? "hit" : "missed", brute_hit ? brute_distance : 0.0f);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void bench_print(const char* name, const BenchTimes& times, unsigned int query_count) {
+    printf("  %-8s bvh %8.4f ms, brute force %8.4f ms per query (%6.1fx)\n", name, times.bvh / query_count, times.brute / query_count, times.brute / times.bvh);
+}
+
+int main(int argc, char** argv) {
+    unsigned int rounds = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 10;
+
+    for (unsigned int count : OBJECT_COUNTS) {
+        std::vector<glm::vec3> bounds_min(count);
+        std::vector<glm::vec3> bounds_max(count);
+        for (unsigned int i = 0; i < count; i++) {
+            bench_box(bench_position(), &bounds_min[i], &bounds_max[i]);
+        }
+        Bvh bvh;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bvh_build(&bvh, bounds_min, bounds_max);
+        double build_time = bench_elapsed(start);
+
+        BenchTimes frustum_times = (BenchTimes) { .bvh = 0.0, .brute = 0.0 };
+        BenchTimes box_times = frustum_times;
+        BenchTimes ray_times = frustum_times;
+        double refit_time = 0.0;
+        unsigned int rebuilt = 0;
+        for (unsigned int round = 0; round < rounds; round++) {
+            if (round != 0) {
+                std::uniform_real_distribution<float> step(-20.0f, 20.0f);
+                for (unsigned int i = 0; i < count / 10; i++) {
+                    unsigned int item = std::uniform_int_distribution<unsigned int>(0, count - 1)(bench_random);
+                    glm::vec3 center = (bvh.item_min[item] + bvh.item_max[item]) * 0.5f + glm::vec3(step(bench_random), 0.0f, step(bench_random));
+                    glm::vec3 item_min;
+                    glm::vec3 item_max;
+                    bench_box(center, &item_min, &item_max);
+                    bvh_update(&bvh, item, item_min, item_max);
+                }
+                start = std::chrono::steady_clock::now();
+                rebuilt += bvh_refit(&bvh);
+                refit_time += bench_elapsed(start);
+            }
+            if (!bench_round(bvh, &frustum_times, &box_times, &ray_times)) {
+                return 1;
+            }
+        }
+
+        unsigned int query_count = rounds * QUERIES_PER_ROUND;
+        printf("%6u objects: build %.3f ms, refit %.3f ms on average with %u subtrees rebuilt\n", count, build_time, rounds > 1 ? refit_time / (rounds - 1) : 0.0, rebuilt);
+        bench_print("frustum", frustum_times, query_count);
+        bench_print("box", box_times, query_count);
+        bench_print("ray", ray_times, query_count);
+    }
+    printf("all %u queries of each kind match brute force\n", rounds * QUERIES_PER_ROUND * (unsigned int)(sizeof(OBJECT_COUNTS) / sizeof(OBJECT_COUNTS[0])));
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+// Compares scalar and SIMD frustum culling of world space boxes.
+// The boxes are unit sized objects scattered over a square map, seen by a strategy camera looking down at part of it.
+// Build with make bench BENCHFLAGS="-O2 -mavx2" to time the AVX kernel instead of the SSE one.
+//
+// usage: cull_bench [runs]
+
+#include "../src/cull.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+const float MAP_SIZE = 2000.0f;
+const unsigned int OBJECT_COUNTS[] = { 10000, 100000, 1000000 };
+
+void bench_generate(CullBoxes* boxes, unsigned int count) {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-MAP_SIZE / 2.0f, MAP_SIZE / 2.0f);
+    std::uniform_real_distribution<float> size(0.5f, 2.0f);
+    cull_boxes_clear(boxes);
+    for (unsigned int i = 0; i < count; i++) {
+        glm::vec3 center = glm::vec3(position(random), 0.0f, position(random));
+        glm::vec3 extents = glm::vec3(size(random), size(random), size(random));
+        cull_boxes_add(boxes, center - extents, center + extents);
+    }
+}
+
+double bench_run(unsigned int runs, const CullFrustum& frustum, const CullBoxes& boxes, bool simd, std::vector<unsigned int>* visible) {
+    double best = 0.0;
+    for (unsigned int i = 0; i < runs; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (simd) {
+            cull_frustum_boxes(frustum, boxes, visible);
+        } else {
+            cull_frustum_boxes_scalar(frustum, boxes, visible);
+        }
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char** argv) {
+    unsigned int runs = argc > 1 ? std::atoi(argv[1]) : 20;
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 400.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 120.0f, 120.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    CullFrustum frustum;
+    cull_frustum_extract(&frustum, projection * view);
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+    const char* kernel = "avx";
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const char* kernel = "sse";
+#else
+    const char* kernel = "scalar fallback";
+#endif
+    printf("kernel: %s, best of %u runs\n", kernel, runs);
+
+    for (unsigned int count : OBJECT_COUNTS) {
+        CullBoxes boxes;
+        bench_generate(&boxes, count);
+
+        std::vector<unsigned int> scalar_visible;
+        std::vector<unsigned int> simd_visible;
+        double scalar_time = bench_run(runs, frustum, boxes, false, &scalar_visible);
+        double simd_time = bench_run(runs, frustum, boxes, true, &simd_visible);
+
+        printf("%7u objects, %6zu visible\n", count, simd_visible.size());
+        printf("  scalar: %8.3f ms (%9.0f objects/ms)\n", scalar_time, count / scalar_time);
+        printf("  simd:   %8.3f ms (%9.0f objects/ms)\n", simd_time, count / simd_time);
+        printf("  speedup: %7.2fx\n", scalar_time / simd_time);
+        if (scalar_visible != simd_visible) {
+            printf("error: scalar and simd results differ\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+// Compares serial and parallel OBJ parsing on a large synthetic model.
+// The model is res/car/car.obj repeated until it reaches the requested size.
+//
+// usage: obj_bench [megabytes] [runs]
+
+#include "../src/obj.hpp"
+#include "../src/worker.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+const char* SOURCE_PATH = "./res/car/car.obj";
+const char* BENCH_PATH = "./bench_car.obj";
+
+bool bench_generate(std::size_t target_size) {
+    std::ifstream source_file(SOURCE_PATH);
+    if (!source_file.is_open()) {
+        printf("Unable to open %s, run the benchmark from the repo root\n", SOURCE_PATH);
+        return false;
+    }
+
+    std::vector<std::string> lines;
+    std::string line;
+    unsigned int counts[3] = { 0, 0, 0 };
+    while (std::getline(source_file, line)) {
+        if (line.rfind("v ", 0) == 0) {
+            counts[0]++;
+        } else if (line.rfind("vt ", 0) == 0) {
+            counts[1]++;
+        } else if (line.rfind("vn ", 0) == 0) {
+            counts[2]++;
+        }
+        lines.push_back(line);
+    }
+
+    std::ofstream bench_file(BENCH_PATH);
+    std::size_t size = 0;
+    for (unsigned int copy = 0; size < target_size; copy++) {
+        std::ostringstream output;
+        for (const std::string& source_line : lines) {
+            if (source_line.rfind("o ", 0) == 0) {
+                output << source_line << "_" << copy << "\n";
+            } else if (source_line.rfind("f ", 0) == 0) {
+                // shift every index so each copy references its own vertices
+                std::istringstream corners(source_line.substr(2));
+                std::string corner;
+                output << "f";
+                while (corners >> corner) {
+                    unsigned int indices[3];
+                    sscanf(corner.c_str(), "%u/%u/%u", &indices[0], &indices[1], &indices[2]);
+                    output << " " << indices[0] + (copy * counts[0]) << "/" << indices[1] + (copy * counts[1]) << "/" << indices[2] + (copy * counts[2]);
+                }
+                output << "\n";
+            } else if (source_line.rfind("mtllib", 0) != 0 || copy == 0) {
+                output << source_line << "\n";
+            }
+        }
+        std::string chunk = output.str();
+        bench_file << chunk;
+        size += chunk.size();
+    }
+
+    return true;
+}
+
+double bench_run(unsigned int runs, ObjData* result) {
+    double best = 0.0;
+    for (unsigned int i = 0; i < runs; i++) {
+        ObjData obj;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!obj_load(&obj, BENCH_PATH)) {
+            exit(1);
+        }
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+        if (i == runs - 1) {
+            *result = obj;
+        }
+    }
+
+    return best;
+}
+
+bool bench_equal(const ObjData& a, const ObjData& b) {
+    if (a.positions != b.positions || a.texture_coordinates != b.texture_coordinates || a.normals != b.normals || a.objects.size() != b.objects.size()) {
+        return false;
+    }
+    for (std::map<std::string, ObjObject>::const_iterator it = a.objects.begin(); it != a.objects.end(); ++it) {
+        std::map<std::string, ObjObject>::const_iterator other = b.objects.find(it->first);
+        if (other == b.objects.end() || other->second.material != it->second.material || other->second.faces.size() != it->second.faces.size()) {
+            return false;
+        }
+        for (std::size_t i = 0; i < it->second.faces.size(); i++) {
+            const ObjFace& face = it->second.faces[i];
+            const ObjFace& other_face = other->second.faces[i];
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                if (face.position_indices[corner] != other_face.position_indices[corner] ||
+                        face.texture_coordinate_indices[corner] != other_face.texture_coordinate_indices[corner] ||
+                        face.normal_indices[corner] != other_face.normal_indices[corner]) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::size_t megabytes = argc > 1 ? std::atoi(argv[1]) : 64;
+    unsigned int runs = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    if (!bench_generate(megabytes * 1024 * 1024)) {
+        return 1;
+    }
+
+    ObjData serial_result;
+    double serial_time = bench_run(runs, &serial_result);
+
+    worker_init();
+    ObjData parallel_result;
+    double parallel_time = bench_run(runs, &parallel_result);
+    unsigned int thread_count = worker_thread_count();
+    worker_quit();
+
+    std::remove(BENCH_PATH);
+
+    printf("model: %zu MB, %zu positions, %zu objects\n", megabytes, serial_result.positions.size(), serial_result.objects.size());
+    printf("serial:   %8.2f ms (%7.1f MB/s)\n", serial_time, megabytes / (serial_time / 1000.0));
+    printf("parallel: %8.2f ms (%7.1f MB/s) on %u threads\n", parallel_time, megabytes / (parallel_time / 1000.0), thread_count);
+    printf("speedup:  %8.2fx\n", serial_time / parallel_time);
+    if (!bench_equal(serial_result, parallel_result)) {
+        printf("error: serial and parallel results differ\n");
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file
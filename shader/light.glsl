@@ -5,8 +5,12 @@ layout (location = 0) in vec3 a_pos;
 layout (location = 1) in vec3 a_normal;
 layout (location = 2) in vec2 a_texture_coordinate;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec3 view_pos;
+};
+
 uniform mat4 model;
 
 void main() {
@@ -4,21 +4,45 @@
 layout (location = 0) in vec3 a_pos;
 layout (location = 1) in vec3 a_normal;
 layout (location = 2) in vec2 a_texture_coordinate;
+layout (location = 3) in mat4 a_instance_model;
+// xyz is the position scale and w the skin layer
+layout (location = 7) in vec4 a_instance_position_scale;
 
 out vec3 frag_pos;
 out vec3 normal;
 out vec2 texture_coordinate;
+flat out float skin;
+
+layout (std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec3 view_pos;
+};
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
+uniform bool instanced;
+uniform vec3 position_scale;
+uniform float skin_layer;
+uniform bool octahedral_normal;
+
+vec3 decode_octahedral(vec2 encoded) {
+    vec3 decoded = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-decoded.z, 0.0);
+    decoded.x += decoded.x >= 0.0 ? -fold : fold;
+    decoded.y += decoded.y >= 0.0 ? -fold : fold;
+    return normalize(decoded);
+}
 
 void main() {
-    gl_Position = projection * view * model * vec4(a_pos, 1.0);
+    vec3 position = a_pos * (instanced ? a_instance_position_scale.xyz : position_scale);
+    vec3 vertex_normal = octahedral_normal ? decode_octahedral(a_normal.xy) : a_normal;
+    mat4 vertex_model = instanced ? a_instance_model : model;
+    gl_Position = projection * view * vertex_model * vec4(position, 1.0);
 
-    frag_pos = vec3(model * vec4(a_pos, 1.0));
-    normal = normalize(mat3(transpose(inverse(model))) * a_normal);
+    frag_pos = vec3(vertex_model * vec4(position, 1.0));
+    normal = normalize(mat3(transpose(inverse(vertex_model))) * vertex_normal);
     texture_coordinate = vec2(a_texture_coordinate.x, 1 - a_texture_coordinate.y);
+    skin = instanced ? a_instance_position_scale.w : skin_layer;
 }
 
 #begin fragment
@@ -44,12 +68,24 @@ vec3 calculate_point_light(PointLight light, vec3 normal, vec3 frag_pos, vec3 vi
 in vec3 frag_pos;
 in vec3 normal;
 in vec2 texture_coordinate;
+flat in float skin;
 
 out vec4 frag_color;
 
-uniform vec3 view_pos;
-uniform PointLight point_light;
+layout (std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec3 view_pos;
+};
+
+layout (std140) uniform Lighting {
+    PointLight point_light;
+};
+
 uniform Material material;
+// when skinned, the layer of skin_map picked by skin stands in for both of the material's maps
+uniform bool skinned;
+uniform sampler2DArray skin_map;
 
 void main() {
     vec3 view_direction = normalize(view_pos - frag_pos);
@@ -57,11 +93,12 @@ void main() {
 }
 
 vec3 calculate_point_light(PointLight light, vec3 normal, vec3 frag_pos, vec3 view_direction) {
-    vec3 ambient = material.ka * vec3(texture(material.map_ka, texture_coordinate));
+    vec3 skin_color = skinned ? vec3(texture(skin_map, vec3(texture_coordinate, skin))) : vec3(1.0);
+    vec3 ambient = material.ka * (skinned ? skin_color : vec3(texture(material.map_ka, texture_coordinate)));
 
     vec3 light_direction = normalize(light.position - frag_pos);
     float diffuse_strength = max(dot(normal, light_direction), 0.0); 
-    vec3 diffuse_color = material.kd * vec3(texture(material.map_kd, texture_coordinate));
+    vec3 diffuse_color = material.kd * (skinned ? skin_color : vec3(texture(material.map_kd, texture_coordinate)));
     vec3 diffuse = diffuse_strength * diffuse_color;
 
     vec3 reflect_direction = reflect(-light_direction, normal);
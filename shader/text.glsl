@@ -2,33 +2,35 @@
 #begin vertex
 
 layout (location = 0) in vec2 vertex_position;
+// per glyph
+layout (location = 1) in vec2 glyph_render_coords;
+layout (location = 2) in vec2 glyph_texture_offset;
+layout (location = 3) in vec3 glyph_color;
 
-out vec2 fragment_vertex_pos;
+out vec2 texture_coordinate;
+flat out vec3 font_color;
 
 uniform vec2 screen_size;
-uniform vec2 render_coords;
 uniform vec2 render_size;
+uniform vec2 atlas_size;
 
 void main() {
-    vec2 render_position = vec2(render_coords.x + (vertex_position.x * render_size.x), render_coords.y + (vertex_position.y * render_size.y));
+    vec2 render_position = glyph_render_coords + (vertex_position * render_size);
     render_position = vec2((render_position.x / (screen_size.x / 2)) - 1, 1 - (render_position.y / (screen_size.y / 2)));
     gl_Position = vec4(render_position, 0.0, 1.0);
-    fragment_vertex_pos = vertex_position;
+    texture_coordinate = (glyph_texture_offset + (render_size * vertex_position)) / atlas_size;
+    font_color = glyph_color;
 }
 
 #begin fragment
 
-in vec2 fragment_vertex_pos;
+in vec2 texture_coordinate;
+flat in vec3 font_color;
 
 out vec4 color;
 
 uniform sampler2D u_texture;
-uniform vec2 texture_offset;
-uniform vec2 render_size;
-uniform vec2 atlas_size;
-uniform vec3 font_color;
 
 void main() {
-    vec2 texture_coordinate = vec2((texture_offset.x + (render_size.x * fragment_vertex_pos.x)) / atlas_size.x, (texture_offset.y + (render_size.y * fragment_vertex_pos.y)) / atlas_size.y);
     color = vec4(font_color, texture(u_texture, texture_coordinate).r);
 }
\ No newline at end of file
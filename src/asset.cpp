@@ -0,0 +1,244 @@
+#include "asset.hpp"
+
+#include "asset_stream.hpp"
+#include "texture.hpp"
+#include "mesh_buffer.hpp"
+#include "gl_state.hpp"
+
+#include <map>
+#include <vector>
+#include <cstdio>
+
+// std::map never moves its values, so pointers to entries can be handed out
+std::map<std::string, AssetTexture> asset_textures;
+std::map<std::string, AssetModel> asset_models;
+
+std::string asset_path_canonical(std::string path) {
+    for (char& c : path) {
+        if (c == '\\') {
+            c = '/';
+        }
+    }
+
+    // resolve . and .. and repeated slashes, so that every spelling of a path finds the same entry
+    std::vector<std::string> parts;
+    std::size_t part_begin = 0;
+    while (part_begin <= path.size()) {
+        std::size_t part_end = path.find('/', part_begin);
+        if (part_end == std::string::npos) {
+            part_end = path.size();
+        }
+        std::string part = path.substr(part_begin, part_end - part_begin);
+        if (part == "..") {
+            if (!parts.empty() && parts.back() != "..") {
+                parts.pop_back();
+            } else {
+                parts.push_back(part);
+            }
+        } else if (part != "" && part != ".") {
+            parts.push_back(part);
+        }
+        part_begin = part_end + 1;
+    }
+
+    std::string canonical = path.size() != 0 && path[0] == '/' ? "/" : "";
+    for (unsigned int i = 0; i < parts.size(); i++) {
+        canonical += (i == 0 ? "" : "/") + parts[i];
+    }
+
+    return canonical;
+}
+
+GLuint asset_texture_load(std::string path) {
+    path = asset_path_canonical(path);
+    std::map<std::string, AssetTexture>::iterator it = asset_textures.find(path);
+    if (it != asset_textures.end()) {
+        it->second.references++;
+        return it->second.texture;
+    }
+
+    GLuint texture;
+    if (!model_texture_load(&texture, path)) {
+        return 0;
+    }
+    asset_textures[path] = (AssetTexture) {
+        .path = path,
+        .texture = texture,
+        .references = 1,
+        .streaming = false,
+        .stream_handle = 0,
+        .bytes = texture_size(texture)
+    };
+
+    return texture;
+}
+
+AssetTexture* asset_texture_stream(std::string path) {
+    path = asset_path_canonical(path);
+    std::map<std::string, AssetTexture>::iterator it = asset_textures.find(path);
+    if (it != asset_textures.end()) {
+        it->second.references++;
+        return &it->second;
+    }
+
+    AssetTexture& entry = asset_textures[path];
+    entry = (AssetTexture) {
+        .path = path,
+        .texture = 0,
+        .references = 1,
+        .streaming = true,
+        .stream_handle = 0,
+        .bytes = 0
+    };
+    entry.stream_handle = asset_stream_texture(&entry.texture, path);
+
+    return &entry;
+}
+
+bool asset_texture_loading(const AssetTexture* texture) {
+    return texture->streaming && asset_stream_state(texture->stream_handle) == ASSET_STREAM_LOADING;
+}
+
+static void asset_texture_free(std::map<std::string, AssetTexture>::iterator it) {
+    if (it->second.texture != 0) {
+        gl_state_forget_texture(it->second.texture);
+        glDeleteTextures(1, &it->second.texture);
+    }
+    asset_textures.erase(it);
+}
+
+void asset_texture_release_entry(AssetTexture* texture) {
+    texture->references--;
+    // a texture that is still streaming in gets freed by asset_update once it's done
+    if (texture->references == 0 && !asset_texture_loading(texture)) {
+        asset_texture_free(asset_textures.find(texture->path));
+    }
+}
+
+void asset_texture_release(GLuint texture) {
+    if (texture == 0) {
+        return;
+    }
+    for (std::map<std::string, AssetTexture>::iterator it = asset_textures.begin(); it != asset_textures.end(); ++it) {
+        if (it->second.texture == texture) {
+            asset_texture_release_entry(&it->second);
+            return;
+        }
+    }
+}
+
+Model* asset_model_load(std::string path) {
+    path = asset_path_canonical(path);
+    std::map<std::string, AssetModel>::iterator it = asset_models.find(path);
+    if (it != asset_models.end()) {
+        it->second.references++;
+        return &it->second.model;
+    }
+
+    AssetModel& entry = asset_models[path];
+    entry.path = path;
+    entry.references = 1;
+    entry.streaming = false;
+    entry.stream_handle = 0;
+    if (!model_load(&entry.model, path)) {
+        asset_models.erase(path);
+        return NULL;
+    }
+
+    return &entry.model;
+}
+
+Model* asset_model_stream(std::string path) {
+    path = asset_path_canonical(path);
+    std::map<std::string, AssetModel>::iterator it = asset_models.find(path);
+    if (it != asset_models.end()) {
+        it->second.references++;
+        return &it->second.model;
+    }
+
+    AssetModel& entry = asset_models[path];
+    entry.path = path;
+    entry.references = 1;
+    entry.streaming = true;
+    entry.stream_handle = asset_stream_model(&entry.model, path);
+
+    return &entry.model;
+}
+
+static void asset_model_free(std::map<std::string, AssetModel>::iterator it) {
+    Model& model = it->second.model;
+    for (std::map<std::string, Mesh>::iterator mesh_it = model.mesh.begin(); mesh_it != model.mesh.end(); ++mesh_it) {
+        mesh_buffer_free(mesh_it->second);
+    }
+    for (std::map<std::string, Material>::iterator material_it = model.material.begin(); material_it != model.material.end(); ++material_it) {
+        asset_texture_release(material_it->second.map_ka);
+        asset_texture_release(material_it->second.map_kd);
+    }
+    asset_models.erase(it);
+}
+
+void asset_model_release(Model* model) {
+    for (std::map<std::string, AssetModel>::iterator it = asset_models.begin(); it != asset_models.end(); ++it) {
+        if (&it->second.model != model) {
+            continue;
+        }
+        it->second.references--;
+        if (it->second.references == 0 && !(it->second.streaming && asset_stream_state(it->second.stream_handle) == ASSET_STREAM_LOADING)) {
+            asset_model_free(it);
+        }
+        return;
+    }
+}
+
+void asset_update() {
+    for (std::map<std::string, AssetTexture>::iterator it = asset_textures.begin(); it != asset_textures.end();) {
+        std::map<std::string, AssetTexture>::iterator next = std::next(it);
+        if (!asset_texture_loading(&it->second)) {
+            if (it->second.streaming) {
+                it->second.streaming = false;
+                it->second.bytes = texture_size(it->second.texture);
+            }
+            if (it->second.references == 0) {
+                asset_texture_free(it);
+            }
+        }
+        it = next;
+    }
+
+    for (std::map<std::string, AssetModel>::iterator it = asset_models.begin(); it != asset_models.end();) {
+        std::map<std::string, AssetModel>::iterator next = std::next(it);
+        if (it->second.streaming && asset_stream_state(it->second.stream_handle) != ASSET_STREAM_LOADING) {
+            it->second.streaming = false;
+        }
+        if (!it->second.streaming && it->second.references == 0) {
+            asset_model_free(it);
+        }
+        it = next;
+    }
+}
+
+std::size_t asset_model_bytes(const Model& model) {
+    // textures are counted on their own since models share them
+    std::size_t bytes = 0;
+    for (std::map<std::string, Mesh>::const_iterator it = model.mesh.begin(); it != model.mesh.end(); ++it) {
+        bytes += (std::size_t)it->second.vertex_data_size * model_vertex_size(it->second.vertex_format);
+        bytes += (std::size_t)it->second.index_count * model_index_size(it->second.index_type);
+    }
+
+    return bytes;
+}
+
+void asset_report() {
+    std::size_t texture_bytes = 0;
+    std::size_t model_bytes = 0;
+    for (std::map<std::string, AssetTexture>::iterator it = asset_textures.begin(); it != asset_textures.end(); ++it) {
+        printf("Texture %s: %u references, %zu bytes\n", it->first.c_str(), it->second.references, it->second.bytes);
+        texture_bytes += it->second.bytes;
+    }
+    for (std::map<std::string, AssetModel>::iterator it = asset_models.begin(); it != asset_models.end(); ++it) {
+        std::size_t bytes = asset_model_bytes(it->second.model);
+        printf("Model %s: %u references, %zu bytes\n", it->first.c_str(), it->second.references, bytes);
+        model_bytes += bytes;
+    }
+    printf("Assets: %zu textures using %zu bytes, %zu models using %zu bytes\n", asset_textures.size(), texture_bytes, asset_models.size(), model_bytes);
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "model.hpp"
+
+#include <glad/glad.h>
+#include <string>
+#include <cstddef>
+
+// Registry of every loaded texture and model, keyed by canonical path.
+// Loading something that is already loaded hands out the same copy and adds a reference, and its GPU memory is freed once the last reference is released.
+
+struct AssetTexture {
+    std::string path;
+    // 0 while streaming in, and stays 0 if loading failed
+    GLuint texture;
+    unsigned int references;
+    bool streaming;
+    unsigned int stream_handle;
+    std::size_t bytes;
+};
+
+struct AssetModel {
+    std::string path;
+    Model model;
+    unsigned int references;
+    bool streaming;
+    unsigned int stream_handle;
+};
+
+std::string asset_path_canonical(std::string path);
+
+// loads right away. a texture that is already streaming in is shared as is, so it may still be 0
+GLuint asset_texture_load(std::string path);
+// starts streaming the texture in unless it is already loaded. the entry stays valid until its last reference is released
+AssetTexture* asset_texture_stream(std::string path);
+bool asset_texture_loading(const AssetTexture* texture);
+void asset_texture_release(GLuint texture);
+void asset_texture_release_entry(AssetTexture* texture);
+
+// returns NULL if the model couldn't be loaded
+Model* asset_model_load(std::string path);
+// the model is empty until it has finished streaming in
+Model* asset_model_stream(std::string path);
+void asset_model_release(Model* model);
+
+// picks up finished streams and frees anything whose last reference went away while it was still streaming in.
+// call once a frame after asset_stream_update
+void asset_update();
+std::size_t asset_model_bytes(const Model& model);
+// prints the GPU memory held by every asset
+void asset_report();
\ No newline at end of file
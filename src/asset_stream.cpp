@@ -0,0 +1,372 @@
+#include "asset_stream.hpp"
+
+#include "mesh_cache.hpp"
+#include "asset.hpp"
+#include "worker.hpp"
+#include "texture.hpp"
+#include "mesh_buffer.hpp"
+#include "gl_state.hpp"
+#include "upload_ring.hpp"
+
+#include <SDL2/SDL.h>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+static const char* ASSET_STREAM_TRACE_PATH = "./stream_trace.csv";
+
+struct AssetStreamTexture {
+    // written once the texture is completely uploaded
+    GLuint* target;
+    TextureData data;
+    GLuint texture;
+    unsigned int level;
+    unsigned int uploaded_rows;
+};
+
+// a material map of a model job, waiting on the asset registry to finish loading it
+struct AssetStreamMaterialMap {
+    GLuint* target;
+    AssetTexture* texture;
+};
+
+struct AssetStreamJob {
+    unsigned int handle;
+    std::string path;
+    bool decoded;
+
+    // model jobs build the model on the side and copy it into place once everything is uploaded
+    Model* model;
+    Model staging;
+    MeshCache cache;
+    unsigned int mesh_index;
+    bool mesh_created;
+    std::size_t mesh_uploaded_bytes;
+    // textures go through the registry so that models share them, which means they are requested once the meshes are up
+    bool materials_requested;
+    std::vector<AssetStreamMaterialMap> material_maps;
+
+    // the one texture of a texture job
+    std::vector<AssetStreamTexture> textures;
+    unsigned int texture_index;
+};
+
+enum AssetStreamStep {
+    ASSET_STREAM_STEP_UPLOADED,
+    // the next piece doesn't fit in what is left of this frame's budget
+    ASSET_STREAM_STEP_BUDGET_FULL,
+    // the job is waiting on another job, so move on to the next one
+    ASSET_STREAM_STEP_WAITING,
+    ASSET_STREAM_STEP_DONE
+};
+
+struct AssetStreamTraceFrame {
+    float frame_milliseconds;
+    float upload_milliseconds;
+    unsigned int upload_bytes;
+    unsigned int pending;
+};
+
+bool asset_stream_trace = false;
+
+// jobs move from the workers to the render thread through the decoded queue, everything else is only touched by the render thread
+std::mutex asset_stream_mutex;
+std::deque<AssetStreamJob*> asset_stream_decoded;
+std::deque<AssetStreamJob*> asset_stream_uploads;
+std::vector<AssetStreamState> asset_stream_states;
+unsigned int asset_stream_pending = 0;
+
+std::vector<AssetStreamTraceFrame> asset_stream_trace_frames;
+float asset_stream_frame_upload_milliseconds = 0.0f;
+unsigned int asset_stream_frame_upload_bytes = 0;
+
+bool asset_stream_init() {
+    return true;
+}
+
+static void asset_stream_job_free(AssetStreamJob* job) {
+    for (const AssetStreamMaterialMap& material_map : job->material_maps) {
+        asset_texture_release_entry(material_map.texture);
+    }
+    for (AssetStreamTexture& texture : job->textures) {
+        // the texture only goes to its target once every level is up, so until then it belongs to the job
+        if (texture.level < texture.data.level.size()) {
+            texture_data_close(&texture.data);
+            if (texture.texture != 0) {
+                gl_state_forget_texture(texture.texture);
+                glDeleteTextures(1, &texture.texture);
+            }
+        }
+    }
+    if (job->model != NULL && job->decoded) {
+        mesh_cache_close(&job->cache);
+    }
+    delete job;
+}
+
+static void asset_stream_trace_write() {
+    FILE* trace_file = fopen(ASSET_STREAM_TRACE_PATH, "w");
+    if (trace_file == NULL) {
+        printf("Unable to write stream trace %s\n", ASSET_STREAM_TRACE_PATH);
+        return;
+    }
+
+    float slowest_frame = 0.0f;
+    float slowest_upload = 0.0f;
+    unsigned int largest_upload = 0;
+    fprintf(trace_file, "frame,frame_ms,upload_ms,upload_bytes,pending\n");
+    for (unsigned int i = 0; i < asset_stream_trace_frames.size(); i++) {
+        const AssetStreamTraceFrame& frame = asset_stream_trace_frames[i];
+        fprintf(trace_file, "%u,%.3f,%.3f,%u,%u\n", i, frame.frame_milliseconds, frame.upload_milliseconds, frame.upload_bytes, frame.pending);
+        slowest_frame = std::max(slowest_frame, frame.frame_milliseconds);
+        slowest_upload = std::max(slowest_upload, frame.upload_milliseconds);
+        largest_upload = std::max(largest_upload, frame.upload_bytes);
+    }
+    fclose(trace_file);
+
+    printf("Wrote stream trace %s: %u frames, slowest frame %.2fms, slowest upload %.2fms of %.2fms budget, largest upload %u of %u bytes\n",
+        ASSET_STREAM_TRACE_PATH, (unsigned int)asset_stream_trace_frames.size(), slowest_frame,
+        slowest_upload, ASSET_STREAM_FRAME_MILLISECONDS, largest_upload, ASSET_STREAM_FRAME_BYTES);
+}
+
+void asset_stream_quit() {
+    // the workers have finished by now, so every job that is left is sitting in one of the queues
+    for (AssetStreamJob* job : asset_stream_decoded) {
+        asset_stream_job_free(job);
+    }
+    for (AssetStreamJob* job : asset_stream_uploads) {
+        asset_stream_job_free(job);
+    }
+    asset_stream_decoded.clear();
+    asset_stream_uploads.clear();
+
+    if (asset_stream_trace) {
+        asset_stream_trace_write();
+    }
+}
+
+static AssetStreamJob* asset_stream_job_create(std::string path) {
+    AssetStreamJob* job = new AssetStreamJob();
+    job->handle = asset_stream_states.size();
+    job->path = path;
+    job->decoded = false;
+    job->model = NULL;
+    job->mesh_index = 0;
+    job->mesh_created = false;
+    job->mesh_uploaded_bytes = 0;
+    job->materials_requested = false;
+    job->texture_index = 0;
+    asset_stream_states.push_back(ASSET_STREAM_LOADING);
+    asset_stream_pending++;
+
+    return job;
+}
+
+static void asset_stream_job_decoded(AssetStreamJob* job) {
+    std::lock_guard<std::mutex> lock(asset_stream_mutex);
+    asset_stream_decoded.push_back(job);
+}
+
+static void asset_stream_texture_decode(AssetStreamJob* job, GLuint* target, std::string path) {
+    // loaded in place, since the levels point into the texture data
+    job->textures.resize(1);
+    AssetStreamTexture& texture = job->textures.back();
+    texture.target = target;
+    texture.texture = 0;
+    texture.level = 0;
+    texture.uploaded_rows = 0;
+    if (!texture_data_load(&texture.data, path)) {
+        job->textures.clear();
+    }
+}
+
+unsigned int asset_stream_model(Model* model, std::string path) {
+    AssetStreamJob* job = asset_stream_job_create(path);
+    job->model = model;
+
+    worker_submit([job] {
+        job->decoded = mesh_cache_load(&job->cache, job->path);
+        asset_stream_job_decoded(job);
+    });
+
+    return job->handle;
+}
+
+unsigned int asset_stream_texture(GLuint* texture, std::string path) {
+    AssetStreamJob* job = asset_stream_job_create(path);
+
+    worker_submit([job, texture] {
+        asset_stream_texture_decode(job, texture, job->path);
+        job->decoded = !job->textures.empty();
+        asset_stream_job_decoded(job);
+    });
+
+    return job->handle;
+}
+
+AssetStreamState asset_stream_state(unsigned int handle) {
+    return asset_stream_states[handle];
+}
+
+bool asset_stream_busy() {
+    return asset_stream_pending != 0;
+}
+
+// uploads one piece of the job, no larger than byte_budget. a texture row larger than the whole frame budget goes through on its own
+static AssetStreamStep asset_stream_upload_step(AssetStreamJob* job, unsigned int byte_budget, unsigned int* bytes_uploaded) {
+    if (job->mesh_index < job->cache.mesh.size()) {
+        const MeshCacheMesh& cache_mesh = job->cache.mesh[job->mesh_index];
+        Mesh& mesh = job->staging.mesh[cache_mesh.name];
+        std::size_t vertex_bytes = cache_mesh.vertex_count * model_vertex_size(cache_mesh.vertex_format);
+        std::size_t index_bytes = cache_mesh.index_count * model_index_size(cache_mesh.index_type);
+        if (!job->mesh_created) {
+            model_mesh_from_cache(&mesh, cache_mesh);
+            model_mesh_create(&mesh, cache_mesh.vertex_count, cache_mesh.index_count, cache_mesh.index_type);
+            job->mesh_created = true;
+            job->mesh_uploaded_bytes = 0;
+        }
+
+        if (job->mesh_uploaded_bytes < vertex_bytes + index_bytes) {
+            bool uploading_vertices = job->mesh_uploaded_bytes < vertex_bytes;
+            std::size_t begin = uploading_vertices ? job->mesh_uploaded_bytes : job->mesh_uploaded_bytes - vertex_bytes;
+            std::size_t size = std::min((std::size_t)byte_budget, (uploading_vertices ? vertex_bytes : index_bytes) - begin);
+            const char* data = (const char*)(uploading_vertices ? cache_mesh.vertices : cache_mesh.indices);
+
+            if (uploading_vertices) {
+                mesh_buffer_upload_vertices(mesh, begin, size, data + begin);
+            } else {
+                mesh_buffer_upload_indices(mesh, begin, size, data + begin);
+            }
+            job->mesh_uploaded_bytes += size;
+            *bytes_uploaded += size;
+        }
+        if (job->mesh_uploaded_bytes == vertex_bytes + index_bytes) {
+            job->mesh_index++;
+            job->mesh_created = false;
+        }
+
+        return ASSET_STREAM_STEP_UPLOADED;
+    }
+
+    if (job->model != NULL && !job->materials_requested) {
+        for (std::map<std::string, ObjMaterial>::iterator it = job->cache.material.begin(); it != job->cache.material.end(); ++it) {
+            Material& material = job->staging.material[it->first];
+            material = model_material(it->second);
+            if (model_material_map_supported(it->second.map_ka)) {
+                job->material_maps.push_back((AssetStreamMaterialMap) { .target = &material.map_ka, .texture = asset_texture_stream(it->second.map_ka) });
+            }
+            if (model_material_map_supported(it->second.map_kd)) {
+                job->material_maps.push_back((AssetStreamMaterialMap) { .target = &material.map_kd, .texture = asset_texture_stream(it->second.map_kd) });
+            }
+        }
+        job->materials_requested = true;
+    }
+    for (const AssetStreamMaterialMap& material_map : job->material_maps) {
+        if (asset_texture_loading(material_map.texture)) {
+            return ASSET_STREAM_STEP_WAITING;
+        }
+    }
+    for (const AssetStreamMaterialMap& material_map : job->material_maps) {
+        *material_map.target = material_map.texture->texture;
+        // the material falls back to the null texture, so a map that failed to load isn't kept around
+        if (material_map.texture->texture == 0) {
+            asset_texture_release_entry(material_map.texture);
+        }
+    }
+    job->material_maps.clear();
+
+    if (job->texture_index < job->textures.size()) {
+        AssetStreamTexture& texture = job->textures[job->texture_index];
+        const TextureLevel& level = texture.data.level[texture.level];
+        if (texture.texture == 0) {
+            texture_create(&texture.texture, texture.data);
+        }
+
+        // copy a band of block rows into the upload ring. the driver copies it into the texture in the background, so the memcpy is all this frame pays for
+        std::size_t row_size = texture_level_row_size(texture.data, texture.level);
+        unsigned int rows = std::min((unsigned int)(byte_budget / row_size), texture_level_row_count(texture.data, texture.level) - texture.uploaded_rows);
+        if (rows == 0 && byte_budget < ASSET_STREAM_FRAME_BYTES) {
+            return ASSET_STREAM_STEP_BUDGET_FULL;
+        }
+        rows = std::max(rows, 1u);
+        std::size_t size = (std::size_t)rows * row_size;
+        UploadRingRange range = upload_ring_upload(level.data + ((std::size_t)texture.uploaded_rows * row_size), size, sizeof(GLuint));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, range.buffer);
+        gl_state_bind_texture(0, texture.texture);
+        texture_upload_rows(texture.data, texture.level, texture.uploaded_rows, rows, (void*)range.offset);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        texture.uploaded_rows += rows;
+        *bytes_uploaded += size;
+
+        if (texture.uploaded_rows == texture_level_row_count(texture.data, texture.level)) {
+            texture.level++;
+            texture.uploaded_rows = 0;
+        }
+        if (texture.level == texture.data.level.size()) {
+            *texture.target = texture.texture;
+            texture_data_close(&texture.data);
+            job->texture_index++;
+        }
+
+        return ASSET_STREAM_STEP_UPLOADED;
+    }
+
+    return ASSET_STREAM_STEP_DONE;
+}
+
+void asset_stream_update() {
+    {
+        std::lock_guard<std::mutex> lock(asset_stream_mutex);
+        asset_stream_uploads.insert(asset_stream_uploads.end(), asset_stream_decoded.begin(), asset_stream_decoded.end());
+        asset_stream_decoded.clear();
+    }
+
+    Uint64 start_time = SDL_GetPerformanceCounter();
+    float elapsed = 0.0f;
+    unsigned int bytes_uploaded = 0;
+    std::deque<AssetStreamJob*>::iterator it = asset_stream_uploads.begin();
+    while (it != asset_stream_uploads.end() && bytes_uploaded < ASSET_STREAM_FRAME_BYTES && elapsed < ASSET_STREAM_FRAME_MILLISECONDS) {
+        AssetStreamJob* job = *it;
+        AssetStreamStep step = job->decoded ? asset_stream_upload_step(job, ASSET_STREAM_FRAME_BYTES - bytes_uploaded, &bytes_uploaded) : ASSET_STREAM_STEP_DONE;
+        if (step == ASSET_STREAM_STEP_BUDGET_FULL) {
+            break;
+        } else if (step == ASSET_STREAM_STEP_WAITING) {
+            ++it;
+            continue;
+        } else if (step == ASSET_STREAM_STEP_UPLOADED) {
+            elapsed = (float)(SDL_GetPerformanceCounter() - start_time) * 1000.0f / (float)SDL_GetPerformanceFrequency();
+            continue;
+        }
+
+        if (job->decoded) {
+            if (job->model != NULL) {
+                *job->model = job->staging;
+            }
+            asset_stream_states[job->handle] = ASSET_STREAM_READY;
+        } else {
+            printf("Unable to stream asset %s\n", job->path.c_str());
+            asset_stream_states[job->handle] = ASSET_STREAM_FAILED;
+        }
+        it = asset_stream_uploads.erase(it);
+        asset_stream_job_free(job);
+        asset_stream_pending--;
+    }
+
+    asset_stream_frame_upload_milliseconds = (float)(SDL_GetPerformanceCounter() - start_time) * 1000.0f / (float)SDL_GetPerformanceFrequency();
+    asset_stream_frame_upload_bytes = bytes_uploaded;
+}
+
+void asset_stream_trace_frame(float frame_milliseconds) {
+    if (!asset_stream_trace) {
+        return;
+    }
+    asset_stream_trace_frames.push_back((AssetStreamTraceFrame) {
+        .frame_milliseconds = frame_milliseconds,
+        .upload_milliseconds = asset_stream_frame_upload_milliseconds,
+        .upload_bytes = asset_stream_frame_upload_bytes,
+        .pending = asset_stream_pending
+    });
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "model.hpp"
+
+#include <glad/glad.h>
+#include <string>
+
+// Loads assets in the background. Files are read and decoded on the worker threads, then uploaded to the GPU
+// a piece at a time from asset_stream_update, so that no frame spends more than the upload budget on them.
+
+enum AssetStreamState {
+    ASSET_STREAM_LOADING,
+    ASSET_STREAM_READY,
+    ASSET_STREAM_FAILED
+};
+
+// upload budget per frame. a frame may go over the time budget by at most one piece of work
+const unsigned int ASSET_STREAM_FRAME_BYTES = 1024 * 1024;
+const float ASSET_STREAM_FRAME_MILLISECONDS = 2.0f;
+
+// when set, every frame is recorded and written to ./stream_trace.csv by asset_stream_quit
+extern bool asset_stream_trace;
+
+bool asset_stream_init();
+void asset_stream_quit();
+// these return a handle right away. the target is only written once the asset is completely uploaded, so it can keep being used until then
+unsigned int asset_stream_model(Model* model, std::string path);
+unsigned int asset_stream_texture(GLuint* texture, std::string path);
+AssetStreamState asset_stream_state(unsigned int handle);
+// true while any asset is still loading
+bool asset_stream_busy();
+// uploads decoded assets within the frame budget. must be called once a frame from the thread that owns the GL context
+void asset_stream_update();
+// records how long the whole frame took, for the trace
+void asset_stream_trace_frame(float frame_milliseconds);
\ No newline at end of file
@@ -0,0 +1,340 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <limits>
+
+struct BvhBin {
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    unsigned int count;
+};
+
+static float bvh_area(glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    glm::vec3 size = glm::max(bounds_max - bounds_min, glm::vec3(0.0f));
+    return 2.0f * ((size.x * size.y) + (size.y * size.z) + (size.z * size.x));
+}
+
+static void bvh_empty_bounds(glm::vec3* bounds_min, glm::vec3* bounds_max) {
+    *bounds_min = glm::vec3(std::numeric_limits<float>::max());
+    *bounds_max = glm::vec3(-std::numeric_limits<float>::max());
+}
+
+static void bvh_grow_bounds(glm::vec3* bounds_min, glm::vec3* bounds_max, glm::vec3 other_min, glm::vec3 other_max) {
+    *bounds_min = glm::min(*bounds_min, other_min);
+    *bounds_max = glm::max(*bounds_max, other_max);
+}
+
+static bool bvh_overlaps(glm::vec3 a_min, glm::vec3 a_max, glm::vec3 b_min, glm::vec3 b_max) {
+    return a_min.x <= b_max.x && a_max.x >= b_min.x && a_min.y <= b_max.y && a_max.y >= b_min.y && a_min.z <= b_max.z && a_max.z >= b_min.z;
+}
+
+// builds the subtree over items [first, first + count) into the node slots starting at node_index
+static void bvh_build_node(Bvh* bvh, unsigned int node_index, unsigned int first, unsigned int count) {
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    glm::vec3 centroid_min;
+    glm::vec3 centroid_max;
+    bvh_empty_bounds(&bounds_min, &bounds_max);
+    bvh_empty_bounds(&centroid_min, &centroid_max);
+    for (unsigned int i = first; i < first + count; i++) {
+        unsigned int item = bvh->items[i];
+        glm::vec3 centroid = (bvh->item_min[item] + bvh->item_max[item]) * 0.5f;
+        bvh_grow_bounds(&bounds_min, &bounds_max, bvh->item_min[item], bvh->item_max[item]);
+        bvh_grow_bounds(&centroid_min, &centroid_max, centroid, centroid);
+    }
+
+    BvhNode& node = bvh->nodes[node_index];
+    node.bounds_min = bounds_min;
+    node.bounds_max = bounds_max;
+    node.first = first;
+    node.count = count;
+    node.leaf = true;
+    node.right = 0;
+    node.built_area = bvh_area(bounds_min, bounds_max);
+    if (count == 1) {
+        return;
+    }
+
+    // bin the centroids along the axis they spread furthest over, then sweep the bins for the cheapest split
+    glm::vec3 centroid_size = centroid_max - centroid_min;
+    unsigned int axis = centroid_size.x > centroid_size.y ? (centroid_size.x > centroid_size.z ? 0 : 2) : (centroid_size.y > centroid_size.z ? 1 : 2);
+    unsigned int left_count = 0;
+    if (centroid_size[axis] > 0.0f) {
+        BvhBin bins[BVH_BIN_COUNT];
+        for (unsigned int bin = 0; bin < BVH_BIN_COUNT; bin++) {
+            bvh_empty_bounds(&bins[bin].bounds_min, &bins[bin].bounds_max);
+            bins[bin].count = 0;
+        }
+        float bin_scale = (float)BVH_BIN_COUNT / centroid_size[axis];
+        for (unsigned int i = first; i < first + count; i++) {
+            unsigned int item = bvh->items[i];
+            float centroid = (bvh->item_min[item][axis] + bvh->item_max[item][axis]) * 0.5f;
+            unsigned int bin = std::min((unsigned int)((centroid - centroid_min[axis]) * bin_scale), BVH_BIN_COUNT - 1);
+            bvh_grow_bounds(&bins[bin].bounds_min, &bins[bin].bounds_max, bvh->item_min[item], bvh->item_max[item]);
+            bins[bin].count++;
+        }
+
+        // area times item count of everything left of each split, then right of it
+        float left_cost[BVH_BIN_COUNT - 1];
+        glm::vec3 sweep_min;
+        glm::vec3 sweep_max;
+        unsigned int sweep_count = 0;
+        bvh_empty_bounds(&sweep_min, &sweep_max);
+        for (unsigned int split = 0; split < BVH_BIN_COUNT - 1; split++) {
+            bvh_grow_bounds(&sweep_min, &sweep_max, bins[split].bounds_min, bins[split].bounds_max);
+            sweep_count += bins[split].count;
+            left_cost[split] = sweep_count == 0 ? 0.0f : bvh_area(sweep_min, sweep_max) * sweep_count;
+        }
+        float best_cost = std::numeric_limits<float>::max();
+        unsigned int best_split = 0;
+        bvh_empty_bounds(&sweep_min, &sweep_max);
+        sweep_count = 0;
+        for (unsigned int split = BVH_BIN_COUNT - 1; split > 0; split--) {
+            bvh_grow_bounds(&sweep_min, &sweep_max, bins[split].bounds_min, bins[split].bounds_max);
+            sweep_count += bins[split].count;
+            float cost = left_cost[split - 1] + (sweep_count == 0 ? 0.0f : bvh_area(sweep_min, sweep_max) * sweep_count);
+            if (sweep_count != 0 && sweep_count != count && cost < best_cost) {
+                best_cost = cost;
+                best_split = split;
+            }
+        }
+
+        // costs are relative to testing every item, with visiting a node costing about as much as testing one item
+        float node_area = std::max(node.built_area, std::numeric_limits<float>::min());
+        if (count <= BVH_MAX_LEAF_SIZE && 1.0f + (best_cost / node_area) >= (float)count) {
+            return;
+        }
+        if (best_cost < std::numeric_limits<float>::max()) {
+            unsigned int* middle = std::partition(&bvh->items[first], &bvh->items[first] + count, [&](unsigned int item) {
+                float centroid = (bvh->item_min[item][axis] + bvh->item_max[item][axis]) * 0.5f;
+                return std::min((unsigned int)((centroid - centroid_min[axis]) * bin_scale), BVH_BIN_COUNT - 1) < best_split;
+            });
+            left_count = middle - &bvh->items[first];
+        }
+    } else if (count <= BVH_MAX_LEAF_SIZE) {
+        return;
+    }
+    // every centroid in one bin or on one point, so there's nothing better than halving the items
+    if (left_count == 0) {
+        left_count = count / 2;
+    }
+
+    node.leaf = false;
+    node.right = node_index + (2 * left_count);
+    bvh_build_node(bvh, node_index + 1, first, left_count);
+    bvh_build_node(bvh, bvh->nodes[node_index].right, first + left_count, count - left_count);
+}
+
+// clears the subtree's slots, since the new one may leave some of them unused
+static void bvh_rebuild_node(Bvh* bvh, unsigned int node_index, unsigned int first, unsigned int count) {
+    for (unsigned int i = node_index; i < node_index + (2 * count) - 1; i++) {
+        bvh->nodes[i].count = 0;
+    }
+    bvh_build_node(bvh, node_index, first, count);
+}
+
+void bvh_build(Bvh* bvh, const std::vector<glm::vec3>& bounds_min, const std::vector<glm::vec3>& bounds_max) {
+    bvh->item_min = bounds_min;
+    bvh->item_max = bounds_max;
+    bvh->items.resize(bounds_min.size());
+    for (unsigned int i = 0; i < bvh->items.size(); i++) {
+        bvh->items[i] = i;
+    }
+    bvh->nodes.clear();
+    if (bvh->items.empty()) {
+        return;
+    }
+
+    bvh->nodes.resize((2 * bvh->items.size()) - 1);
+    bvh_rebuild_node(bvh, 0, 0, bvh->items.size());
+}
+
+void bvh_update(Bvh* bvh, unsigned int item, glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    bvh->item_min[item] = bounds_min;
+    bvh->item_max[item] = bounds_max;
+}
+
+unsigned int bvh_refit(Bvh* bvh) {
+    // children always come after their parent, so going backwards refits them first
+    for (unsigned int node_index = bvh->nodes.size(); node_index-- > 0;) {
+        BvhNode& node = bvh->nodes[node_index];
+        if (node.count == 0) {
+            continue;
+        }
+        if (node.leaf) {
+            bvh_empty_bounds(&node.bounds_min, &node.bounds_max);
+            for (unsigned int i = node.first; i < node.first + node.count; i++) {
+                bvh_grow_bounds(&node.bounds_min, &node.bounds_max, bvh->item_min[bvh->items[i]], bvh->item_max[bvh->items[i]]);
+            }
+        } else {
+            const BvhNode& left = bvh->nodes[node_index + 1];
+            const BvhNode& right = bvh->nodes[node.right];
+            node.bounds_min = glm::min(left.bounds_min, right.bounds_min);
+            node.bounds_max = glm::max(left.bounds_max, right.bounds_max);
+        }
+    }
+
+    // rebuild the topmost subtrees that have grown too loose, which covers everything below them too
+    unsigned int rebuilt = 0;
+    std::vector<unsigned int> stack;
+    if (!bvh->nodes.empty()) {
+        stack.push_back(0);
+    }
+    while (!stack.empty()) {
+        unsigned int node_index = stack.back();
+        stack.pop_back();
+        const BvhNode& node = bvh->nodes[node_index];
+        if (node.leaf) {
+            continue;
+        }
+        if (bvh_area(node.bounds_min, node.bounds_max) > node.built_area * BVH_REBUILD_GROWTH) {
+            bvh_rebuild_node(bvh, node_index, node.first, node.count);
+            rebuilt++;
+            continue;
+        }
+        stack.push_back(node_index + 1);
+        stack.push_back(node.right);
+    }
+
+    return rebuilt;
+}
+
+enum BvhFrustumResult {
+    BVH_FRUSTUM_OUTSIDE,
+    BVH_FRUSTUM_INTERSECTS,
+    BVH_FRUSTUM_INSIDE
+};
+
+static BvhFrustumResult bvh_frustum_test(const CullFrustum& frustum, glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    BvhFrustumResult result = BVH_FRUSTUM_INSIDE;
+    for (unsigned int i = 0; i < 6; i++) {
+        // the corners furthest along and against the plane normal
+        glm::vec3 normal = glm::vec3(frustum.plane[i]);
+        glm::vec3 far_corner = glm::vec3(normal.x >= 0.0f ? bounds_max.x : bounds_min.x, normal.y >= 0.0f ? bounds_max.y : bounds_min.y, normal.z >= 0.0f ? bounds_max.z : bounds_min.z);
+        glm::vec3 near_corner = glm::vec3(normal.x >= 0.0f ? bounds_min.x : bounds_max.x, normal.y >= 0.0f ? bounds_min.y : bounds_max.y, normal.z >= 0.0f ? bounds_min.z : bounds_max.z);
+        if (glm::dot(normal, far_corner) + frustum.plane[i].w < 0.0f) {
+            return BVH_FRUSTUM_OUTSIDE;
+        }
+        if (glm::dot(normal, near_corner) + frustum.plane[i].w < 0.0f) {
+            result = BVH_FRUSTUM_INTERSECTS;
+        }
+    }
+
+    return result;
+}
+
+void bvh_query_frustum(const Bvh& bvh, const CullFrustum& frustum, std::vector<unsigned int>* items) {
+    items->clear();
+    std::vector<unsigned int> stack;
+    if (!bvh.nodes.empty()) {
+        stack.push_back(0);
+    }
+    while (!stack.empty()) {
+        unsigned int node_index = stack.back();
+        stack.pop_back();
+        const BvhNode& node = bvh.nodes[node_index];
+        BvhFrustumResult result = bvh_frustum_test(frustum, node.bounds_min, node.bounds_max);
+        if (result == BVH_FRUSTUM_OUTSIDE) {
+            continue;
+        }
+        // a node inside every plane takes everything below it without testing further
+        if (result == BVH_FRUSTUM_INSIDE) {
+            items->insert(items->end(), bvh.items.begin() + node.first, bvh.items.begin() + node.first + node.count);
+        } else if (node.leaf) {
+            for (unsigned int i = node.first; i < node.first + node.count; i++) {
+                if (cull_frustum_box(frustum, bvh.item_min[bvh.items[i]], bvh.item_max[bvh.items[i]])) {
+                    items->push_back(bvh.items[i]);
+                }
+            }
+        } else {
+            stack.push_back(node_index + 1);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+void bvh_query_box(const Bvh& bvh, glm::vec3 bounds_min, glm::vec3 bounds_max, std::vector<unsigned int>* items) {
+    items->clear();
+    std::vector<unsigned int> stack;
+    if (!bvh.nodes.empty()) {
+        stack.push_back(0);
+    }
+    while (!stack.empty()) {
+        unsigned int node_index = stack.back();
+        stack.pop_back();
+        const BvhNode& node = bvh.nodes[node_index];
+        if (!bvh_overlaps(node.bounds_min, node.bounds_max, bounds_min, bounds_max)) {
+            continue;
+        }
+        if (node.leaf) {
+            for (unsigned int i = node.first; i < node.first + node.count; i++) {
+                if (bvh_overlaps(bvh.item_min[bvh.items[i]], bvh.item_max[bvh.items[i]], bounds_min, bounds_max)) {
+                    items->push_back(bvh.items[i]);
+                }
+            }
+        } else {
+            stack.push_back(node_index + 1);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+// distance along the ray to where it enters the box, or infinity if it misses
+static float bvh_ray_box(glm::vec3 origin, glm::vec3 inverse_direction, float max_distance, glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    glm::vec3 t0 = (bounds_min - origin) * inverse_direction;
+    glm::vec3 t1 = (bounds_max - origin) * inverse_direction;
+    glm::vec3 t_near = glm::min(t0, t1);
+    glm::vec3 t_far = glm::max(t0, t1);
+    float enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+    float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, max_distance));
+
+    return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+bool bvh_query_ray(const Bvh& bvh, glm::vec3 origin, glm::vec3 direction, float max_distance, unsigned int* item, float* distance) {
+    // dividing by a zero component gives infinity, which the slab test handles
+    glm::vec3 inverse_direction = 1.0f / direction;
+    float nearest = max_distance;
+    bool hit = false;
+    std::vector<unsigned int> stack;
+    if (!bvh.nodes.empty() && bvh_ray_box(origin, inverse_direction, nearest, bvh.nodes[0].bounds_min, bvh.nodes[0].bounds_max) <= nearest) {
+        stack.push_back(0);
+    }
+    while (!stack.empty()) {
+        unsigned int node_index = stack.back();
+        stack.pop_back();
+        const BvhNode& node = bvh.nodes[node_index];
+        if (node.leaf) {
+            for (unsigned int i = node.first; i < node.first + node.count; i++) {
+                float item_distance = bvh_ray_box(origin, inverse_direction, nearest, bvh.item_min[bvh.items[i]], bvh.item_max[bvh.items[i]]);
+                if (item_distance <= nearest) {
+                    nearest = item_distance;
+                    *item = bvh.items[i];
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        // the nearer child goes on top of the stack, so hits found in it can rule out the other one
+        unsigned int children[2] = { node_index + 1, node.right };
+        float child_distance[2];
+        for (unsigned int child = 0; child < 2; child++) {
+            child_distance[child] = bvh_ray_box(origin, inverse_direction, nearest, bvh.nodes[children[child]].bounds_min, bvh.nodes[children[child]].bounds_max);
+        }
+        if (child_distance[0] < child_distance[1]) {
+            std::swap(children[0], children[1]);
+            std::swap(child_distance[0], child_distance[1]);
+        }
+        for (unsigned int child = 0; child < 2; child++) {
+            if (child_distance[child] <= nearest) {
+                stack.push_back(children[child]);
+            }
+        }
+    }
+    if (hit) {
+        *distance = nearest;
+    }
+
+    return hit;
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "cull.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Bounding volume hierarchy over axis aligned boxes, one per item, for culling, picking and proximity queries.
+// bvh_build splits items with the surface area heuristic. Items that move are updated in place and bvh_refit grows their nodes to match,
+// which keeps queries correct but lets the tree get looser, so refit also rebuilds any subtree whose surface area has grown too far past what it was built with.
+//
+// Nodes are stored depth first and a subtree over n items always owns 2n - 1 node slots, whether or not it uses them all.
+// That way a subtree can be rebuilt in place without touching the rest of the tree.
+
+// leaves may hold up to this many items when splitting them further wouldn't pay off
+const unsigned int BVH_MAX_LEAF_SIZE = 8;
+// candidate split planes per axis
+const unsigned int BVH_BIN_COUNT = 16;
+// a subtree is rebuilt once its surface area is this many times what it was built with
+const float BVH_REBUILD_GROWTH = 2.0f;
+
+struct BvhNode {
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    // every node covers items [first, first + count) of Bvh::items. count is 0 for unused slots
+    unsigned int first;
+    unsigned int count;
+    bool leaf;
+    // interior nodes have their left child right after them
+    unsigned int right;
+    float built_area;
+};
+
+struct Bvh {
+    std::vector<BvhNode> nodes;
+    // item ids in leaf order
+    std::vector<unsigned int> items;
+    // bounds of every item, by id
+    std::vector<glm::vec3> item_min;
+    std::vector<glm::vec3> item_max;
+};
+
+// builds the tree over items 0 to bounds_min.size() - 1
+void bvh_build(Bvh* bvh, const std::vector<glm::vec3>& bounds_min, const std::vector<glm::vec3>& bounds_max);
+// moves an item. queries use the old node bounds until bvh_refit
+void bvh_update(Bvh* bvh, unsigned int item, glm::vec3 bounds_min, glm::vec3 bounds_max);
+// refits every node to its items and returns how many subtrees were rebuilt
+unsigned int bvh_refit(Bvh* bvh);
+// the following fill items with the ids of every item whose box passes the test, in no particular order
+void bvh_query_frustum(const Bvh& bvh, const CullFrustum& frustum, std::vector<unsigned int>* items);
+void bvh_query_box(const Bvh& bvh, glm::vec3 bounds_min, glm::vec3 bounds_max, std::vector<unsigned int>* items);
+// the item whose box the ray enters first within max_distance. direction doesn't need to be normalized, distance is in units of it
+bool bvh_query_ray(const Bvh& bvh, glm::vec3 origin, glm::vec3 direction, float max_distance, unsigned int* item, float* distance);
\ No newline at end of file
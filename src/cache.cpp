@@ -0,0 +1,66 @@
+#include "cache.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+#endif
+
+static const char* CACHE_FOLDER = "./cache/";
+
+// the same source can be cooked on two threads at once, so every write gets a temp file of its own
+std::atomic<unsigned int> cache_temp_counter(0);
+
+std::string cache_path(std::string source_path, std::string extension) {
+    if (source_path.rfind("./", 0) == 0) {
+        source_path = source_path.substr(2);
+    }
+    for (char& c : source_path) {
+        bool allowed = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '-' || c == '_';
+        if (!allowed) {
+            c = '_';
+        }
+    }
+
+    return CACHE_FOLDER + source_path + extension;
+}
+
+bool cache_file_stat(std::string path, int64_t* modified_time, uint64_t* size) {
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0) {
+        return false;
+    }
+    *modified_time = (int64_t)file_stat.st_mtime;
+    *size = (uint64_t)file_stat.st_size;
+
+    return true;
+}
+
+bool cache_write(std::string path, const void* data, std::size_t size) {
+#ifdef _WIN32
+    _mkdir(CACHE_FOLDER);
+#else
+    mkdir(CACHE_FOLDER, 0755);
+#endif
+    std::string temp_path = path + "." + std::to_string(cache_temp_counter++) + ".tmp";
+    FILE* cache_file = fopen(temp_path.c_str(), "wb");
+    if (cache_file == NULL) {
+        printf("Unable to write cache %s\n", path.c_str());
+        return false;
+    }
+    bool written = fwrite(data, 1, size, cache_file) == size;
+    written = fclose(cache_file) == 0 && written;
+#ifdef _WIN32
+    // rename won't replace an existing file here. elsewhere it replaces it atomically
+    std::remove(path.c_str());
+#endif
+    if (!written || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        printf("Unable to write cache %s\n", path.c_str());
+        std::remove(temp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Files baked from source assets, stored in ./cache/ under a name derived from the source path
+
+std::string cache_path(std::string source_path, std::string extension);
+bool cache_file_stat(std::string path, int64_t* modified_time, uint64_t* size);
+// writes to a temporary file first and renames it into place, so that a crash never leaves a half written cache behind
+bool cache_write(std::string path, const void* data, std::size_t size);
\ No newline at end of file
@@ -0,0 +1,227 @@
+#include "cull.hpp"
+
+#include <algorithm>
+
+bool cull_enabled = true;
+CullFrustum cull_camera_frustum;
+CullStats cull_current_stats;
+
+CullBoxes::CullBoxes() {
+    count = 0;
+}
+
+void cull_frustum_extract(CullFrustum* frustum, const glm::mat4& projection_view) {
+    // each plane is the fourth row of the matrix plus or minus one of the others (Gribb and Hartmann)
+    glm::vec4 row[4];
+    for (unsigned int i = 0; i < 4; i++) {
+        row[i] = glm::vec4(projection_view[0][i], projection_view[1][i], projection_view[2][i], projection_view[3][i]);
+    }
+    frustum->plane[0] = row[3] + row[0];
+    frustum->plane[1] = row[3] - row[0];
+    frustum->plane[2] = row[3] + row[1];
+    frustum->plane[3] = row[3] - row[1];
+    frustum->plane[4] = row[3] + row[2];
+    frustum->plane[5] = row[3] - row[2];
+    for (unsigned int i = 0; i < 6; i++) {
+        frustum->plane[i] /= glm::length(glm::vec3(frustum->plane[i]));
+    }
+}
+
+bool cull_frustum_sphere(const CullFrustum& frustum, glm::vec3 center, float radius) {
+    for (unsigned int i = 0; i < 6; i++) {
+        if (glm::dot(glm::vec3(frustum.plane[i]), center) + frustum.plane[i].w < -radius) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool cull_frustum_box(const CullFrustum& frustum, glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    for (unsigned int i = 0; i < 6; i++) {
+        // the corner furthest along the plane normal is outside only when the whole box is
+        glm::vec3 normal = glm::vec3(frustum.plane[i]);
+        glm::vec3 corner = glm::vec3(
+            normal.x >= 0.0f ? bounds_max.x : bounds_min.x,
+            normal.y >= 0.0f ? bounds_max.y : bounds_min.y,
+            normal.z >= 0.0f ? bounds_max.z : bounds_min.z
+        );
+        if (glm::dot(normal, corner) + frustum.plane[i].w < 0.0f) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// for every plane, the arrays holding the box corner furthest along its normal
+struct CullPlaneCorners {
+    const float* x;
+    const float* y;
+    const float* z;
+};
+
+// a bit for every box of the block at offset first that no plane rules out
+static unsigned int cull_block_visible(const CullFrustum& frustum, const CullPlaneCorners* corners, unsigned int first) {
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+    __m256 outside = _mm256_setzero_ps();
+    for (unsigned int i = 0; i < 6; i++) {
+        __m256 distance = _mm256_mul_ps(_mm256_loadu_ps(corners[i].x + first), _mm256_set1_ps(frustum.plane[i].x));
+        distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_loadu_ps(corners[i].y + first), _mm256_set1_ps(frustum.plane[i].y)));
+        distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_loadu_ps(corners[i].z + first), _mm256_set1_ps(frustum.plane[i].z)));
+        distance = _mm256_add_ps(distance, _mm256_set1_ps(frustum.plane[i].w));
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+
+    return ~_mm256_movemask_ps(outside) & 0xff;
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    unsigned int visible = 0;
+    for (unsigned int half = 0; half < CULL_BOX_BLOCK; half += 4) {
+        glm_vec4 outside = _mm_setzero_ps();
+        for (unsigned int i = 0; i < 6; i++) {
+            glm_vec4 distance = _mm_mul_ps(_mm_loadu_ps(corners[i].x + first + half), _mm_set1_ps(frustum.plane[i].x));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(corners[i].y + first + half), _mm_set1_ps(frustum.plane[i].y)));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(corners[i].z + first + half), _mm_set1_ps(frustum.plane[i].z)));
+            distance = _mm_add_ps(distance, _mm_set1_ps(frustum.plane[i].w));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+        }
+        visible |= (~_mm_movemask_ps(outside) & 0xf) << half;
+    }
+
+    return visible;
+#else
+    unsigned int visible = 0;
+    for (unsigned int box = 0; box < CULL_BOX_BLOCK; box++) {
+        bool inside = true;
+        for (unsigned int i = 0; i < 6 && inside; i++) {
+            inside = (corners[i].x[first + box] * frustum.plane[i].x) + (corners[i].y[first + box] * frustum.plane[i].y) + (corners[i].z[first + box] * frustum.plane[i].z) + frustum.plane[i].w >= 0.0f;
+        }
+        visible |= (unsigned int)inside << box;
+    }
+
+    return visible;
+#endif
+}
+
+void cull_frustum_boxes(const CullFrustum& frustum, const CullBoxes& boxes, std::vector<unsigned int>* visible) {
+    visible->resize(boxes.count);
+    if (boxes.count == 0) {
+        return;
+    }
+
+    CullPlaneCorners corners[6];
+    for (unsigned int i = 0; i < 6; i++) {
+        corners[i] = (CullPlaneCorners) {
+            .x = frustum.plane[i].x >= 0.0f ? &boxes.max_x[0] : &boxes.min_x[0],
+            .y = frustum.plane[i].y >= 0.0f ? &boxes.max_y[0] : &boxes.min_y[0],
+            .z = frustum.plane[i].z >= 0.0f ? &boxes.max_z[0] : &boxes.min_z[0]
+        };
+    }
+
+    // visible indices are compacted as they're found, so a block costs nothing past its test when it's all culled
+    unsigned int visible_count = 0;
+    for (unsigned int first = 0; first < boxes.count; first += CULL_BOX_BLOCK) {
+        unsigned int mask = cull_block_visible(frustum, corners, first);
+        if (boxes.count - first < CULL_BOX_BLOCK) {
+            mask &= (1u << (boxes.count - first)) - 1;
+        }
+        while (mask != 0) {
+            (*visible)[visible_count] = first + __builtin_ctz(mask);
+            visible_count++;
+            mask &= mask - 1;
+        }
+    }
+    visible->resize(visible_count);
+}
+
+void cull_frustum_boxes_scalar(const CullFrustum& frustum, const CullBoxes& boxes, std::vector<unsigned int>* visible) {
+    visible->clear();
+    for (unsigned int i = 0; i < boxes.count; i++) {
+        if (cull_frustum_box(frustum, glm::vec3(boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]), glm::vec3(boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]))) {
+            visible->push_back(i);
+        }
+    }
+}
+
+void cull_boxes_clear(CullBoxes* boxes) {
+    // the arrays keep their size so that refilling them every frame doesn't allocate
+    boxes->count = 0;
+}
+
+void cull_boxes_add(CullBoxes* boxes, glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    if (boxes->count == boxes->min_x.size()) {
+        std::size_t size = boxes->min_x.size() + CULL_BOX_BLOCK;
+        boxes->min_x.resize(size, 0.0f);
+        boxes->min_y.resize(size, 0.0f);
+        boxes->min_z.resize(size, 0.0f);
+        boxes->max_x.resize(size, 0.0f);
+        boxes->max_y.resize(size, 0.0f);
+        boxes->max_z.resize(size, 0.0f);
+    }
+    boxes->min_x[boxes->count] = bounds_min.x;
+    boxes->min_y[boxes->count] = bounds_min.y;
+    boxes->min_z[boxes->count] = bounds_min.z;
+    boxes->max_x[boxes->count] = bounds_max.x;
+    boxes->max_y[boxes->count] = bounds_max.y;
+    boxes->max_z[boxes->count] = bounds_max.z;
+    boxes->count++;
+}
+
+void cull_box_transform(glm::vec3* world_min, glm::vec3* world_max, const glm::mat4& matrix, glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    // the transformed center, grown by the extents projected onto each world axis (Arvo)
+    glm::vec3 center = glm::vec3(matrix * glm::vec4((bounds_min + bounds_max) * 0.5f, 1.0f));
+    glm::vec3 extents = (bounds_max - bounds_min) * 0.5f;
+    glm::vec3 world_extents = glm::vec3(0.0f);
+    for (unsigned int i = 0; i < 3; i++) {
+        world_extents += glm::abs(glm::vec3(matrix[i])) * extents[i];
+    }
+    *world_min = center - world_extents;
+    *world_max = center + world_extents;
+}
+
+void cull_begin(const glm::mat4& projection_view) {
+    cull_frustum_extract(&cull_camera_frustum, projection_view);
+    cull_current_stats = (CullStats) { .tested = 0, .culled = 0 };
+}
+
+bool cull_visible(const glm::mat4& model_matrix, glm::vec3 bounds_min, glm::vec3 bounds_max, float radius) {
+    if (!cull_enabled) {
+        return true;
+    }
+
+    cull_current_stats.tested++;
+    glm::vec3 center = glm::vec3(model_matrix * glm::vec4((bounds_min + bounds_max) * 0.5f, 1.0f));
+    float scale = std::max(glm::length(glm::vec3(model_matrix[0])), std::max(glm::length(glm::vec3(model_matrix[1])), glm::length(glm::vec3(model_matrix[2]))));
+    if (!cull_frustum_sphere(cull_camera_frustum, center, radius * scale)) {
+        cull_current_stats.culled++;
+        return false;
+    }
+
+    glm::vec3 world_min;
+    glm::vec3 world_max;
+    cull_box_transform(&world_min, &world_max, model_matrix, bounds_min, bounds_max);
+    if (!cull_frustum_box(cull_camera_frustum, world_min, world_max)) {
+        cull_current_stats.culled++;
+        return false;
+    }
+
+    return true;
+}
+
+void cull_visible_boxes(const CullBoxes& boxes, std::vector<unsigned int>* visible) {
+    if (!cull_enabled) {
+        visible->resize(boxes.count);
+        for (unsigned int i = 0; i < boxes.count; i++) {
+            (*visible)[i] = i;
+        }
+        return;
+    }
+
+    cull_frustum_boxes(cull_camera_frustum, boxes, visible);
+    cull_current_stats.tested += boxes.count;
+    cull_current_stats.culled += boxes.count - visible->size();
+}
+
+CullStats cull_stats() {
+    return cull_current_stats;
+}
\ No newline at end of file
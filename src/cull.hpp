@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// View frustum culling. cull_begin takes the camera's matrices at the start of the frame,
+// then everything that submits draws asks cull_visible about its bounds before it builds a packet.
+// Bounds are tested as a sphere first since that's cheapest, and objects the sphere can't rule out are tested as a box.
+// Large groups of objects go through cull_visible_boxes instead, which tests world space boxes several at a time with SSE or AVX.
+
+// planes point into the frustum, xyz is the normal and w the distance, so a point p is inside a plane when dot(xyz, p) + w >= 0
+struct CullFrustum {
+    glm::vec4 plane[6];
+};
+
+struct CullStats {
+    unsigned int tested;
+    unsigned int culled;
+};
+
+// boxes are tested in blocks of this many, the AVX width. SSE builds test a block as two halves
+const unsigned int CULL_BOX_BLOCK = 8;
+
+// world space boxes as a structure of arrays, so that one load reads the same coordinate of a whole block.
+// the arrays are padded with zeros to a multiple of CULL_BOX_BLOCK and only the first count entries are boxes
+struct CullBoxes {
+    std::vector<float> min_x;
+    std::vector<float> min_y;
+    std::vector<float> min_z;
+    std::vector<float> max_x;
+    std::vector<float> max_y;
+    std::vector<float> max_z;
+    unsigned int count;
+
+    CullBoxes();
+};
+
+// when false everything is visible, set before rendering
+extern bool cull_enabled;
+// set by cull_begin
+extern CullFrustum cull_camera_frustum;
+
+// normalized planes of the frustum whose clip space is projection_view
+void cull_frustum_extract(CullFrustum* frustum, const glm::mat4& projection_view);
+bool cull_frustum_sphere(const CullFrustum& frustum, glm::vec3 center, float radius);
+bool cull_frustum_box(const CullFrustum& frustum, glm::vec3 bounds_min, glm::vec3 bounds_max);
+// fills visible with the index of every box at least partly inside the frustum, in order
+void cull_frustum_boxes(const CullFrustum& frustum, const CullBoxes& boxes, std::vector<unsigned int>* visible);
+// the same test one box at a time, for comparison
+void cull_frustum_boxes_scalar(const CullFrustum& frustum, const CullBoxes& boxes, std::vector<unsigned int>* visible);
+void cull_boxes_clear(CullBoxes* boxes);
+void cull_boxes_add(CullBoxes* boxes, glm::vec3 bounds_min, glm::vec3 bounds_max);
+// the world space box around the local box bounds_min, bounds_max once transformed by matrix
+void cull_box_transform(glm::vec3* world_min, glm::vec3* world_max, const glm::mat4& matrix, glm::vec3 bounds_min, glm::vec3 bounds_max);
+
+void cull_begin(const glm::mat4& projection_view);
+// bounds are local to model_matrix and radius is the radius of a sphere around their center
+bool cull_visible(const glm::mat4& model_matrix, glm::vec3 bounds_min, glm::vec3 bounds_max, float radius);
+// cull_frustum_boxes against the camera frustum
+void cull_visible_boxes(const CullBoxes& boxes, std::vector<unsigned int>* visible);
+// tests made since the last cull_begin
+CullStats cull_stats();
\ No newline at end of file
@@ -2,18 +2,31 @@
 
 #include "shader.hpp"
 #include "global.hpp"
+#include "gl_state.hpp"
+#include "upload_ring.hpp"
 
 #include <SDL2/SDL_ttf.h>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <vector>
+#include <cstddef>
 #include <cstdio>
 
 const int FIRST_CHAR = 32;
 
+struct FontGlyphInstance {
+    glm::vec2 render_coords;
+    glm::vec2 texture_offset;
+    glm::vec3 color;
+};
+
 Font font_hack10;
 TTF_Font* test;
 
 unsigned int glyph_vao;
+// glyphs queued by font_render since the last font_flush, all from font_batch's atlas
+std::vector<FontGlyphInstance> font_glyph_instances;
+Font font_batch;
 
 bool font_load(Font* font, const char* path, unsigned int size);
 
@@ -46,24 +59,29 @@ bool font_init() {
 
     glGenVertexArrays(1, &glyph_vao);
     glGenBuffers(1, &glyph_vbo);
-    glBindVertexArray(glyph_vao);
+    gl_state_bind_vertex_array(glyph_vao);
     glBindBuffer(GL_ARRAY_BUFFER, glyph_vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(glyph_vertices), glyph_vertices, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0);
 
+    // one instance per glyph, pointed at the upload ring by font_flush
+    for (GLuint attribute = 1; attribute < 4; attribute++) {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     if (!font_load(&font_hack10, "./hack.ttf", 10)) {
         return false;
     }
 
-    glUseProgram(text_shader);
+    gl_state_use_program(text_shader.id);
     float screen_size[2] = { SCREEN_WIDTH, SCREEN_HEIGHT };
-    glUniform2fv(glGetUniformLocation(text_shader, "screen_size"), 1, &screen_size[0]);
-    glUniform1ui(glGetUniformLocation(text_shader, "u_texture"), 0);
+    glUniform2fv(text_shader.uniform[SHADER_UNIFORM_SCREEN_SIZE], 1, &screen_size[0]);
+    glUniform1i(text_shader.uniform[SHADER_UNIFORM_U_TEXTURE], 0);
 
     return true;
 }
@@ -108,7 +126,7 @@ bool font_load(Font* font, const char* path, unsigned int size) {
 
     // Generate OpenGL texture
     glGenTextures(1, &font->atlas);
-    glBindTexture(GL_TEXTURE_2D, font->atlas);
+    gl_state_bind_texture(0, font->atlas);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, atlas_width, atlas_height, 0, GL_BGRA, GL_UNSIGNED_BYTE, atlas_surface->pixels);
@@ -118,7 +136,6 @@ bool font_load(Font* font, const char* path, unsigned int size) {
     font->glyph_height = (unsigned int)max_height;
 
     // Cleanup
-    glBindTexture(GL_TEXTURE_2D, 0);
     for (int i = 0; i < 96; i++) {
         SDL_FreeSurface(glyphs[i]);
     }
@@ -138,30 +155,48 @@ bool font_load(Font* font, const char* path, unsigned int size) {
   }
 
 void font_render(const Font& font, std::string text, glm::vec2 render_pos, glm::vec3 color) {
-    glUseProgram(text_shader);
-    glm::vec2 atlas_size = glm::vec2((float)next_largest_power_of_two(font.glyph_width * 96), (float)next_largest_power_of_two(font.glyph_height));
-    glUniform2fv(glGetUniformLocation(text_shader, "atlas_size"), 1, glm::value_ptr(atlas_size));
-    glm::vec2 render_size = glm::vec2((float)font.glyph_width, (float)font.glyph_height);
-    glUniform2fv(glGetUniformLocation(text_shader, "render_size"), 1, glm::value_ptr(render_size));
-    glUniform3fv(glGetUniformLocation(text_shader, "font_color"), 1, glm::value_ptr(color));
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, font.atlas);
-    glBindVertexArray(glyph_vao);
+    if (!font_glyph_instances.empty() && font.atlas != font_batch.atlas) {
+        font_flush();
+    }
+    font_batch = font;
 
     glm::vec2 render_coords = render_pos;
-    glm::vec2 texture_offset;
     for (char c : text) {
-        int glyph_index = (int)c - FIRST_CHAR;
-        texture_offset.x = (float)(font.glyph_width * glyph_index);
-        glUniform2fv(glGetUniformLocation(text_shader, "render_coords"), 1, glm::value_ptr(render_coords));
-        glUniform2fv(glGetUniformLocation(text_shader, "texture_offset"), 1, glm::value_ptr(texture_offset));
-
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        // blank glyphs only move the pen
+        if (c != ' ') {
+            int glyph_index = (int)c - FIRST_CHAR;
+            font_glyph_instances.push_back((FontGlyphInstance) {
+                .render_coords = render_coords,
+                .texture_offset = glm::vec2((float)(font.glyph_width * glyph_index), 0.0f),
+                .color = color
+            });
+        }
 
         render_coords.x += font.glyph_width;
     }
+}
+
+void font_flush() {
+    if (font_glyph_instances.empty()) {
+        return;
+    }
+
+    gl_state_use_program(text_shader.id);
+    glm::vec2 atlas_size = glm::vec2((float)next_largest_power_of_two(font_batch.glyph_width * 96), (float)next_largest_power_of_two(font_batch.glyph_height));
+    glUniform2fv(text_shader.uniform[SHADER_UNIFORM_ATLAS_SIZE], 1, glm::value_ptr(atlas_size));
+    glm::vec2 render_size = glm::vec2((float)font_batch.glyph_width, (float)font_batch.glyph_height);
+    glUniform2fv(text_shader.uniform[SHADER_UNIFORM_RENDER_SIZE], 1, glm::value_ptr(render_size));
+
+    gl_state_bind_texture(0, font_batch.atlas);
+    gl_state_bind_vertex_array(glyph_vao);
+
+    UploadRingRange range = upload_ring_upload(&font_glyph_instances[0], font_glyph_instances.size() * sizeof(FontGlyphInstance), sizeof(float));
+    glBindBuffer(GL_ARRAY_BUFFER, range.buffer);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(FontGlyphInstance), (void*)(range.offset + offsetof(FontGlyphInstance, render_coords)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(FontGlyphInstance), (void*)(range.offset + offsetof(FontGlyphInstance, texture_offset)));
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(FontGlyphInstance), (void*)(range.offset + offsetof(FontGlyphInstance, color)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, font_glyph_instances.size());
 
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    font_glyph_instances.clear();
 }
\ No newline at end of file
@@ -17,4 +17,7 @@ extern Font font_hack10;
 const glm::vec3 FONT_COLOR_WHITE = glm::vec3(1.0f, 1.0f, 1.0f);
 
 bool font_init();
-void font_render(const Font& font, std::string text, glm::vec2 render_pos, glm::vec3 color);
\ No newline at end of file
+// queues the text, nothing is drawn until font_flush
+void font_render(const Font& font, std::string text, glm::vec2 render_pos, glm::vec3 color);
+// draws all queued text in a single instanced draw, or one per run of text in the same font when fonts are mixed. blending has to be set up before calling
+void font_flush();
\ No newline at end of file
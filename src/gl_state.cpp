@@ -0,0 +1,190 @@
+#include "gl_state.hpp"
+
+#include <cstdio>
+
+enum GlStateTextureTarget {
+    GL_STATE_TEXTURE_TARGET_2D,
+    GL_STATE_TEXTURE_TARGET_2D_ARRAY,
+    GL_STATE_TEXTURE_TARGET_COUNT
+};
+
+enum GlStateCapability {
+    GL_STATE_CAPABILITY_BLEND,
+    GL_STATE_CAPABILITY_DEPTH_TEST,
+    GL_STATE_CAPABILITY_COUNT
+};
+
+struct GlState {
+    GLuint program;
+    GLuint vao;
+    unsigned int active_texture_unit;
+    GLuint texture[GL_STATE_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGET_COUNT];
+    GLuint framebuffer;
+    bool capability[GL_STATE_CAPABILITY_COUNT];
+    GLenum blend_source_factor;
+    GLenum blend_destination_factor;
+    bool depth_mask;
+    // the default viewport is the size of the window, which isn't known here, so width starts out at -1 to force the first call
+    GLint viewport[4];
+};
+
+GlState gl_state = (GlState) {
+    .program = 0,
+    .vao = 0,
+    .active_texture_unit = 0,
+    .texture = { { 0 } },
+    .framebuffer = 0,
+    .capability = { false, false },
+    .blend_source_factor = GL_ONE,
+    .blend_destination_factor = GL_ZERO,
+    .depth_mask = true,
+    .viewport = { 0, 0, -1, -1 }
+};
+GlStateStats gl_state_current_stats = (GlStateStats) { .issued = 0, .filtered = 0 };
+GlStateStats gl_state_last_stats = (GlStateStats) { .issued = 0, .filtered = 0 };
+
+// counts the call and returns whether it needs to be made
+static bool gl_state_changed(bool changed) {
+    if (changed) {
+        gl_state_current_stats.issued++;
+    } else {
+        gl_state_current_stats.filtered++;
+    }
+
+    return changed;
+}
+
+void gl_state_frame_begin() {
+    gl_state_last_stats = gl_state_current_stats;
+    gl_state_current_stats = (GlStateStats) { .issued = 0, .filtered = 0 };
+}
+
+GlStateStats gl_state_stats() {
+    return gl_state_last_stats;
+}
+
+bool gl_state_use_program(GLuint program) {
+    if (!gl_state_changed(program != gl_state.program)) {
+        return false;
+    }
+    gl_state.program = program;
+    glUseProgram(program);
+
+    return true;
+}
+
+bool gl_state_bind_vertex_array(GLuint vao) {
+    if (!gl_state_changed(vao != gl_state.vao)) {
+        return false;
+    }
+    gl_state.vao = vao;
+    glBindVertexArray(vao);
+
+    return true;
+}
+
+static bool gl_state_bind_texture_target(unsigned int unit, GlStateTextureTarget target, GLenum gl_target, GLuint texture) {
+    if (!gl_state_changed(texture != gl_state.texture[unit][target])) {
+        return false;
+    }
+    if (gl_state_changed(unit != gl_state.active_texture_unit)) {
+        gl_state.active_texture_unit = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    gl_state.texture[unit][target] = texture;
+    glBindTexture(gl_target, texture);
+
+    return true;
+}
+
+bool gl_state_bind_texture(unsigned int unit, GLuint texture) {
+    return gl_state_bind_texture_target(unit, GL_STATE_TEXTURE_TARGET_2D, GL_TEXTURE_2D, texture);
+}
+
+bool gl_state_bind_texture_array(unsigned int unit, GLuint texture) {
+    return gl_state_bind_texture_target(unit, GL_STATE_TEXTURE_TARGET_2D_ARRAY, GL_TEXTURE_2D_ARRAY, texture);
+}
+
+bool gl_state_bind_framebuffer(GLuint framebuffer) {
+    if (!gl_state_changed(framebuffer != gl_state.framebuffer)) {
+        return false;
+    }
+    gl_state.framebuffer = framebuffer;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    return true;
+}
+
+bool gl_state_enable(GLenum capability, bool enabled) {
+    GlStateCapability index;
+    if (capability == GL_BLEND) {
+        index = GL_STATE_CAPABILITY_BLEND;
+    } else if (capability == GL_DEPTH_TEST) {
+        index = GL_STATE_CAPABILITY_DEPTH_TEST;
+    } else {
+        printf("Capability %x isn't tracked by the GL state cache\n", capability);
+        return false;
+    }
+
+    if (!gl_state_changed(enabled != gl_state.capability[index])) {
+        return false;
+    }
+    gl_state.capability[index] = enabled;
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+
+    return true;
+}
+
+bool gl_state_blend_func(GLenum source_factor, GLenum destination_factor) {
+    if (!gl_state_changed(source_factor != gl_state.blend_source_factor || destination_factor != gl_state.blend_destination_factor)) {
+        return false;
+    }
+    gl_state.blend_source_factor = source_factor;
+    gl_state.blend_destination_factor = destination_factor;
+    glBlendFunc(source_factor, destination_factor);
+
+    return true;
+}
+
+bool gl_state_depth_mask(bool write) {
+    if (!gl_state_changed(write != gl_state.depth_mask)) {
+        return false;
+    }
+    gl_state.depth_mask = write;
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+
+    return true;
+}
+
+bool gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (!gl_state_changed(x != gl_state.viewport[0] || y != gl_state.viewport[1] || width != gl_state.viewport[2] || height != gl_state.viewport[3])) {
+        return false;
+    }
+    gl_state.viewport[0] = x;
+    gl_state.viewport[1] = y;
+    gl_state.viewport[2] = width;
+    gl_state.viewport[3] = height;
+    glViewport(x, y, width, height);
+
+    return true;
+}
+
+void gl_state_forget_texture(GLuint texture) {
+    for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+        for (unsigned int target = 0; target < GL_STATE_TEXTURE_TARGET_COUNT; target++) {
+            if (gl_state.texture[unit][target] == texture) {
+                gl_state.texture[unit][target] = 0;
+            }
+        }
+    }
+}
+
+void gl_state_forget_vertex_array(GLuint vao) {
+    if (gl_state.vao == vao) {
+        gl_state.vao = 0;
+    }
+}
\ No newline at end of file
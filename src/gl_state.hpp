@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Cache of the binds and render state that change from draw to draw, so that setting something to the value it already has costs no GL call.
+// Anything that binds a program, vertex array, texture or framebuffer, or sets blending, depth or the viewport, has to go through here or the cache goes stale.
+// The cache starts out at GL's defaults, so it's valid as soon as the context is created.
+
+const unsigned int GL_STATE_TEXTURE_UNITS = 16;
+
+struct GlStateStats {
+    unsigned int issued;
+    // calls skipped because they wouldn't have changed anything
+    unsigned int filtered;
+};
+
+// starts counting a new frame. gl_state_stats reports the frame before
+void gl_state_frame_begin();
+GlStateStats gl_state_stats();
+
+// each of these returns whether it had to call GL
+bool gl_state_use_program(GLuint program);
+bool gl_state_bind_vertex_array(GLuint vao);
+// binds to GL_TEXTURE_2D of the unit, switching the active texture unit only if needed
+bool gl_state_bind_texture(unsigned int unit, GLuint texture);
+// same for GL_TEXTURE_2D_ARRAY, which has its own binding on every unit
+bool gl_state_bind_texture_array(unsigned int unit, GLuint texture);
+bool gl_state_bind_framebuffer(GLuint framebuffer);
+// capability is GL_BLEND or GL_DEPTH_TEST
+bool gl_state_enable(GLenum capability, bool enabled);
+bool gl_state_blend_func(GLenum source_factor, GLenum destination_factor);
+bool gl_state_depth_mask(bool write);
+bool gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+// GL unbinds deleted objects and may reuse their names, so the cache has to drop them too
+void gl_state_forget_texture(GLuint texture);
+void gl_state_forget_vertex_array(GLuint vao);
\ No newline at end of file
@@ -7,6 +7,17 @@
 #include "model.hpp"
 #include "global.hpp"
 #include "scene.hpp"
+#include "worker.hpp"
+#include "asset_stream.hpp"
+#include "asset.hpp"
+#include "texture.hpp"
+#include "render_queue.hpp"
+#include "mesh_buffer.hpp"
+#include "gl_state.hpp"
+#include "upload_ring.hpp"
+#include "cull.hpp"
+#include "occlusion.hpp"
+#include "occlusion_query.hpp"
 
 #include <glad/glad.h>
 #include <SDL2/SDL.h>
@@ -17,6 +28,9 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 // Engine
 SDL_Window* window;
@@ -32,7 +46,25 @@ unsigned int frames = 0;
 unsigned int fps = 0;
 float elapsed = 0.0f;
 
-int main() {
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stream-trace") == 0) {
+            asset_stream_trace = true;
+        } else if (strcmp(argv[i], "--army") == 0 && i + 1 < argc) {
+            scene_army_size = std::max(atoi(argv[i + 1]), 1);
+            i++;
+        } else if (strcmp(argv[i], "--props") == 0 && i + 1 < argc) {
+            scene_prop_count = std::max(atoi(argv[i + 1]), 0);
+            i++;
+        } else if (strcmp(argv[i], "--no-cull") == 0) {
+            cull_enabled = false;
+        } else if (strcmp(argv[i], "--no-occlusion") == 0) {
+            occlusion_enabled = false;
+        } else if (strcmp(argv[i], "--gpu-occlusion") == 0) {
+            occlusion_query_enabled = true;
+        }
+    }
+
     // Init engine
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("Error initializing SDL: %s\n", SDL_GetError());
@@ -71,24 +103,45 @@ int main() {
         return -1;
     }
 
+    if (!worker_init()) {
+        return -1;
+    }
+    if (!asset_stream_init()) {
+        return -1;
+    }
+    if (!texture_init()) {
+        return -1;
+    }
+    if (!upload_ring_init()) {
+        return -1;
+    }
     if (!shader_init()) {
         return -1;
     }
     if (!font_init()) {
         return -1;
     }
+    if (!mesh_buffer_init()) {
+        return -1;
+    }
     if (!model_init()) {
         return -1;
     }
+    if (!render_queue_init()) {
+        return -1;
+    }
+    if (!occlusion_query_init()) {
+        return -1;
+    }
     scene_init();
 
     // Set OpenGL flags
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
+    gl_state_enable(GL_DEPTH_TEST, true);
+    gl_state_enable(GL_BLEND, true);
 
     // Setup screen shader
-    glUseProgram(screen_shader);
-    glUniform1i(glGetUniformLocation(screen_shader, "screen_texture"), 0);
+    gl_state_use_program(screen_shader.id);
+    glUniform1i(screen_shader.uniform[SHADER_UNIFORM_SCREEN_TEXTURE], 0);
 
     // Setup quad vao
     GLuint quad_vao;
@@ -108,7 +161,7 @@ int main() {
     glGenVertexArrays(1, &quad_vao);
     glGenBuffers(1, &quad_vbo);
 
-    glBindVertexArray(quad_vao);
+    gl_state_bind_vertex_array(quad_vao);
     glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), &quad_vertices, GL_STATIC_DRAW);
 
@@ -118,22 +171,18 @@ int main() {
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 
-    glBindVertexArray(0);
-
     // Setup framebuffer
     GLuint framebuffer;
     glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    gl_state_bind_framebuffer(framebuffer);
 
     GLuint texture_color_buffer;
-    glActiveTexture(GL_TEXTURE0);
     glGenTextures(1, &texture_color_buffer);
-    glBindTexture(GL_TEXTURE_2D, texture_color_buffer);
+    gl_state_bind_texture(0, texture_color_buffer);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_color_buffer, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
 
     GLuint rbo;
     glGenRenderbuffers(1, &rbo);
@@ -147,10 +196,11 @@ int main() {
         return -1;
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl_state_bind_framebuffer(0);
 
     // Game loop
     bool running = true;
+    bool streaming = true;
     while (running) {
         // Timekeep
         unsigned long current_time = SDL_GetTicks();
@@ -160,6 +210,9 @@ int main() {
 
         float delta = (float)(current_time - last_time) / 60.0f;
         last_time = current_time;
+        Uint64 frame_start_time = SDL_GetPerformanceCounter();
+        // streaming uploads during the update, so the frame's uploads start here
+        upload_ring_frame_begin();
 
         if (current_time - last_second >= 1000) {
             fps = frames;
@@ -183,14 +236,21 @@ int main() {
         }
 
         // Update
+        asset_stream_update();
+        asset_update();
+        if (streaming && !asset_stream_busy()) {
+            streaming = false;
+            asset_report();
+        }
         scene_update(delta);
 
         // Render
+        gl_state_frame_begin();
         // Prepare rendering onto framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-        glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-        glBlendFunc(GL_ONE, GL_ZERO);
-        glEnable(GL_DEPTH_TEST);
+        gl_state_bind_framebuffer(framebuffer);
+        gl_state_viewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+        gl_state_blend_func(GL_ONE, GL_ZERO);
+        gl_state_enable(GL_DEPTH_TEST, true);
         glClearColor(0.05f, 0.05f, 0.05f, 0.05f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -198,28 +258,45 @@ int main() {
         scene_render();
 
         // Render framebuffer to screen
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
-        glBlendFunc(GL_ONE, GL_ZERO);
-        glDisable(GL_DEPTH_TEST);
+        gl_state_bind_framebuffer(0);
+        gl_state_viewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+        gl_state_blend_func(GL_ONE, GL_ZERO);
+        gl_state_enable(GL_DEPTH_TEST, false);
         glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        glUseProgram(screen_shader);
-        glBindVertexArray(quad_vao);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture_color_buffer);
+        gl_state_use_program(screen_shader.id);
+        gl_state_bind_vertex_array(quad_vao);
+        gl_state_bind_texture(0, texture_color_buffer);
         glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
 
         // Render fps
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        gl_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         font_render(font_hack10, "FPS: " + std::to_string(fps), glm::vec2(0.0f, 0.0f), FONT_COLOR_WHITE);
+        GlStateStats gl_stats = gl_state_stats();
+        font_render(font_hack10, "GL calls: " + std::to_string(gl_stats.issued) + " issued, " + std::to_string(gl_stats.filtered) + " filtered", glm::vec2(0.0f, (float)font_hack10.glyph_height), FONT_COLOR_WHITE);
+        UploadRingStats upload_stats = upload_ring_stats();
+        font_render(font_hack10, "Uploads: " + std::to_string(upload_stats.bytes / 1024) + " KB, " + std::to_string(upload_stats.stalls) + " stalls", glm::vec2(0.0f, (float)(font_hack10.glyph_height * 2)), FONT_COLOR_WHITE);
+        CullStats visibility_stats = cull_stats();
+        font_render(font_hack10, "Culled: " + std::to_string(visibility_stats.culled) + " of " + std::to_string(visibility_stats.tested), glm::vec2(0.0f, (float)(font_hack10.glyph_height * 3)), FONT_COLOR_WHITE);
+        OcclusionStats occlusion_frame_stats = occlusion_stats();
+        font_render(font_hack10, "Occlusion: " + std::to_string(occlusion_frame_stats.occluded) + " of " + std::to_string(occlusion_frame_stats.tested) + " hidden, " + std::to_string(occlusion_frame_stats.triangles) + " triangles in " + std::to_string(occlusion_frame_stats.milliseconds) + " ms", glm::vec2(0.0f, (float)(font_hack10.glyph_height * 4)), FONT_COLOR_WHITE);
+        OcclusionQueryStats query_stats = occlusion_query_stats();
+        font_render(font_hack10, "Occlusion queries: " + std::to_string(query_stats.queries) + " issued, " + std::to_string(query_stats.occluded) + " of " + std::to_string(query_stats.groups) + " groups hidden, " + std::to_string(query_stats.conditional) + " conditional", glm::vec2(0.0f, (float)(font_hack10.glyph_height * 5)), FONT_COLOR_WHITE);
+        font_flush();
+        upload_ring_frame_end();
 
         SDL_GL_SwapWindow(window);
         frames++;
+        asset_stream_trace_frame((float)(SDL_GetPerformanceCounter() - frame_start_time) * 1000.0f / (float)SDL_GetPerformanceFrequency());
     }
 
+    // let loads that are still in flight finish before dropping them
+    worker_quit();
+    asset_stream_quit();
+    occlusion_query_quit();
+    mesh_buffer_quit();
+    upload_ring_quit();
     TTF_Quit();
     IMG_Quit();
     SDL_DestroyWindow(window);
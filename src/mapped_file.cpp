@@ -0,0 +1,109 @@
+#include "mapped_file.hpp"
+
+#include <cstdio>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+bool mapped_file_open(MappedFile* file, std::string path) {
+    file->data = NULL;
+    file->size = 0;
+
+#ifdef _WIN32
+    file->file_handle = NULL;
+    file->mapping_handle = NULL;
+
+    HANDLE file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size)) {
+        CloseHandle(file_handle);
+        return false;
+    }
+    file->file_handle = file_handle;
+    file->size = (std::size_t)file_size.QuadPart;
+
+    // an empty file cannot be mapped, but it is still a valid file
+    if (file->size == 0) {
+        return true;
+    }
+
+    HANDLE mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_handle == NULL) {
+        printf("Unable to map file %s\n", path.c_str());
+        mapped_file_close(file);
+        return false;
+    }
+    file->mapping_handle = mapping_handle;
+
+    file->data = (const char*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (file->data == NULL) {
+        printf("Unable to map file %s\n", path.c_str());
+        mapped_file_close(file);
+        return false;
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        close(fd);
+        return false;
+    }
+    file->size = (std::size_t)file_stat.st_size;
+
+    // an empty file cannot be mapped, but it is still a valid file
+    if (file->size == 0) {
+        close(fd);
+        return true;
+    }
+
+    void* data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Unable to map file %s\n", path.c_str());
+        file->size = 0;
+        return false;
+    }
+    madvise(data, file->size, MADV_SEQUENTIAL);
+    file->data = (const char*)data;
+#endif
+
+    return true;
+}
+
+void mapped_file_close(MappedFile* file) {
+#ifdef _WIN32
+    if (file->data != NULL) {
+        UnmapViewOfFile(file->data);
+    }
+    if (file->mapping_handle != NULL) {
+        CloseHandle((HANDLE)file->mapping_handle);
+    }
+    if (file->file_handle != NULL) {
+        CloseHandle((HANDLE)file->file_handle);
+    }
+    file->file_handle = NULL;
+    file->mapping_handle = NULL;
+#else
+    if (file->data != NULL) {
+        munmap((void*)file->data, file->size);
+    }
+#endif
+    file->data = NULL;
+    file->size = 0;
+}
\ No newline at end of file
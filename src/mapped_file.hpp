@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Read-only view of a whole file mapped into memory.
+// The data is not null terminated, always use size to find the end.
+struct MappedFile {
+    const char* data;
+    std::size_t size;
+#ifdef _WIN32
+    void* file_handle;
+    void* mapping_handle;
+#endif
+};
+
+bool mapped_file_open(MappedFile* file, std::string path);
+void mapped_file_close(MappedFile* file);
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "mesh_buffer.hpp"
+
+#include "gl_state.hpp"
+
+#include <map>
+#include <iterator>
+#include <cstdio>
+
+struct MeshBufferArena {
+    GLuint buffer;
+    // in vertices for vertex buffers and in bytes for index buffers
+    unsigned int capacity;
+    unsigned int unit_size;
+    // offset to size of every free range. neighbouring ranges are merged when freed
+    std::map<unsigned int, unsigned int> free_ranges;
+};
+
+struct MeshBufferPool {
+    GLuint vao;
+    MeshBufferArena vertices;
+    MeshBufferArena indices;
+};
+
+// indexes need to stay aligned to the largest index type, since draws address them in units of their type
+const unsigned int MESH_BUFFER_INDEX_ALIGNMENT = sizeof(GLuint);
+
+MeshBufferPool mesh_buffer_pool[VERTEX_FORMAT_COUNT];
+
+static void mesh_buffer_vertex_attributes(VertexFormat vertex_format) {
+    if (vertex_format == VERTEX_FORMAT_COMPACT) {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(CompactVertexData), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertexData), (void*)(4 * sizeof(GLshort)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertexData), (void*)(6 * sizeof(GLshort)));
+    } else {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)(6 * sizeof(float)));
+    }
+}
+
+// (re)attaches the pool's current buffers to its vertex array
+static void mesh_buffer_pool_bind(MeshBufferPool& pool, VertexFormat vertex_format) {
+    gl_state_bind_vertex_array(pool.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, pool.vertices.buffer);
+    mesh_buffer_vertex_attributes(vertex_format);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indices.buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void mesh_buffer_arena_create(MeshBufferArena* arena, unsigned int capacity, unsigned int unit_size) {
+    arena->capacity = capacity;
+    arena->unit_size = unit_size;
+    arena->free_ranges.clear();
+    arena->free_ranges[0] = capacity;
+    glGenBuffers(1, &arena->buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena->buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (std::size_t)capacity * unit_size, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+bool mesh_buffer_init() {
+    for (unsigned int i = 0; i < VERTEX_FORMAT_COUNT; i++) {
+        MeshBufferPool& pool = mesh_buffer_pool[i];
+        glGenVertexArrays(1, &pool.vao);
+        mesh_buffer_arena_create(&pool.vertices, MESH_BUFFER_INITIAL_VERTICES, model_vertex_size((VertexFormat)i));
+        mesh_buffer_arena_create(&pool.indices, MESH_BUFFER_INITIAL_INDEX_BYTES, 1);
+        mesh_buffer_pool_bind(pool, (VertexFormat)i);
+    }
+
+    return true;
+}
+
+void mesh_buffer_quit() {
+    for (unsigned int i = 0; i < VERTEX_FORMAT_COUNT; i++) {
+        gl_state_forget_vertex_array(mesh_buffer_pool[i].vao);
+        glDeleteVertexArrays(1, &mesh_buffer_pool[i].vao);
+        glDeleteBuffers(1, &mesh_buffer_pool[i].vertices.buffer);
+        glDeleteBuffers(1, &mesh_buffer_pool[i].indices.buffer);
+    }
+}
+
+static void mesh_buffer_arena_release(MeshBufferArena* arena, unsigned int offset, unsigned int size) {
+    std::map<unsigned int, unsigned int>::iterator next = arena->free_ranges.lower_bound(offset);
+    if (next != arena->free_ranges.end() && offset + size == next->first) {
+        size += next->second;
+        next = arena->free_ranges.erase(next);
+    }
+    if (next != arena->free_ranges.begin()) {
+        std::map<unsigned int, unsigned int>::iterator previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+    arena->free_ranges[offset] = size;
+}
+
+// doubles the buffer until size fits at its end, copying the old contents over on the GPU
+static void mesh_buffer_arena_grow(MeshBufferArena* arena, unsigned int size) {
+    unsigned int old_capacity = arena->capacity;
+    unsigned int new_capacity = old_capacity;
+    // the free range at the end of the buffer, if there is one, counts towards the new allocation
+    std::map<unsigned int, unsigned int>::reverse_iterator last = arena->free_ranges.rbegin();
+    unsigned int tail_free = last != arena->free_ranges.rend() && last->first + last->second == old_capacity ? last->second : 0;
+    while (new_capacity - old_capacity + tail_free < size) {
+        new_capacity *= 2;
+    }
+
+    GLuint new_buffer;
+    glGenBuffers(1, &new_buffer);
+    glBindBuffer(GL_COPY_READ_BUFFER, arena->buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (std::size_t)new_capacity * arena->unit_size, NULL, GL_STATIC_DRAW);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (std::size_t)old_capacity * arena->unit_size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &arena->buffer);
+
+    printf("Mesh buffer grew from %u to %u bytes\n", old_capacity * arena->unit_size, new_capacity * arena->unit_size);
+    arena->buffer = new_buffer;
+    arena->capacity = new_capacity;
+    mesh_buffer_arena_release(arena, old_capacity, new_capacity - old_capacity);
+}
+
+// first fit
+static unsigned int mesh_buffer_arena_allocate(MeshBufferArena* arena, unsigned int size, bool* grew) {
+    *grew = false;
+    std::map<unsigned int, unsigned int>::iterator it;
+    while (true) {
+        for (it = arena->free_ranges.begin(); it != arena->free_ranges.end(); ++it) {
+            if (it->second >= size) {
+                break;
+            }
+        }
+        if (it != arena->free_ranges.end()) {
+            break;
+        }
+        mesh_buffer_arena_grow(arena, size);
+        *grew = true;
+    }
+
+    unsigned int offset = it->first;
+    unsigned int remaining = it->second - size;
+    arena->free_ranges.erase(it);
+    if (remaining != 0) {
+        arena->free_ranges[offset + size] = remaining;
+    }
+
+    return offset;
+}
+
+static unsigned int mesh_buffer_index_bytes(unsigned int index_count, GLenum index_type) {
+    unsigned int size = index_count * model_index_size(index_type);
+    return (size + MESH_BUFFER_INDEX_ALIGNMENT - 1) & ~(MESH_BUFFER_INDEX_ALIGNMENT - 1);
+}
+
+void mesh_buffer_allocate(Mesh* mesh, unsigned int vertex_count, unsigned int index_count, GLenum index_type) {
+    MeshBufferPool& pool = mesh_buffer_pool[mesh->vertex_format];
+    bool vertices_grew;
+    bool indices_grew;
+    mesh->vertex_data_size = vertex_count;
+    mesh->index_count = index_count;
+    mesh->index_type = index_type;
+    mesh->vao = pool.vao;
+    mesh->base_vertex = mesh_buffer_arena_allocate(&pool.vertices, vertex_count, &vertices_grew);
+    mesh->first_index = mesh_buffer_arena_allocate(&pool.indices, mesh_buffer_index_bytes(index_count, index_type), &indices_grew) / model_index_size(index_type);
+    if (vertices_grew || indices_grew) {
+        mesh_buffer_pool_bind(pool, mesh->vertex_format);
+    }
+}
+
+void mesh_buffer_free(const Mesh& mesh) {
+    MeshBufferPool& pool = mesh_buffer_pool[mesh.vertex_format];
+    mesh_buffer_arena_release(&pool.vertices, mesh.base_vertex, mesh.vertex_data_size);
+    mesh_buffer_arena_release(&pool.indices, mesh.first_index * model_index_size(mesh.index_type), mesh_buffer_index_bytes(mesh.index_count, mesh.index_type));
+}
+
+void mesh_buffer_upload_vertices(const Mesh& mesh, std::size_t begin, std::size_t size, const void* data) {
+    const MeshBufferArena& arena = mesh_buffer_pool[mesh.vertex_format].vertices;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena.buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, ((std::size_t)mesh.base_vertex * arena.unit_size) + begin, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void mesh_buffer_upload_indices(const Mesh& mesh, std::size_t begin, std::size_t size, const void* data) {
+    const MeshBufferArena& arena = mesh_buffer_pool[mesh.vertex_format].indices;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena.buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, ((std::size_t)mesh.first_index * model_index_size(mesh.index_type)) + begin, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "model.hpp"
+
+#include <glad/glad.h>
+
+// Shared vertex and index buffers that every mesh is sub-allocated from, one set per vertex format.
+// Each format has a single vertex array, so draws of different meshes in the same format never rebind vertex state.
+// Meshes keep their own index numbering and are drawn with their base_vertex.
+
+// starting sizes, the buffers double whenever an allocation doesn't fit
+const unsigned int MESH_BUFFER_INITIAL_VERTICES = 1 << 16;
+const unsigned int MESH_BUFFER_INITIAL_INDEX_BYTES = 1 << 20;
+
+bool mesh_buffer_init();
+void mesh_buffer_quit();
+// reserves room for the vertices and indices of the mesh in its vertex format's buffers and fills in vao, base_vertex and first_index
+void mesh_buffer_allocate(Mesh* mesh, unsigned int vertex_count, unsigned int index_count, GLenum index_type);
+void mesh_buffer_free(const Mesh& mesh);
+// begin and size are in bytes, relative to the start of the mesh's vertices or indices
+void mesh_buffer_upload_vertices(const Mesh& mesh, std::size_t begin, std::size_t size, const void* data);
+void mesh_buffer_upload_indices(const Mesh& mesh, std::size_t begin, std::size_t size, const void* data);
\ No newline at end of file
@@ -0,0 +1,352 @@
+#include "mesh_cache.hpp"
+
+#include "cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+// The file is written in native byte order since a cache never leaves the machine that baked it.
+// Layout: header | mesh records | material records | string table | vertex, index and level of detail blobs (16 byte aligned)
+
+static const char MESH_CACHE_MAGIC[4] = { 'A', 'M', 'S', 'H' };
+// bump whenever model_import or the layout below changes what ends up in the cache
+static const uint32_t MESH_CACHE_VERSION = 5;
+static const char* MESH_CACHE_EXTENSION = ".mesh";
+static const std::size_t MESH_CACHE_BLOB_ALIGNMENT = 16;
+
+struct MeshCacheString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    int64_t source_modified_time;
+    uint64_t source_size;
+    int64_t mtl_modified_time;
+    MeshCacheString mtl_path;
+    uint32_t mesh_count;
+    uint32_t material_count;
+    uint64_t string_table_offset;
+    uint64_t string_table_size;
+};
+
+struct MeshCacheMeshRecord {
+    MeshCacheString name;
+    MeshCacheString material;
+    float offset[3];
+    float bounds_min[3];
+    float bounds_max[3];
+    float position_scale[3];
+    uint32_t vertex_format;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t index_type;
+    uint32_t lod_count;
+    uint64_t vertex_data_offset;
+    uint64_t index_data_offset;
+    uint64_t lod_data_offset;
+};
+
+struct MeshCacheLodRecord {
+    uint32_t index_offset;
+    uint32_t index_count;
+    float error;
+};
+
+struct MeshCacheMaterialRecord {
+    MeshCacheString name;
+    float ka[3];
+    float kd[3];
+    float ks[3];
+    MeshCacheString map_ka;
+    MeshCacheString map_kd;
+};
+
+static bool mesh_cache_string_valid(MeshCacheString string, std::size_t strings_size) {
+    return (uint64_t)string.offset + string.length <= strings_size;
+}
+
+static std::string mesh_cache_string(const char* strings, MeshCacheString string) {
+    return std::string(strings + string.offset, string.length);
+}
+
+static bool mesh_cache_parse(MeshCache* cache, const char* data, std::size_t size, std::string source_path) {
+    bool valid = size >= sizeof(MeshCacheHeader);
+    const MeshCacheHeader* header = (const MeshCacheHeader*)data;
+
+    // make sure the cache was baked by this loader from the current versions of the source files
+    int64_t modified_time;
+    uint64_t source_size;
+    valid = valid && std::memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0 && header->version == MESH_CACHE_VERSION;
+    valid = valid && cache_file_stat(source_path, &modified_time, &source_size);
+    valid = valid && modified_time == header->source_modified_time && source_size == header->source_size;
+    valid = valid && header->string_table_offset <= size && header->string_table_size <= size - header->string_table_offset;
+    valid = valid && sizeof(MeshCacheHeader) + (header->mesh_count * sizeof(MeshCacheMeshRecord)) + (header->material_count * sizeof(MeshCacheMaterialRecord)) <= header->string_table_offset;
+
+    const char* strings = valid ? data + header->string_table_offset : NULL;
+    std::size_t strings_size = valid ? header->string_table_size : 0;
+    if (valid && header->mtl_path.length != 0) {
+        valid = mesh_cache_string_valid(header->mtl_path, strings_size);
+        valid = valid && cache_file_stat(mesh_cache_string(strings, header->mtl_path), &modified_time, &source_size);
+        valid = valid && modified_time == header->mtl_modified_time;
+    }
+
+    const MeshCacheMeshRecord* mesh_records = (const MeshCacheMeshRecord*)(data + sizeof(MeshCacheHeader));
+    for (uint32_t i = 0; valid && i < header->mesh_count; i++) {
+        const MeshCacheMeshRecord& record = mesh_records[i];
+        if (record.index_type != GL_UNSIGNED_SHORT && record.index_type != GL_UNSIGNED_INT) {
+            valid = false;
+            break;
+        }
+        uint64_t index_size = record.index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        valid = mesh_cache_string_valid(record.name, strings_size) && mesh_cache_string_valid(record.material, strings_size);
+        // meshes baked in a different vertex format than the one currently wanted have to be baked again
+        valid = valid && record.vertex_format == (uint32_t)model_vertex_format;
+        valid = valid && record.vertex_data_offset <= size && (uint64_t)record.vertex_count * model_vertex_size(model_vertex_format) <= size - record.vertex_data_offset;
+        valid = valid && record.index_data_offset <= size && (uint64_t)record.index_count * index_size <= size - record.index_data_offset;
+        valid = valid && record.lod_count != 0 && record.lod_data_offset <= size && (uint64_t)record.lod_count * sizeof(MeshCacheLodRecord) <= size - record.lod_data_offset;
+        if (!valid) {
+            break;
+        }
+
+        std::vector<MeshLod> lod;
+        const MeshCacheLodRecord* lod_records = (const MeshCacheLodRecord*)(data + record.lod_data_offset);
+        for (uint32_t lod_index = 0; valid && lod_index < record.lod_count; lod_index++) {
+            const MeshCacheLodRecord& lod_record = lod_records[lod_index];
+            valid = (uint64_t)lod_record.index_offset + lod_record.index_count <= record.index_count;
+            lod.push_back((MeshLod) {
+                .index_offset = lod_record.index_offset,
+                .index_count = lod_record.index_count,
+                .error = lod_record.error
+            });
+        }
+        if (!valid) {
+            break;
+        }
+
+        cache->mesh.push_back((MeshCacheMesh) {
+            .name = mesh_cache_string(strings, record.name),
+            .material = mesh_cache_string(strings, record.material),
+            .offset = glm::vec3(record.offset[0], record.offset[1], record.offset[2]),
+            .bounds_min = glm::vec3(record.bounds_min[0], record.bounds_min[1], record.bounds_min[2]),
+            .bounds_max = glm::vec3(record.bounds_max[0], record.bounds_max[1], record.bounds_max[2]),
+            .vertex_format = (VertexFormat)record.vertex_format,
+            .position_scale = glm::vec3(record.position_scale[0], record.position_scale[1], record.position_scale[2]),
+            .vertices = data + record.vertex_data_offset,
+            .vertex_count = record.vertex_count,
+            .indices = data + record.index_data_offset,
+            .index_count = record.index_count,
+            .index_type = (GLenum)record.index_type,
+            .lod = lod
+        });
+    }
+
+    const MeshCacheMaterialRecord* material_records = (const MeshCacheMaterialRecord*)(mesh_records + (valid ? header->mesh_count : 0));
+    for (uint32_t i = 0; valid && i < header->material_count; i++) {
+        const MeshCacheMaterialRecord& record = material_records[i];
+        valid = mesh_cache_string_valid(record.name, strings_size) && mesh_cache_string_valid(record.map_ka, strings_size) && mesh_cache_string_valid(record.map_kd, strings_size);
+        if (!valid) {
+            break;
+        }
+
+        ObjMaterial& material = cache->material[mesh_cache_string(strings, record.name)];
+        material.ka = glm::vec3(record.ka[0], record.ka[1], record.ka[2]);
+        material.kd = glm::vec3(record.kd[0], record.kd[1], record.kd[2]);
+        material.ks = glm::vec3(record.ks[0], record.ks[1], record.ks[2]);
+        material.map_ka = mesh_cache_string(strings, record.map_ka);
+        material.map_kd = mesh_cache_string(strings, record.map_kd);
+    }
+
+    return valid;
+}
+
+bool mesh_cache_open(MeshCache* cache, std::string source_path) {
+    cache->mesh.clear();
+    cache->material.clear();
+    cache->memory.clear();
+    if (!mapped_file_open(&cache->file, cache_path(source_path, MESH_CACHE_EXTENSION))) {
+        return false;
+    }
+    if (!mesh_cache_parse(cache, cache->file.data, cache->file.size, source_path)) {
+        mesh_cache_close(cache);
+        return false;
+    }
+
+    return true;
+}
+
+void mesh_cache_close(MeshCache* cache) {
+    if (cache->memory.empty()) {
+        mapped_file_close(&cache->file);
+    }
+    cache->memory.clear();
+    cache->mesh.clear();
+    cache->material.clear();
+}
+
+static MeshCacheString mesh_cache_add_string(std::string* string_table, const std::string& value) {
+    MeshCacheString result;
+    result.offset = string_table->size();
+    result.length = value.size();
+    *string_table += value;
+
+    return result;
+}
+
+static std::size_t mesh_cache_align(std::size_t offset) {
+    return (offset + MESH_CACHE_BLOB_ALIGNMENT - 1) & ~(MESH_CACHE_BLOB_ALIGNMENT - 1);
+}
+
+static bool mesh_cache_bake(std::vector<char>* buffer, const ModelData& model_data, std::string source_path) {
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    header.version = MESH_CACHE_VERSION;
+    if (!cache_file_stat(source_path, &header.source_modified_time, &header.source_size)) {
+        return false;
+    }
+    uint64_t mtl_size;
+    if (model_data.mtl_path != "" && !cache_file_stat(model_data.mtl_path, &header.mtl_modified_time, &mtl_size)) {
+        return false;
+    }
+    header.mesh_count = model_data.mesh.size();
+    header.material_count = model_data.material.size();
+
+    std::string string_table;
+    header.mtl_path = mesh_cache_add_string(&string_table, model_data.mtl_path);
+
+    std::vector<MeshCacheMaterialRecord> material_records;
+    for (std::map<std::string, ObjMaterial>::const_iterator it = model_data.material.begin(); it != model_data.material.end(); ++it) {
+        MeshCacheMaterialRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.name = mesh_cache_add_string(&string_table, it->first);
+        for (int i = 0; i < 3; i++) {
+            record.ka[i] = it->second.ka[i];
+            record.kd[i] = it->second.kd[i];
+            record.ks[i] = it->second.ks[i];
+        }
+        record.map_ka = mesh_cache_add_string(&string_table, it->second.map_ka);
+        record.map_kd = mesh_cache_add_string(&string_table, it->second.map_kd);
+        material_records.push_back(record);
+    }
+
+    // lay out the blobs after the string table, converting vertices to the current format and indices to 16 bit whenever they fit
+    std::vector<MeshCacheMeshRecord> mesh_records;
+    std::vector<std::vector<CompactVertexData>> compact_vertices;
+    std::vector<std::vector<GLushort>> short_indices;
+    for (std::map<std::string, MeshData>::const_iterator it = model_data.mesh.begin(); it != model_data.mesh.end(); ++it) {
+        // padding goes to disk too, so it's cleared to keep cache files deterministic
+        MeshCacheMeshRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.name = mesh_cache_add_string(&string_table, it->first);
+        record.material = mesh_cache_add_string(&string_table, it->second.material);
+        for (int i = 0; i < 3; i++) {
+            record.offset[i] = it->second.offset[i];
+            record.bounds_min[i] = it->second.bounds_min[i];
+            record.bounds_max[i] = it->second.bounds_max[i];
+            record.position_scale[i] = 1.0f;
+        }
+        record.vertex_format = model_vertex_format;
+        compact_vertices.push_back(std::vector<CompactVertexData>());
+        if (model_vertex_format == VERTEX_FORMAT_COMPACT) {
+            glm::vec3 position_scale = model_position_scale(it->second);
+            for (int i = 0; i < 3; i++) {
+                record.position_scale[i] = position_scale[i];
+            }
+            model_vertices_compact(&compact_vertices.back(), it->second.vertices, position_scale);
+        }
+        record.vertex_count = it->second.vertices.size();
+        record.index_count = it->second.indices.size();
+        record.index_type = it->second.vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        record.lod_count = it->second.lod.size();
+        if (record.index_type == GL_UNSIGNED_SHORT) {
+            short_indices.push_back(std::vector<GLushort>(it->second.indices.begin(), it->second.indices.end()));
+        } else {
+            short_indices.push_back(std::vector<GLushort>());
+        }
+        mesh_records.push_back(record);
+    }
+
+    header.string_table_offset = sizeof(MeshCacheHeader) + (mesh_records.size() * sizeof(MeshCacheMeshRecord)) + (material_records.size() * sizeof(MeshCacheMaterialRecord));
+    header.string_table_size = string_table.size();
+    std::size_t blob_offset = mesh_cache_align(header.string_table_offset + header.string_table_size);
+    for (MeshCacheMeshRecord& record : mesh_records) {
+        record.vertex_data_offset = blob_offset;
+        blob_offset = mesh_cache_align(blob_offset + (record.vertex_count * model_vertex_size((VertexFormat)record.vertex_format)));
+        record.index_data_offset = blob_offset;
+        blob_offset = mesh_cache_align(blob_offset + (record.index_count * (record.index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint))));
+        record.lod_data_offset = blob_offset;
+        blob_offset = mesh_cache_align(blob_offset + (record.lod_count * sizeof(MeshCacheLodRecord)));
+    }
+
+    // assemble the whole file in memory so that it can be written out in one go
+    buffer->assign(blob_offset, 0);
+    std::memcpy(&(*buffer)[0], &header, sizeof(header));
+    if (!mesh_records.empty()) {
+        std::memcpy(&(*buffer)[sizeof(header)], &mesh_records[0], mesh_records.size() * sizeof(MeshCacheMeshRecord));
+    }
+    if (!material_records.empty()) {
+        std::memcpy(&(*buffer)[sizeof(header) + (mesh_records.size() * sizeof(MeshCacheMeshRecord))], &material_records[0], material_records.size() * sizeof(MeshCacheMaterialRecord));
+    }
+    if (!string_table.empty()) {
+        std::memcpy(&(*buffer)[header.string_table_offset], string_table.data(), string_table.size());
+    }
+    unsigned int mesh_index = 0;
+    for (std::map<std::string, MeshData>::const_iterator it = model_data.mesh.begin(); it != model_data.mesh.end(); ++it) {
+        const MeshCacheMeshRecord& record = mesh_records[mesh_index];
+        if (record.vertex_count != 0 && record.vertex_format == VERTEX_FORMAT_COMPACT) {
+            std::memcpy(&(*buffer)[record.vertex_data_offset], &compact_vertices[mesh_index][0], record.vertex_count * sizeof(CompactVertexData));
+        } else if (record.vertex_count != 0) {
+            std::memcpy(&(*buffer)[record.vertex_data_offset], &it->second.vertices[0], record.vertex_count * sizeof(VertexData));
+        }
+        if (record.index_count != 0 && record.index_type == GL_UNSIGNED_SHORT) {
+            std::memcpy(&(*buffer)[record.index_data_offset], &short_indices[mesh_index][0], record.index_count * sizeof(GLushort));
+        } else if (record.index_count != 0) {
+            std::memcpy(&(*buffer)[record.index_data_offset], &it->second.indices[0], record.index_count * sizeof(GLuint));
+        }
+        MeshCacheLodRecord* lod_records = (MeshCacheLodRecord*)(buffer->data() + record.lod_data_offset);
+        for (uint32_t lod_index = 0; lod_index < record.lod_count; lod_index++) {
+            lod_records[lod_index].index_offset = it->second.lod[lod_index].index_offset;
+            lod_records[lod_index].index_count = it->second.lod[lod_index].index_count;
+            lod_records[lod_index].error = it->second.lod[lod_index].error;
+        }
+        mesh_index++;
+    }
+
+    return true;
+}
+
+bool mesh_cache_write(const ModelData& model_data, std::string source_path) {
+    std::vector<char> buffer;
+    if (!mesh_cache_bake(&buffer, model_data, source_path)) {
+        return false;
+    }
+
+    return cache_write(cache_path(source_path, MESH_CACHE_EXTENSION), buffer.data(), buffer.size());
+}
+
+bool mesh_cache_load(MeshCache* cache, std::string source_path) {
+    if (mesh_cache_open(cache, source_path)) {
+        return true;
+    }
+
+    ModelData model_data;
+    if (!model_import(&model_data, source_path)) {
+        return false;
+    }
+    if (!mesh_cache_bake(&cache->memory, model_data, source_path)) {
+        cache->memory.clear();
+        return false;
+    }
+    // failing to save the cache only costs an import next time, the baked copy in memory is still good
+    cache_write(cache_path(source_path, MESH_CACHE_EXTENSION), cache->memory.data(), cache->memory.size());
+    if (!mesh_cache_parse(cache, cache->memory.data(), cache->memory.size(), source_path)) {
+        mesh_cache_close(cache);
+        return false;
+    }
+
+    return true;
+}
\ No newline at end of file
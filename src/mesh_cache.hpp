@@ -0,0 +1,44 @@
+#pragma once
+
+#include "model.hpp"
+#include "mapped_file.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <map>
+
+// Baked binary copies of imported models, stored in ./cache/.
+// A cache file is only used while the loader version, the vertex format and the modification times of the source obj and mtl match the ones it was baked from.
+
+struct MeshCacheMesh {
+    std::string name;
+    std::string material;
+    glm::vec3 offset;
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    VertexFormat vertex_format;
+    glm::vec3 position_scale;
+    // these point into the cache data and are only valid until mesh_cache_close
+    const void* vertices;
+    unsigned int vertex_count;
+    const void* indices;
+    unsigned int index_count;
+    GLenum index_type;
+    std::vector<MeshLod> lod;
+};
+
+struct MeshCache {
+    MappedFile file;
+    // holds the baked data instead of file when the cache had to be rebuilt by mesh_cache_load
+    std::vector<char> memory;
+    std::vector<MeshCacheMesh> mesh;
+    std::map<std::string, ObjMaterial> material;
+};
+
+bool mesh_cache_open(MeshCache* cache, std::string source_path);
+void mesh_cache_close(MeshCache* cache);
+bool mesh_cache_write(const ModelData& model_data, std::string source_path);
+// opens the cache, importing the model and rebaking it first if the cache is missing or stale
+bool mesh_cache_load(MeshCache* cache, std::string source_path);
\ No newline at end of file
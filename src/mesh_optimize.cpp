@@ -0,0 +1,255 @@
+#include "mesh_optimize.hpp"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+
+// soft clusters are cut once their ACMR gets this close to the ACMR of the hard cluster they came from
+const float MESH_OPTIMIZE_OVERDRAW_THRESHOLD = 1.05f;
+
+MeshOptimizeStats mesh_optimize_analyze(const std::vector<unsigned int>& indices, unsigned int vertex_count) {
+    // simulate a FIFO cache, which is what most hardware post-transform caches behave like
+    std::vector<unsigned int> cache_timestamps(vertex_count, 0);
+    unsigned int timestamp = MESH_OPTIMIZE_CACHE_SIZE + 1;
+    unsigned int misses = 0;
+    for (unsigned int index : indices) {
+        if (timestamp - cache_timestamps[index] > MESH_OPTIMIZE_CACHE_SIZE) {
+            cache_timestamps[index] = timestamp;
+            timestamp++;
+            misses++;
+        }
+    }
+
+    MeshOptimizeStats stats;
+    stats.acmr = indices.empty() ? 0.0f : (float)misses / (float)(indices.size() / 3);
+    stats.atvr = vertex_count == 0 ? 0.0f : (float)misses / (float)vertex_count;
+
+    return stats;
+}
+
+void mesh_optimize_vertex_cache(std::vector<unsigned int>* indices, unsigned int vertex_count, std::vector<unsigned int>* clusters) {
+    const unsigned int triangle_count = indices->size() / 3;
+
+    // build vertex to triangle adjacency
+    std::vector<unsigned int> live_triangles(vertex_count, 0);
+    for (unsigned int index : *indices) {
+        live_triangles[index]++;
+    }
+    std::vector<unsigned int> adjacency_offsets(vertex_count + 1, 0);
+    for (unsigned int vertex = 0; vertex < vertex_count; vertex++) {
+        adjacency_offsets[vertex + 1] = adjacency_offsets[vertex] + live_triangles[vertex];
+    }
+    std::vector<unsigned int> adjacency(indices->size());
+    std::vector<unsigned int> adjacency_fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for (unsigned int i = 0; i < indices->size(); i++) {
+        adjacency[adjacency_fill[(*indices)[i]]++] = i / 3;
+    }
+
+    std::vector<unsigned int> cache_timestamps(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<unsigned int> dead_end_stack;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> output;
+    output.reserve(indices->size());
+    if (clusters != NULL) {
+        clusters->clear();
+    }
+
+    unsigned int timestamp = MESH_OPTIMIZE_CACHE_SIZE + 1;
+    unsigned int scan_cursor = 0;
+    int fanning_vertex = vertex_count == 0 ? -1 : 0;
+    bool cold_start = true;
+    while (fanning_vertex >= 0) {
+        if (cold_start && clusters != NULL) {
+            clusters->push_back(output.size() / 3);
+        }
+        cold_start = false;
+
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int i = adjacency_offsets[fanning_vertex]; i < adjacency_offsets[fanning_vertex + 1]; i++) {
+            unsigned int triangle = adjacency[i];
+            if (emitted[triangle]) {
+                continue;
+            }
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                unsigned int vertex = (*indices)[(triangle * 3) + corner];
+                output.push_back(vertex);
+                dead_end_stack.push_back(vertex);
+                candidates.push_back(vertex);
+                live_triangles[vertex]--;
+                if (timestamp - cache_timestamps[vertex] > MESH_OPTIMIZE_CACHE_SIZE) {
+                    cache_timestamps[vertex] = timestamp;
+                    timestamp++;
+                }
+            }
+            emitted[triangle] = true;
+        }
+
+        // prefer the candidate that will still be in the cache once all of its triangles have been emitted, and is oldest among those
+        int best_vertex = -1;
+        int best_priority = -1;
+        for (unsigned int vertex : candidates) {
+            if (live_triangles[vertex] == 0) {
+                continue;
+            }
+            int priority = 0;
+            if (timestamp - cache_timestamps[vertex] + (2 * live_triangles[vertex]) <= MESH_OPTIMIZE_CACHE_SIZE) {
+                priority = timestamp - cache_timestamps[vertex];
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                best_vertex = vertex;
+            }
+        }
+
+        // dead end, so fall back to a recently used vertex, or failing that, the next unfinished vertex in input order
+        if (best_vertex == -1) {
+            while (!dead_end_stack.empty()) {
+                unsigned int vertex = dead_end_stack.back();
+                dead_end_stack.pop_back();
+                if (live_triangles[vertex] > 0) {
+                    best_vertex = vertex;
+                    break;
+                }
+            }
+        }
+        if (best_vertex == -1) {
+            while (scan_cursor < vertex_count && live_triangles[scan_cursor] == 0) {
+                scan_cursor++;
+            }
+            if (scan_cursor < vertex_count) {
+                best_vertex = scan_cursor;
+                cold_start = true;
+            }
+        }
+
+        fanning_vertex = best_vertex;
+    }
+
+    indices->swap(output);
+}
+
+void mesh_optimize_overdraw(std::vector<unsigned int>* indices, const std::vector<VertexData>& vertices, const std::vector<unsigned int>& clusters, float threshold) {
+    const unsigned int triangle_count = indices->size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // split the hard clusters into smaller soft clusters wherever the cache is doing about as well as it does for the whole cluster
+    std::vector<unsigned int> soft_clusters;
+    std::vector<unsigned int> cache_timestamps(vertices.size(), 0);
+    unsigned int timestamp = MESH_OPTIMIZE_CACHE_SIZE + 1;
+    for (unsigned int cluster = 0; cluster < clusters.size(); cluster++) {
+        unsigned int cluster_begin = clusters[cluster];
+        unsigned int cluster_end = cluster + 1 < clusters.size() ? clusters[cluster + 1] : triangle_count;
+
+        std::vector<unsigned int> cluster_indices(indices->begin() + (cluster_begin * 3), indices->begin() + (cluster_end * 3));
+        float cluster_acmr = mesh_optimize_analyze(cluster_indices, vertices.size()).acmr;
+
+        soft_clusters.push_back(cluster_begin);
+        timestamp += MESH_OPTIMIZE_CACHE_SIZE + 1;
+        unsigned int misses = 0;
+        unsigned int soft_begin = cluster_begin;
+        for (unsigned int triangle = cluster_begin; triangle < cluster_end; triangle++) {
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                unsigned int vertex = (*indices)[(triangle * 3) + corner];
+                if (timestamp - cache_timestamps[vertex] > MESH_OPTIMIZE_CACHE_SIZE) {
+                    cache_timestamps[vertex] = timestamp;
+                    timestamp++;
+                    misses++;
+                }
+            }
+
+            unsigned int soft_triangle_count = triangle + 1 - soft_begin;
+            if (triangle + 1 < cluster_end && (float)misses / (float)soft_triangle_count <= cluster_acmr * threshold) {
+                soft_clusters.push_back(triangle + 1);
+                soft_begin = triangle + 1;
+                misses = 0;
+                // a new soft cluster may be drawn anywhere, so it has to assume a cold cache
+                timestamp += MESH_OPTIMIZE_CACHE_SIZE + 1;
+            }
+        }
+    }
+
+    // measure how likely each cluster is to occlude the rest of the mesh: how far it faces away from the mesh center
+    glm::vec3 mesh_centroid = glm::vec3(0.0f);
+    float mesh_area = 0.0f;
+    std::vector<glm::vec3> cluster_centroids(soft_clusters.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> cluster_normals(soft_clusters.size(), glm::vec3(0.0f));
+    std::vector<float> cluster_areas(soft_clusters.size(), 0.0f);
+    for (unsigned int cluster = 0; cluster < soft_clusters.size(); cluster++) {
+        unsigned int cluster_end = cluster + 1 < soft_clusters.size() ? soft_clusters[cluster + 1] : triangle_count;
+        for (unsigned int triangle = soft_clusters[cluster]; triangle < cluster_end; triangle++) {
+            glm::vec3 a = vertices[(*indices)[(triangle * 3) + 0]].position;
+            glm::vec3 b = vertices[(*indices)[(triangle * 3) + 1]].position;
+            glm::vec3 c = vertices[(*indices)[(triangle * 3) + 2]].position;
+            // the cross product has the length of twice the area, so it works as an area weighted normal
+            glm::vec3 weighted_normal = glm::cross(b - a, c - a);
+            float area = glm::length(weighted_normal);
+            glm::vec3 centroid = (a + b + c) / 3.0f;
+
+            cluster_centroids[cluster] += centroid * area;
+            cluster_normals[cluster] += weighted_normal;
+            cluster_areas[cluster] += area;
+            mesh_centroid += centroid * area;
+            mesh_area += area;
+        }
+    }
+    if (mesh_area > 0.0f) {
+        mesh_centroid /= mesh_area;
+    }
+
+    std::vector<std::pair<float, unsigned int>> cluster_order;
+    for (unsigned int cluster = 0; cluster < soft_clusters.size(); cluster++) {
+        float occlusion = 0.0f;
+        if (cluster_areas[cluster] > 0.0f) {
+            glm::vec3 centroid = cluster_centroids[cluster] / cluster_areas[cluster];
+            float normal_length = glm::length(cluster_normals[cluster]);
+            if (normal_length > 0.0f) {
+                occlusion = glm::dot(centroid - mesh_centroid, cluster_normals[cluster] / normal_length);
+            }
+        }
+        cluster_order.push_back(std::make_pair(-occlusion, cluster));
+    }
+    std::stable_sort(cluster_order.begin(), cluster_order.end());
+
+    std::vector<unsigned int> output;
+    output.reserve(indices->size());
+    for (const std::pair<float, unsigned int>& entry : cluster_order) {
+        unsigned int cluster = entry.second;
+        unsigned int cluster_end = cluster + 1 < soft_clusters.size() ? soft_clusters[cluster + 1] : triangle_count;
+        output.insert(output.end(), indices->begin() + (soft_clusters[cluster] * 3), indices->begin() + (cluster_end * 3));
+    }
+    indices->swap(output);
+}
+
+void mesh_optimize_vertex_fetch(std::vector<VertexData>* vertices, std::vector<unsigned int>* indices) {
+    const unsigned int UNUSED = (unsigned int)-1;
+    std::vector<unsigned int> remap(vertices->size(), UNUSED);
+    std::vector<VertexData> output;
+    output.reserve(vertices->size());
+
+    for (unsigned int& index : *indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = output.size();
+            output.push_back((*vertices)[index]);
+        }
+        index = remap[index];
+    }
+
+    // unreferenced vertices are dropped
+    vertices->swap(output);
+}
+
+void mesh_optimize(MeshData* mesh_data) {
+    // each level of detail is drawn on its own, so each one gets its own triangle order
+    for (const MeshLod& lod : mesh_data->lod) {
+        std::vector<unsigned int> lod_indices(mesh_data->indices.begin() + lod.index_offset, mesh_data->indices.begin() + lod.index_offset + lod.index_count);
+        std::vector<unsigned int> clusters;
+        mesh_optimize_vertex_cache(&lod_indices, mesh_data->vertices.size(), &clusters);
+        mesh_optimize_overdraw(&lod_indices, mesh_data->vertices, clusters, MESH_OPTIMIZE_OVERDRAW_THRESHOLD);
+        std::copy(lod_indices.begin(), lod_indices.end(), mesh_data->indices.begin() + lod.index_offset);
+    }
+    // the full mesh comes first in the index buffer, so the vertex order favors it and the coarser levels use a subset of it
+    mesh_optimize_vertex_fetch(&mesh_data->vertices, &mesh_data->indices);
+}
\ No newline at end of file
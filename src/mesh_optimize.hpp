@@ -0,0 +1,28 @@
+#pragma once
+
+#include "model.hpp"
+
+#include <vector>
+
+// Reorders indexed triangle lists for the GPU.
+// The passes should run in order: vertex cache, then overdraw (which keeps most of the cache locality), then vertex fetch
+
+// size of the simulated post-transform cache, both for optimizing and for measuring
+const unsigned int MESH_OPTIMIZE_CACHE_SIZE = 16;
+
+struct MeshOptimizeStats {
+    // average cache miss ratio, vertex shader invocations per triangle. 0.5 is ideal, 3 means no reuse at all
+    float acmr;
+    // average transform to vertex ratio, vertex shader invocations per vertex. 1 is ideal
+    float atvr;
+};
+
+MeshOptimizeStats mesh_optimize_analyze(const std::vector<unsigned int>& indices, unsigned int vertex_count);
+// Tipsify. Optionally returns the first triangle of every cluster which starts on a cold cache
+void mesh_optimize_vertex_cache(std::vector<unsigned int>* indices, unsigned int vertex_count, std::vector<unsigned int>* clusters);
+// splits the clusters further and sorts them so that outward facing parts of the mesh draw first
+void mesh_optimize_overdraw(std::vector<unsigned int>* indices, const std::vector<VertexData>& vertices, const std::vector<unsigned int>& clusters, float threshold);
+// renumbers vertices in the order they are first used
+void mesh_optimize_vertex_fetch(std::vector<VertexData>* vertices, std::vector<unsigned int>* indices);
+// runs every pass on the mesh
+void mesh_optimize(MeshData* mesh_data);
\ No newline at end of file
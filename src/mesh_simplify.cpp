@@ -0,0 +1,389 @@
+#include "mesh_simplify.hpp"
+
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <queue>
+#include <cmath>
+#include <cstring>
+
+// target triangle ratio and maximum error, relative to the mesh radius, for each level after the first
+const float MESH_SIMPLIFY_LOD_RATIOS[MESH_SIMPLIFY_MAX_LODS - 1] = { 0.5f, 0.25f, 0.125f };
+const float MESH_SIMPLIFY_LOD_ERRORS[MESH_SIMPLIFY_MAX_LODS - 1] = { 0.02f, 0.05f, 0.1f };
+// a vertex of "from" that isn't on the collapsed edge may still move onto a vertex of "to" with the same texture coordinates and a normal at least this close,
+// which lets flat shaded meshes simplify across their smoother regions
+const float MESH_SIMPLIFY_NORMAL_THRESHOLD = 0.9f;
+// cosine of the largest rotation a triangle may make in a single collapse, which also keeps triangles from flipping over
+const float MESH_SIMPLIFY_FLIP_THRESHOLD = 0.25f;
+// a level that doesn't get rid of at least this many of the previous level's triangles isn't worth the index memory
+const float MESH_SIMPLIFY_MIN_REDUCTION = 0.85f;
+
+// symmetric 4x4 matrix measuring squared distance to a set of planes, weighted by triangle area
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+struct CollapseCandidate {
+    float cost;
+    unsigned int from;
+    unsigned int to;
+
+    bool operator>(const CollapseCandidate& other) const {
+        return cost > other.cost;
+    }
+};
+
+struct PositionKey {
+    uint32_t bits[3];
+
+    bool operator==(const PositionKey& other) const {
+        return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+    }
+};
+
+struct PositionKeyHash {
+    std::size_t operator()(const PositionKey& key) const {
+        return ((std::size_t)key.bits[0] * 73856093u) ^ ((std::size_t)key.bits[1] * 19349663u) ^ ((std::size_t)key.bits[2] * 83492791u);
+    }
+};
+
+static Quadric quadric_from_triangle(glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+    glm::dvec3 normal = glm::cross(glm::dvec3(b - a), glm::dvec3(c - a));
+    double area = glm::length(normal) * 0.5;
+    Quadric quadric;
+    std::memset(&quadric, 0, sizeof(quadric));
+    if (area == 0.0) {
+        return quadric;
+    }
+    normal = glm::normalize(normal);
+    double distance = -glm::dot(normal, glm::dvec3(a));
+
+    quadric.a00 = normal.x * normal.x * area;
+    quadric.a01 = normal.x * normal.y * area;
+    quadric.a02 = normal.x * normal.z * area;
+    quadric.a11 = normal.y * normal.y * area;
+    quadric.a12 = normal.y * normal.z * area;
+    quadric.a22 = normal.z * normal.z * area;
+    quadric.b0 = normal.x * distance * area;
+    quadric.b1 = normal.y * distance * area;
+    quadric.b2 = normal.z * distance * area;
+    quadric.c = distance * distance * area;
+    quadric.weight = area;
+
+    return quadric;
+}
+
+static void quadric_add(Quadric* quadric, const Quadric& other) {
+    quadric->a00 += other.a00;
+    quadric->a01 += other.a01;
+    quadric->a02 += other.a02;
+    quadric->a11 += other.a11;
+    quadric->a12 += other.a12;
+    quadric->a22 += other.a22;
+    quadric->b0 += other.b0;
+    quadric->b1 += other.b1;
+    quadric->b2 += other.b2;
+    quadric->c += other.c;
+    quadric->weight += other.weight;
+}
+
+// returns the area weighted RMS distance from point to the planes of the quadric
+static float quadric_error(const Quadric& quadric, glm::vec3 point) {
+    if (quadric.weight == 0.0) {
+        return 0.0f;
+    }
+    double x = point.x;
+    double y = point.y;
+    double z = point.z;
+    double error = (quadric.a00 * x * x) + (2.0 * quadric.a01 * x * y) + (2.0 * quadric.a02 * x * z) +
+                   (quadric.a11 * y * y) + (2.0 * quadric.a12 * y * z) + (quadric.a22 * z * z) +
+                   (2.0 * quadric.b0 * x) + (2.0 * quadric.b1 * y) + (2.0 * quadric.b2 * z) + quadric.c;
+
+    return (float)std::sqrt(std::max(error, 0.0) / quadric.weight);
+}
+
+float mesh_simplify(std::vector<unsigned int>* indices, const std::vector<VertexData>& vertices, unsigned int target_index_count, float target_error) {
+    unsigned int triangle_count = indices->size() / 3;
+
+    // weld vertices that only differ by their attributes, so that edges are found across uv seams and hard normals
+    std::vector<unsigned int> vertex_position(vertices.size());
+    std::vector<glm::vec3> positions;
+    std::unordered_map<PositionKey, unsigned int, PositionKeyHash> position_lookup;
+    for (unsigned int vertex = 0; vertex < vertices.size(); vertex++) {
+        PositionKey key;
+        std::memcpy(key.bits, &vertices[vertex].position[0], sizeof(key.bits));
+        std::pair<std::unordered_map<PositionKey, unsigned int, PositionKeyHash>::iterator, bool> lookup = position_lookup.insert(std::make_pair(key, (unsigned int)positions.size()));
+        if (lookup.second) {
+            positions.push_back(vertices[vertex].position);
+        }
+        vertex_position[vertex] = lookup.first->second;
+    }
+
+    std::vector<unsigned int> position_remap(positions.size());
+    std::vector<Quadric> quadrics(positions.size());
+    std::vector<std::vector<unsigned int>> position_triangles(positions.size());
+    std::vector<bool> position_locked(positions.size(), false);
+    std::vector<bool> triangle_removed(triangle_count, false);
+    for (unsigned int position = 0; position < positions.size(); position++) {
+        position_remap[position] = position;
+        std::memset(&quadrics[position], 0, sizeof(Quadric));
+    }
+
+    std::unordered_map<uint64_t, unsigned int> edge_counts;
+    for (unsigned int triangle = 0; triangle < triangle_count; triangle++) {
+        unsigned int corners[3];
+        for (unsigned int corner = 0; corner < 3; corner++) {
+            corners[corner] = vertex_position[(*indices)[(triangle * 3) + corner]];
+            position_triangles[corners[corner]].push_back(triangle);
+        }
+        Quadric quadric = quadric_from_triangle(positions[corners[0]], positions[corners[1]], positions[corners[2]]);
+        for (unsigned int corner = 0; corner < 3; corner++) {
+            quadric_add(&quadrics[corners[corner]], quadric);
+
+            unsigned int a = std::min(corners[corner], corners[(corner + 1) % 3]);
+            unsigned int b = std::max(corners[corner], corners[(corner + 1) % 3]);
+            edge_counts[((uint64_t)a << 32) | b]++;
+        }
+    }
+
+    // lock open borders and non-manifold edges so that the silhouette of the mesh and the boundary between materials stay put
+    for (std::unordered_map<uint64_t, unsigned int>::iterator it = edge_counts.begin(); it != edge_counts.end(); ++it) {
+        if (it->second != 2) {
+            position_locked[(unsigned int)(it->first >> 32)] = true;
+            position_locked[(unsigned int)(it->first & 0xffffffff)] = true;
+        }
+    }
+
+    std::priority_queue<CollapseCandidate, std::vector<CollapseCandidate>, std::greater<CollapseCandidate>> candidates;
+    for (unsigned int triangle = 0; triangle < triangle_count; triangle++) {
+        for (unsigned int corner = 0; corner < 3; corner++) {
+            unsigned int from = vertex_position[(*indices)[(triangle * 3) + corner]];
+            unsigned int to = vertex_position[(*indices)[(triangle * 3) + ((corner + 1) % 3)]];
+            Quadric quadric = quadrics[from];
+            quadric_add(&quadric, quadrics[to]);
+            candidates.push((CollapseCandidate) { .cost = quadric_error(quadric, positions[to]), .from = from, .to = to });
+            candidates.push((CollapseCandidate) { .cost = quadric_error(quadric, positions[from]), .from = to, .to = from });
+        }
+    }
+
+    float max_error = 0.0f;
+    std::unordered_map<unsigned int, unsigned int> vertex_map;
+    while (triangle_count * 3 > target_index_count && !candidates.empty()) {
+        CollapseCandidate candidate = candidates.top();
+        candidates.pop();
+        if (candidate.cost > target_error) {
+            break;
+        }
+
+        unsigned int from = candidate.from;
+        unsigned int to = candidate.to;
+        if (position_remap[from] != from || position_remap[to] != to || from == to || position_locked[from]) {
+            continue;
+        }
+
+        // the queue holds stale costs, so re-evaluate and requeue if the collapse got more expensive in the meantime
+        Quadric quadric = quadrics[from];
+        quadric_add(&quadric, quadrics[to]);
+        float cost = quadric_error(quadric, positions[to]);
+        if (cost > candidate.cost * 1.0001f + 1e-9f) {
+            candidates.push((CollapseCandidate) { .cost = cost, .from = from, .to = to });
+            continue;
+        }
+
+        // the triangles along the edge tell us which vertex of "to" replaces each vertex of "from".
+        // a vertex of "from" that isn't on the edge sits on a uv seam or hard edge, and may only move onto a matching vertex of "to" so that the seam doesn't tear
+        vertex_map.clear();
+        bool valid = true;
+        bool shares_edge = false;
+        for (unsigned int triangle : position_triangles[from]) {
+            if (triangle_removed[triangle]) {
+                continue;
+            }
+            int from_corner = -1;
+            int to_corner = -1;
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                unsigned int position = vertex_position[(*indices)[(triangle * 3) + corner]];
+                if (position == from) {
+                    from_corner = corner;
+                } else if (position == to) {
+                    to_corner = corner;
+                }
+            }
+            if (from_corner == -1 || to_corner == -1) {
+                continue;
+            }
+            shares_edge = true;
+            unsigned int from_vertex = (*indices)[(triangle * 3) + from_corner];
+            unsigned int to_vertex = (*indices)[(triangle * 3) + to_corner];
+            std::pair<std::unordered_map<unsigned int, unsigned int>::iterator, bool> lookup = vertex_map.insert(std::make_pair(from_vertex, to_vertex));
+            if (!lookup.second && lookup.first->second != to_vertex) {
+                valid = false;
+                break;
+            }
+        }
+        if (!valid || !shares_edge) {
+            continue;
+        }
+
+        for (unsigned int triangle : position_triangles[from]) {
+            if (triangle_removed[triangle] || !valid) {
+                continue;
+            }
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                unsigned int from_vertex = (*indices)[(triangle * 3) + corner];
+                if (vertex_position[from_vertex] != from || vertex_map.find(from_vertex) != vertex_map.end()) {
+                    continue;
+                }
+                int best_vertex = -1;
+                float best_dot = MESH_SIMPLIFY_NORMAL_THRESHOLD;
+                for (unsigned int to_triangle : position_triangles[to]) {
+                    if (triangle_removed[to_triangle]) {
+                        continue;
+                    }
+                    for (unsigned int to_corner = 0; to_corner < 3; to_corner++) {
+                        unsigned int to_vertex = (*indices)[(to_triangle * 3) + to_corner];
+                        if (vertex_position[to_vertex] != to || vertices[to_vertex].texture_coordinates != vertices[from_vertex].texture_coordinates) {
+                            continue;
+                        }
+                        float normal_dot = glm::dot(vertices[to_vertex].normal, vertices[from_vertex].normal);
+                        if (normal_dot >= best_dot) {
+                            best_dot = normal_dot;
+                            best_vertex = to_vertex;
+                        }
+                    }
+                }
+                if (best_vertex == -1) {
+                    valid = false;
+                    break;
+                }
+                vertex_map[from_vertex] = best_vertex;
+            }
+        }
+        if (!valid) {
+            continue;
+        }
+
+        // the surviving triangles must not flip over or turn too far
+        for (unsigned int triangle : position_triangles[from]) {
+            if (triangle_removed[triangle] || !valid) {
+                continue;
+            }
+            glm::vec3 corners[3];
+            glm::vec3 moved_corners[3];
+            bool contains_to = false;
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                unsigned int vertex = (*indices)[(triangle * 3) + corner];
+                unsigned int position = vertex_position[vertex];
+                corners[corner] = positions[position];
+                moved_corners[corner] = positions[position];
+                if (position == to) {
+                    contains_to = true;
+                } else if (position == from) {
+                    moved_corners[corner] = positions[to];
+                }
+            }
+            if (contains_to) {
+                continue;
+            }
+            glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            glm::vec3 moved_normal = glm::cross(moved_corners[1] - moved_corners[0], moved_corners[2] - moved_corners[0]);
+            float normal_length = glm::length(normal) * glm::length(moved_normal);
+            if (normal_length == 0.0f || glm::dot(normal, moved_normal) < normal_length * MESH_SIMPLIFY_FLIP_THRESHOLD) {
+                valid = false;
+            }
+        }
+        if (!valid) {
+            continue;
+        }
+
+        // collapse
+        for (unsigned int triangle : position_triangles[from]) {
+            if (triangle_removed[triangle]) {
+                continue;
+            }
+            bool contains_to = false;
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                if (vertex_position[(*indices)[(triangle * 3) + corner]] == to) {
+                    contains_to = true;
+                }
+            }
+            if (contains_to) {
+                triangle_removed[triangle] = true;
+                triangle_count--;
+                continue;
+            }
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                unsigned int& vertex = (*indices)[(triangle * 3) + corner];
+                if (vertex_position[vertex] == from) {
+                    vertex = vertex_map[vertex];
+                }
+            }
+            position_triangles[to].push_back(triangle);
+        }
+        position_remap[from] = to;
+        quadrics[to] = quadric;
+        position_triangles[from].clear();
+        max_error = std::max(max_error, cost);
+
+        // every edge around "to" has a new cost now
+        for (unsigned int triangle : position_triangles[to]) {
+            if (triangle_removed[triangle]) {
+                continue;
+            }
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                unsigned int neighbor = vertex_position[(*indices)[(triangle * 3) + corner]];
+                if (neighbor == to) {
+                    continue;
+                }
+                Quadric edge_quadric = quadrics[neighbor];
+                quadric_add(&edge_quadric, quadrics[to]);
+                candidates.push((CollapseCandidate) { .cost = quadric_error(edge_quadric, positions[to]), .from = neighbor, .to = to });
+                candidates.push((CollapseCandidate) { .cost = quadric_error(edge_quadric, positions[neighbor]), .from = to, .to = neighbor });
+            }
+        }
+    }
+
+    // compact the index buffer down to the surviving triangles
+    std::vector<unsigned int> output;
+    output.reserve(triangle_count * 3);
+    for (unsigned int triangle = 0; triangle < triangle_removed.size(); triangle++) {
+        if (!triangle_removed[triangle]) {
+            output.insert(output.end(), indices->begin() + (triangle * 3), indices->begin() + (triangle * 3) + 3);
+        }
+    }
+    indices->swap(output);
+
+    return max_error;
+}
+
+void mesh_simplify_lods(MeshData* mesh_data) {
+    mesh_data->lod.clear();
+    mesh_data->lod.push_back((MeshLod) {
+        .index_offset = 0,
+        .index_count = (unsigned int)mesh_data->indices.size(),
+        .error = 0.0f
+    });
+
+    float radius = glm::length(glm::max(glm::abs(mesh_data->bounds_min), glm::abs(mesh_data->bounds_max)));
+    std::vector<unsigned int> lod_indices(mesh_data->indices.begin(), mesh_data->indices.end());
+    const unsigned int full_index_count = mesh_data->indices.size();
+    for (unsigned int level = 0; level < MESH_SIMPLIFY_MAX_LODS - 1; level++) {
+        // each level continues from the previous one, which keeps the chain consistent and is cheaper than starting over
+        unsigned int previous_index_count = lod_indices.size();
+        unsigned int target_index_count = ((unsigned int)(full_index_count * MESH_SIMPLIFY_LOD_RATIOS[level]) / 3) * 3;
+        float error = mesh_simplify(&lod_indices, mesh_data->vertices, target_index_count, radius * MESH_SIMPLIFY_LOD_ERRORS[level]);
+        if (lod_indices.empty() || lod_indices.size() > previous_index_count * MESH_SIMPLIFY_MIN_REDUCTION) {
+            break;
+        }
+
+        mesh_data->lod.push_back((MeshLod) {
+            .index_offset = (unsigned int)mesh_data->indices.size(),
+            .index_count = (unsigned int)lod_indices.size(),
+            // error is measured against the previous level, so adding them up bounds how far this one is from the full mesh
+            .error = error + mesh_data->lod.back().error
+        });
+        mesh_data->indices.insert(mesh_data->indices.end(), lod_indices.begin(), lod_indices.end());
+    }
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "model.hpp"
+
+#include <vector>
+
+// Quadric error edge collapse simplification.
+// Vertices are only ever moved onto other existing vertices, so every level of detail shares the vertex buffer of the full mesh
+
+const unsigned int MESH_SIMPLIFY_MAX_LODS = 4;
+
+// collapses edges until the mesh is down to target_index_count indices or the next collapse would cost more than target_error.
+// returns the cost of the most expensive collapse that was made, in the same units as the vertex positions.
+// that's an area weighted RMS distance to the planes of the mesh as it was passed in, not a maximum
+float mesh_simplify(std::vector<unsigned int>* indices, const std::vector<VertexData>& vertices, unsigned int target_index_count, float target_error);
+// fills mesh_data->lod with the full mesh followed by up to MESH_SIMPLIFY_MAX_LODS - 1 coarser levels
+void mesh_simplify_lods(MeshData* mesh_data);
\ No newline at end of file
@@ -1,17 +1,40 @@
 #include "model.hpp"
 
 #include "shader.hpp"
+#include "obj.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_simplify.hpp"
+#include "asset.hpp"
+#include "texture.hpp"
+#include "render_queue.hpp"
+#include "mesh_buffer.hpp"
+#include "cull.hpp"
 
 #include <SDL2/SDL.h>
-#include <SDL2/SDL_image.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
-#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <cstdio>
+#include <limits>
 
 GLuint model_null_texture;
+VertexFormat model_vertex_format = VERTEX_FORMAT_COMPACT;
+glm::vec3 model_lod_camera_position = glm::vec3(0.0f);
+float model_lod_projection_scale = 0.0f;
+
+// reused by model_render_instanced so that culling doesn't allocate every frame
+CullBoxes model_cull_boxes;
+std::vector<unsigned int> model_visible_instances;
+std::vector<glm::mat4> model_instance_matrices;
+
+// a level of detail is used once its error covers less than this many pixels on screen
+const float MODEL_LOD_PIXEL_ERROR = 1.0f;
 
 bool model_init() {
     if (!model_texture_load(&model_null_texture, "./res/null_texture.png")) {
@@ -20,124 +43,72 @@ bool model_init() {
     return true;
 }
 
-bool model_load(Model* model, std::string path) {
-    // define structs
-    struct Face {
-        unsigned int position_indices[3];
-        unsigned int texture_coordinate_indices[3];
-        unsigned int normal_indices[3];
-    };
-    struct VertexData {
-        glm::vec3 position;
-        glm::vec3 normal;
-        glm::vec2 texture_coordinates;
-    };
+// identifies a unique combination of vertex attributes referenced by a face corner
+struct VertexKey {
+    int position_index;
+    int texture_coordinate_index;
+    int normal_index;
 
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec2> texture_coordinates;
-    std::vector<glm::vec3> normals;
-    std::map<std::string, std::vector<Face>> faces;
-
-    // open file
-    std::ifstream filein;
-    filein.open(path.c_str());
-    
-    if (!filein.is_open()) {
-        printf("Unable to open model %s\n", path.c_str());
-        return false;
+    bool operator==(const VertexKey& other) const {
+        return position_index == other.position_index && texture_coordinate_index == other.texture_coordinate_index && normal_index == other.normal_index;
     }
+};
+
+struct VertexKeyHash {
+    std::size_t operator()(const VertexKey& key) const {
+        std::size_t hash = (std::size_t)key.position_index * 73856093u;
+        hash ^= (std::size_t)key.texture_coordinate_index * 19349663u;
+        hash ^= (std::size_t)key.normal_index * 83492791u;
+        return hash;
+    }
+};
 
-    std::string current_object = "";
-    std::string mtllib_path = "";
+bool model_import(ModelData* model_data, std::string path) {
+    ObjData obj;
+    if (!obj_load(&obj, path)) {
+        return false;
+    }
 
-    std::string line;
-    while (std::getline(filein, line)) {
-        // ignore comments
-        if (line == "" || line[0] == '#') {
+    unsigned int vertex_count = 0;
+    unsigned int triangle_count = 0;
+    unsigned int lod_index_count = 0;
+    MeshOptimizeStats stats_before = (MeshOptimizeStats) { .acmr = 0.0f, .atvr = 0.0f };
+    MeshOptimizeStats stats_after = stats_before;
+    for (std::map<std::string, ObjObject>::iterator it = obj.objects.begin(); it != obj.objects.end(); ++it) {
+        if (it->second.faces.empty()) {
             continue;
         }
 
-        // split line into words
-        std::vector<std::string> words;
-        while (line != "") {
-            if (line[0] == ' ') {
-                line = line.substr(1);
-                continue;
-            }
-            std::size_t space_index = line.find(" ");
-            if (space_index == std::string::npos) {
-                words.push_back(line);
-                line = "";
-            } else {
-                words.push_back(line.substr(0, space_index));
-                line = line.substr(space_index + 1);
-            }
-        }
-
-        // parse line
-        if (words[0] == "v") {
-            positions.push_back(glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3])));
-        } else if (words[0] == "vt") {
-            texture_coordinates.push_back(glm::vec2(std::stof(words[1]), std::stof(words[2])));
-        } else if (words[0] == "vn") {
-            normals.push_back(glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3])));
-        } else if (words[0] == "f") {
-            for (unsigned int face_index = 1; face_index < words.size() - 2; face_index++) {
-                Face face;
-                for (unsigned int i = 0; i < 3; i++) {
-                    unsigned int index = i == 0 ? 1 : face_index + i;
-                    std::size_t slash_index = words[index].find("/");
-                    std::size_t second_slash_index = words[index].find("/", slash_index + 1);
-                    // subtract all indices by one because OBJ file indices start at 1 instead of 0
-                    face.position_indices[i] = std::stoi(words[index].substr(0, slash_index)) - 1;
-                    face.texture_coordinate_indices[i] = std::stoi(words[index].substr(slash_index + 1, second_slash_index)) - 1;
-                    face.normal_indices[i] = std::stoi(words[index].substr(second_slash_index + 1)) - 1;
-                }
-                faces[current_object].push_back(face);
-            }
-        } else if (words[0] == "o") {
-            if (words.size() > 1) {
-                current_object = words[1];
-            } else {
-                current_object = "";
-            }
-            std::map<std::string, std::vector<Face>>::iterator it = faces.find(current_object);
-            if (it == faces.end()) {
-                std::vector<Face> new_face_vector;
-                faces[current_object] = new_face_vector;
-            }
-        } else if (words[0] == "mtllib") {
-            mtllib_path = "";
-            for (unsigned int i = 1; i < words.size(); i++) {
-                mtllib_path += words[i];
-            }
-        } else if (words[0] == "usemtl") {
-            std::string mtl_name = "";
-            for (unsigned int i = 1; i < words.size(); i++) {
-                mtl_name += words[i];
-            }
-            model->mesh[current_object].material = mtl_name;
-        }
-    }
-    filein.close();
-
-    for (std::map<std::string, std::vector<Face>>::iterator it = faces.begin(); it != faces.end(); ++it) {
-        // get vertex data from faces
-        std::vector<VertexData> vertex_data;
-        for (Face face : it->second) {
+        // get vertex data from faces, sharing one vertex between every corner that uses the same attributes
+        MeshData& mesh_data = model_data->mesh[it->first];
+        std::vector<VertexData>& vertex_data = mesh_data.vertices;
+        std::vector<unsigned int>& indices = mesh_data.indices;
+        std::unordered_map<VertexKey, unsigned int, VertexKeyHash> vertex_lookup;
+        indices.reserve(it->second.faces.size() * 3);
+        vertex_lookup.reserve(it->second.faces.size() * 3);
+        for (const ObjFace& face : it->second.faces) {
             for (unsigned int i = 0; i < 3; i++) {
-                vertex_data.push_back((VertexData) {
-                    .position = positions[face.position_indices[i]],
-                    .normal = normals[face.normal_indices[i]],
-                    .texture_coordinates = texture_coordinates[face.texture_coordinate_indices[i]]
-                });
+                VertexKey key = (VertexKey) {
+                    .position_index = face.position_indices[i],
+                    .texture_coordinate_index = face.texture_coordinate_indices[i],
+                    .normal_index = face.normal_indices[i]
+                };
+                std::pair<std::unordered_map<VertexKey, unsigned int, VertexKeyHash>::iterator, bool> lookup = vertex_lookup.insert(std::make_pair(key, (unsigned int)vertex_data.size()));
+                if (lookup.second) {
+                    vertex_data.push_back((VertexData) {
+                        .position = obj.positions[key.position_index],
+                        .normal = key.normal_index != -1 ? obj.normals[key.normal_index] : glm::vec3(0.0f),
+                        .texture_coordinates = key.texture_coordinate_index != -1 ? obj.texture_coordinates[key.texture_coordinate_index] : glm::vec2(0.0f)
+                    });
+                }
+                indices.push_back(lookup.first->second);
             }
         }
 
         // center vertex positions around 0,0 and save the offset
         glm::vec3 vertex_min = vertex_data[0].position;
         glm::vec3 vertex_max = vertex_data[0].position;
-        for (VertexData v : vertex_data) {
+        for (const VertexData& v : vertex_data) {
             for (int i = 0; i < 3; i++) {
                 vertex_min[i] = std::min(v.position[i], vertex_min[i]);
                 vertex_max[i] = std::max(v.position[i], vertex_max[i]);
@@ -148,185 +119,379 @@ bool model_load(Model* model, std::string path) {
             v.position -= mesh_center;
         }
 
-        Mesh new_mesh;
-        new_mesh.offset = mesh_center;
-        new_mesh.vertex_data_size = vertex_data.size();
-        glGenVertexArrays(1, &new_mesh.vao);
-        glGenBuffers(1, &new_mesh.vbo);
-        glBindVertexArray(new_mesh.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, new_mesh.vbo);
-        glBufferData(GL_ARRAY_BUFFER, vertex_data.size() * sizeof(VertexData), &vertex_data[0], GL_STATIC_DRAW);
-
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)(6 * sizeof(float)));
-
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        model->mesh[it->first] = new_mesh;
+        mesh_data.material = it->second.material;
+        mesh_data.offset = mesh_center;
+        mesh_data.bounds_min = vertex_min - mesh_center;
+        mesh_data.bounds_max = vertex_max - mesh_center;
+
+        // the coarser levels of detail are appended to the index buffer
+        mesh_simplify_lods(&mesh_data);
+        lod_index_count += indices.size() - mesh_data.lod[0].index_count;
+
+        // reorder for the post-transform cache, overdraw and vertex fetch, keeping track of the totals for the report below.
+        // only the full mesh is measured so that the numbers stay comparable
+        std::vector<unsigned int> full_indices(indices.begin(), indices.begin() + mesh_data.lod[0].index_count);
+        MeshOptimizeStats mesh_stats = mesh_optimize_analyze(full_indices, vertex_data.size());
+        stats_before.acmr += mesh_stats.acmr * (full_indices.size() / 3);
+        stats_before.atvr += mesh_stats.atvr * vertex_data.size();
+        mesh_optimize(&mesh_data);
+        full_indices.assign(indices.begin(), indices.begin() + mesh_data.lod[0].index_count);
+        mesh_stats = mesh_optimize_analyze(full_indices, vertex_data.size());
+        stats_after.acmr += mesh_stats.acmr * (full_indices.size() / 3);
+        stats_after.atvr += mesh_stats.atvr * vertex_data.size();
+        vertex_count += vertex_data.size();
+        triangle_count += full_indices.size() / 3;
+    }
+
+    if (triangle_count != 0) {
+        printf("Optimized model %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", path.c_str(),
+            stats_before.acmr / triangle_count, stats_after.acmr / triangle_count,
+            stats_before.atvr / vertex_count, stats_after.atvr / vertex_count);
+        printf("Simplified model %s: %u triangles, %u more in coarser levels of detail\n", path.c_str(), triangle_count, lod_index_count / 3);
+    }
+
+    // a model without a material lib renders with the default material
+    model_data->mtl_path = "";
+    if (obj.mtllib == "") {
+        return true;
     }
 
     // Read mtl file
     std::size_t path_last_forward_slash = path.rfind('/');
     std::string path_folder = path_last_forward_slash == std::string::npos ? "./" : path.substr(0, path_last_forward_slash + 1);
-    std::string mtl_path = path_folder + mtllib_path;
-    std::ifstream mtl_filein;
-    mtl_filein.open(mtl_path.c_str());
-
-    if (!mtl_filein.is_open()) {
-        printf("Unable to open material lib %s\n", mtllib_path.c_str());
+    model_data->mtl_path = path_folder + obj.mtllib;
+    if (!obj_load_mtl(&model_data->material, model_data->mtl_path)) {
         return false;
     }
+    for (std::map<std::string, ObjMaterial>::iterator it = model_data->material.begin(); it != model_data->material.end(); ++it) {
+        if (it->second.map_ka != "") {
+            it->second.map_ka = path_folder + it->second.map_ka;
+        }
+        if (it->second.map_kd != "") {
+            it->second.map_kd = path_folder + it->second.map_kd;
+        }
+    }
+
+    return true;
+}
 
-    std::string current_material = "";
+unsigned int model_vertex_size(VertexFormat vertex_format) {
+    return vertex_format == VERTEX_FORMAT_COMPACT ? sizeof(CompactVertexData) : sizeof(VertexData);
+}
 
-    while (std::getline(mtl_filein, line)) {
-        // ignore comments
-        if (line == "" || line[0] == '#') {
-            continue;
+glm::vec3 model_position_scale(const MeshData& mesh_data) {
+    // positions are centered, so the larger side of the bounds covers the whole mesh
+    glm::vec3 position_scale = glm::max(glm::abs(mesh_data.bounds_min), glm::abs(mesh_data.bounds_max));
+    for (int i = 0; i < 3; i++) {
+        if (position_scale[i] == 0.0f) {
+            position_scale[i] = 1.0f;
         }
+    }
 
-        // split line into words
-        std::vector<std::string> words;
-        while (line != "") {
-            if (line[0] == ' ') {
-                line = line.substr(1);
-                continue;
-            }
-            std::size_t space_index = line.find(" ");
-            if (space_index == std::string::npos) {
-                words.push_back(line);
-                line = "";
-            } else {
-                words.push_back(line.substr(0, space_index));
-                line = line.substr(space_index + 1);
-            }
+    return position_scale;
+}
+
+GLshort model_pack_snorm16(float value) {
+    return (GLshort)std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+GLhalf model_pack_half(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x007fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff) {
+        // inf and nan
+        return (GLhalf)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+    } else if (exponent >= 31) {
+        // too large, clamp to inf
+        return (GLhalf)(sign | 0x7c00);
+    } else if (exponent <= 0) {
+        // denormal or too small, round to nearest denormal
+        if (exponent < -10) {
+            return (GLhalf)sign;
         }
+        mantissa |= 0x00800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half_mantissa = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) {
+            half_mantissa++;
+        }
+        return (GLhalf)(sign | half_mantissa);
+    }
 
-        // parse line
-        if (words[0] == "newmtl") {
-            std::string mtl_name = "";
-            for (unsigned int i = 1; i < words.size(); i++) {
-                mtl_name += words[i];
-            }
+    // round to nearest, a carry out of the mantissa correctly bumps the exponent
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x00001000) {
+        half++;
+    }
+    return (GLhalf)half;
+}
 
-            model->material[current_material] = (Material) {
-                .ka = glm::vec3(0.2f),
-                .kd = glm::vec3(0.8f),
-                .ks = glm::vec3(1.0f),
-                .map_ka = 0,
-                .map_kd = 0
-            };
-        } else if (words[0] == "Ka") {
-            model->material[current_material].ka = glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3]));
-        } else if (words[0] == "Kd") {
-            model->material[current_material].kd = glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3]));
-        } else if (words[0] == "Ks") {
-            model->material[current_material].ks = glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3]));
-        } else if (words[0] == "map_Ka") {
-            // TODO support non-png textures
-            if (words[1].find(".png") == std::string::npos) {
-                continue;
-            }
+void model_vertices_compact(std::vector<CompactVertexData>* compact_vertices, const std::vector<VertexData>& vertices, glm::vec3 position_scale) {
+    compact_vertices->resize(vertices.size());
+    for (unsigned int i = 0; i < vertices.size(); i++) {
+        CompactVertexData& compact = (*compact_vertices)[i];
 
-            model_texture_load(&model->material[current_material].map_ka, path_folder + words[1]);
-        } else if (words[0] == "map_Kd") {
-            // TODO support non-png textures
-            if (words[1].find(".png") == std::string::npos) {
-                continue;
+        glm::vec3 position = glm::clamp(vertices[i].position / position_scale, -1.0f, 1.0f);
+        for (int axis = 0; axis < 3; axis++) {
+            compact.position[axis] = model_pack_snorm16(position[axis]);
+        }
+        compact.position[3] = 0;
+
+        // octahedral encoding: project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper half
+        glm::vec3 normal = vertices[i].normal;
+        float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        glm::vec2 encoded = glm::vec2(0.0f);
+        if (length > 0.0f) {
+            normal /= length;
+            encoded = glm::vec2(normal.x, normal.y);
+            if (normal.z < 0.0f) {
+                encoded = glm::vec2(
+                    (1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+                    (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f)
+                );
             }
-
-            model_texture_load(&model->material[current_material].map_kd, path_folder + words[1]);
         }
+        compact.normal[0] = model_pack_snorm16(encoded.x);
+        compact.normal[1] = model_pack_snorm16(encoded.y);
+
+        compact.texture_coordinates[0] = model_pack_half(vertices[i].texture_coordinates.x);
+        compact.texture_coordinates[1] = model_pack_half(vertices[i].texture_coordinates.y);
     }
-    mtl_filein.close();
+}
+
+unsigned int model_index_size(GLenum index_type) {
+    return index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+void model_mesh_create(Mesh* mesh, unsigned int vertex_count, unsigned int index_count, GLenum index_type) {
+    mesh_buffer_allocate(mesh, vertex_count, index_count, index_type);
+}
+
+void model_mesh_bounds(Mesh* mesh, glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    mesh->bounds_min = bounds_min;
+    mesh->bounds_max = bounds_max;
+    mesh->bounds_radius = glm::length(bounds_max - bounds_min) * 0.5f;
+}
+
+void model_bounds(const Model& model, glm::vec3* bounds_min, glm::vec3* bounds_max) {
+    if (model.mesh.empty()) {
+        *bounds_min = glm::vec3(0.0f);
+        *bounds_max = glm::vec3(0.0f);
+        return;
+    }
+
+    *bounds_min = glm::vec3(std::numeric_limits<float>::max());
+    *bounds_max = glm::vec3(-std::numeric_limits<float>::max());
+    for (std::map<std::string, Mesh>::const_iterator it = model.mesh.begin(); it != model.mesh.end(); ++it) {
+        glm::vec3 center = it->second.offset + ((it->second.bounds_min + it->second.bounds_max) * 0.5f);
+        *bounds_min = glm::min(*bounds_min, center - glm::vec3(it->second.bounds_radius));
+        *bounds_max = glm::max(*bounds_max, center + glm::vec3(it->second.bounds_radius));
+    }
+}
+
+void model_mesh_upload(Mesh* mesh, const void* vertices, unsigned int vertex_count, const void* indices, unsigned int index_count, GLenum index_type) {
+    model_mesh_create(mesh, vertex_count, index_count, index_type);
+    mesh_buffer_upload_vertices(*mesh, 0, vertex_count * model_vertex_size(mesh->vertex_format), vertices);
+    mesh_buffer_upload_indices(*mesh, 0, index_count * model_index_size(index_type), indices);
+}
+
+void model_mesh_from_cache(Mesh* mesh, const MeshCacheMesh& cache_mesh) {
+    mesh->material = cache_mesh.material;
+    mesh->offset = cache_mesh.offset;
+    model_mesh_bounds(mesh, cache_mesh.bounds_min, cache_mesh.bounds_max);
+    mesh->vertex_format = cache_mesh.vertex_format;
+    mesh->position_scale = cache_mesh.position_scale;
+    mesh->lod = cache_mesh.lod;
+}
+
+Material model_material(const ObjMaterial& material_data) {
+    return (Material) {
+        .ka = material_data.ka,
+        .kd = material_data.kd,
+        .ks = material_data.ks,
+        .map_ka = 0,
+        .map_kd = 0
+    };
+}
+
+bool model_material_map_supported(const std::string& path) {
+    // TODO support non-png textures
+    return path.find(".png") != std::string::npos;
+}
+
+void model_material_load(Model* model, std::string name, const ObjMaterial& material_data) {
+    Material& material = model->material[name];
+    material = model_material(material_data);
+    if (model_material_map_supported(material_data.map_ka)) {
+        material.map_ka = asset_texture_load(material_data.map_ka);
+    }
+    if (model_material_map_supported(material_data.map_kd)) {
+        material.map_kd = asset_texture_load(material_data.map_kd);
+    }
+}
+
+bool model_load(Model* model, std::string path) {
+    // the cache holds the meshes exactly as the GPU wants them, so upload straight out of it
+    MeshCache cache;
+    if (!mesh_cache_load(&cache, path)) {
+        return false;
+    }
+    for (const MeshCacheMesh& cache_mesh : cache.mesh) {
+        Mesh& mesh = model->mesh[cache_mesh.name];
+        model_mesh_from_cache(&mesh, cache_mesh);
+        model_mesh_upload(&mesh, cache_mesh.vertices, cache_mesh.vertex_count, cache_mesh.indices, cache_mesh.index_count, cache_mesh.index_type);
+    }
+    for (std::map<std::string, ObjMaterial>::iterator it = cache.material.begin(); it != cache.material.end(); ++it) {
+        model_material_load(model, it->first, it->second);
+    }
+    mesh_cache_close(&cache);
 
     return true;
 }
 
 bool model_texture_load(GLuint* texture, std::string path) {
-    SDL_Surface* texture_surface = IMG_Load(path.c_str());
-    if (texture_surface == NULL) {
-        printf("Unable to load model texture at path %s: %s\n", path.c_str(), IMG_GetError());
+    TextureData texture_data;
+    if (!texture_data_load(&texture_data, path)) {
         return false;
     }
 
-    GLenum texture_format;
-    if (texture_surface->format->BytesPerPixel == 4) {
-        if (texture_surface->format->Rmask == 0x000000ff) {
-            texture_format = GL_RGBA;
-        } else {
-            texture_format = GL_BGRA;
-        }
-    } else if (texture_surface->format->BytesPerPixel == 3) {
-        if (texture_surface->format->Rmask == 0x000000ff) {
-            texture_format = GL_RGB;
-        } else {
-            texture_format = GL_BGR;
-        }
-    } else {
-        printf("Texture format of texture %s not recognized\n", path.c_str());
-        return false;
+    texture_create(texture, texture_data);
+    for (unsigned int level = 0; level < texture_data.level.size(); level++) {
+        texture_upload_rows(texture_data, level, 0, texture_level_row_count(texture_data, level), texture_data.level[level].data);
     }
+    texture_data_close(&texture_data);
 
-    glGenTextures(1, texture);
+    return true;
+}
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, *texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture_surface->w, texture_surface->h, 0, texture_format, GL_UNSIGNED_BYTE, texture_surface->pixels);
-    glBindTexture(GL_TEXTURE_2D, 0);
+ModelTransform::ModelTransform() {
+    skin = 0;
+}
 
-    SDL_FreeSurface(texture_surface);
+bool model_skins_load(ModelSkins* skins, std::string material, const std::vector<std::string>& paths) {
+    if (!texture_array_load(&skins->texture, paths)) {
+        printf("Unable to load skins for material %s\n", material.c_str());
+        return false;
+    }
+    skins->material = material;
+    skins->count = paths.size();
 
     return true;
-} 
-
-void model_render(Model& model, ModelTransform& transform) {
-    glUseProgram(shader);
+}
 
-    glm::mat4 base_model_matrix = transform.base.to_model();
-    for (std::map<std::string, Mesh>::iterator it = model.mesh.begin(); it != model.mesh.end(); ++it) {
-        glm::mat4 model_matrix = base_model_matrix * glm::translate(glm::mat4(1.0f), it->second.offset);
-        if (transform.mesh.count(it->first)) {
-            model_matrix = model_matrix * transform.mesh[it->first].to_model();
+// picks the coarsest level whose error is still too small to see from here
+static unsigned int model_mesh_lod(const Mesh& mesh, const glm::mat4& model_matrix) {
+    unsigned int lod = 0;
+    glm::vec3 mesh_position = glm::vec3(model_matrix[3]);
+    float mesh_scale = std::max(glm::length(glm::vec3(model_matrix[0])), std::max(glm::length(glm::vec3(model_matrix[1])), glm::length(glm::vec3(model_matrix[2]))));
+    float mesh_distance = std::max(glm::length(mesh_position - model_lod_camera_position), 0.0001f);
+    for (unsigned int coarser_lod = 1; coarser_lod < mesh.lod.size(); coarser_lod++) {
+        if (mesh.lod[coarser_lod].error * mesh_scale * model_lod_projection_scale / mesh_distance > MODEL_LOD_PIXEL_ERROR) {
+            break;
         }
+        lod = coarser_lod;
+    }
+
+    return lod;
+}
+
+static glm::mat4 model_mesh_matrix(const ModelTransform& transform, const glm::mat4& base_model_matrix, const std::string& name, const Mesh& mesh) {
+    glm::mat4 model_matrix = base_model_matrix * glm::translate(glm::mat4(1.0f), mesh.offset);
+    std::map<std::string, Transform>::const_iterator it = transform.mesh.find(name);
+    if (it != transform.mesh.end()) {
+        model_matrix = model_matrix * it->second.to_model();
+    }
 
-        glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, glm::value_ptr(model_matrix));
-        glUniform3fv(glGetUniformLocation(shader, "material.ka"), 1, glm::value_ptr(model.material[it->second.material].ka));
-        glUniform3fv(glGetUniformLocation(shader, "material.kd"), 1, glm::value_ptr(model.material[it->second.material].kd));
-        glUniform3fv(glGetUniformLocation(shader, "material.ks"), 1, glm::value_ptr(model.material[it->second.material].ks));
-        glActiveTexture(GL_TEXTURE0);
-        if (model.material[it->second.material].map_ka != 0) {
-            glBindTexture(GL_TEXTURE_2D, model.material[it->second.material].map_ka);
-        // if no ambient map, try using diffuse map
-        } else if (model.material[it->second.material].map_kd != 0) {
-            glBindTexture(GL_TEXTURE_2D, model.material[it->second.material].map_kd);
-        } else {
-            glBindTexture(GL_TEXTURE_2D, model_null_texture);
+    return model_matrix;
+}
+
+static RenderPacket model_mesh_packet(Model& model, const Mesh& mesh, unsigned int lod, const glm::mat4& model_matrix) {
+    const Material& material = model.material[mesh.material];
+
+    RenderPacket packet;
+    packet.pass = RENDER_PASS_OPAQUE;
+    packet.program = &shader;
+    packet.vao = mesh.vao;
+    // if no ambient map, try using diffuse map
+    packet.texture[0] = material.map_ka != 0 ? material.map_ka : (material.map_kd != 0 ? material.map_kd : model_null_texture);
+    packet.texture[1] = material.map_kd != 0 ? material.map_kd : model_null_texture;
+    packet.model = model_matrix;
+    packet.instance_count = 0;
+    packet.instance_first = 0;
+    packet.skin_texture = 0;
+    packet.position_scale = mesh.position_scale;
+    packet.skin = 0.0f;
+    packet.octahedral_normal = mesh.vertex_format == VERTEX_FORMAT_COMPACT;
+    packet.ka = material.ka;
+    packet.kd = material.kd;
+    packet.ks = material.ks;
+    packet.index_type = mesh.index_type;
+    packet.first = mesh.first_index + mesh.lod[lod].index_offset;
+    packet.count = mesh.lod[lod].index_count;
+    packet.base_vertex = mesh.base_vertex;
+    packet.condition_query = 0;
+
+    return packet;
+}
+
+void model_render_instanced(Model& model, const std::vector<ModelTransform>& transforms, const std::vector<unsigned int>& visible, const ModelSkins* skins) {
+    if (visible.empty()) {
+        return;
+    }
+
+    std::vector<glm::mat4> base_model_matrices;
+    for (unsigned int transform_index : visible) {
+        base_model_matrices.push_back(transforms[transform_index].base.to_model());
+    }
+
+    // instances are grouped by level of detail, so every mesh costs at most one draw per level
+    std::vector<std::vector<RenderInstance>> lod_instances;
+    model_instance_matrices.resize(visible.size());
+    for (std::map<std::string, Mesh>::iterator it = model.mesh.begin(); it != model.mesh.end(); ++it) {
+        // every instance's box goes in one array first so they can be culled together
+        cull_boxes_clear(&model_cull_boxes);
+        for (unsigned int i = 0; i < visible.size(); i++) {
+            model_instance_matrices[i] = model_mesh_matrix(transforms[visible[i]], base_model_matrices[i], it->first, it->second);
+            glm::vec3 world_min;
+            glm::vec3 world_max;
+            cull_box_transform(&world_min, &world_max, model_instance_matrices[i], it->second.bounds_min, it->second.bounds_max);
+            cull_boxes_add(&model_cull_boxes, world_min, world_max);
         }
-        glActiveTexture(GL_TEXTURE0 + 1);
-        if (model.material[it->second.material].map_kd != 0) {
-            glBindTexture(GL_TEXTURE_2D, model.material[it->second.material].map_kd);
-        } else {
-            glBindTexture(GL_TEXTURE_2D, model_null_texture);
+        cull_visible_boxes(model_cull_boxes, &model_visible_instances);
+
+        lod_instances.assign(it->second.lod.size(), std::vector<RenderInstance>());
+        std::vector<glm::mat4> nearest_matrix(it->second.lod.size());
+        std::vector<float> nearest_distance(it->second.lod.size(), 0.0f);
+        for (unsigned int i : model_visible_instances) {
+            const glm::mat4& model_matrix = model_instance_matrices[i];
+            unsigned int lod = model_mesh_lod(it->second, model_matrix);
+            float distance = glm::length(glm::vec3(model_matrix[3]) - model_lod_camera_position);
+            if (lod_instances[lod].empty() || distance < nearest_distance[lod]) {
+                nearest_matrix[lod] = model_matrix;
+                nearest_distance[lod] = distance;
+            }
+            lod_instances[lod].push_back((RenderInstance) {
+                .model = model_matrix,
+                .position_scale = glm::vec4(it->second.position_scale, (float)transforms[visible[i]].skin)
+            });
         }
-        glUniform1i(glGetUniformLocation(shader, "material.map_ka"), 0);
-        glUniform1i(glGetUniformLocation(shader, "material.map_kd"), 1);
 
-        glBindVertexArray(it->second.vao);
-        glDrawArrays(GL_TRIANGLES, 0, it->second.vertex_data_size);
+        for (unsigned int lod = 0; lod < lod_instances.size(); lod++) {
+            if (lod_instances[lod].empty()) {
+                continue;
+            }
+            // the nearest instance stands in for the group when sorting
+            RenderPacket packet = model_mesh_packet(model, it->second, lod, nearest_matrix[lod]);
+            if (skins != NULL && skins->material == it->second.material) {
+                packet.skin_texture = skins->texture;
+            }
+            packet.instance_count = lod_instances[lod].size();
+            packet.instance_first = render_queue_instances(&lod_instances[lod][0], lod_instances[lod].size());
+            render_queue_submit(packet);
+        }
     }
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE0 + 1);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindVertexArray(0);
 }
\ No newline at end of file
@@ -1,12 +1,16 @@
 #pragma once
 
 #include "transform.hpp"
+#include "obj.hpp"
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <string>
+#include <vector>
 #include <map>
 
+struct MeshCacheMesh;
+
 struct Material {
     glm::vec3 ka;
     glm::vec3 kd;
@@ -15,12 +19,41 @@ struct Material {
     GLuint map_kd;
 };
 
+enum VertexFormat {
+    VERTEX_FORMAT_FLOAT,
+    // 16 bit positions scaled by the mesh bounds, octahedral encoded 16 bit normals and half float texture coordinates
+    VERTEX_FORMAT_COMPACT,
+    VERTEX_FORMAT_COUNT
+};
+
+// a range of the index buffer, coarser levels come later in the buffer
+struct MeshLod {
+    unsigned int index_offset;
+    unsigned int index_count;
+    // how far the surface may have moved from the full mesh, in model units.
+    // the sum of the simplification error of every level up to this one, see mesh_simplify
+    float error;
+};
+
 struct Mesh {
+    // shared by every mesh of the same vertex format, see mesh_buffer.hpp
     GLuint vao;
-    GLuint vbo;
+    // where the mesh starts in the shared buffers, first_index is in units of index_type
+    unsigned int base_vertex;
+    unsigned int first_index;
     unsigned int vertex_data_size;
+    unsigned int index_count;
+    GLenum index_type;
+    VertexFormat vertex_format;
+    // compact positions are stored in -1..1 and multiplied by this in the vertex shader
+    glm::vec3 position_scale;
     std::string material;
     glm::vec3 offset;
+    // relative to offset, used for culling. bounds_radius is the radius of the sphere around the box
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    float bounds_radius;
+    std::vector<MeshLod> lod;
 };
 
 struct Model {
@@ -28,14 +61,84 @@ struct Model {
     std::map<std::string, Material> material;
 };
 
+// CPU side mesh data, produced by importing a model and uploaded by model_load
+struct VertexData {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texture_coordinates;
+};
+
+struct CompactVertexData {
+    GLshort position[4];
+    GLshort normal[2];
+    GLhalf texture_coordinates[2];
+};
+
+struct MeshData {
+    std::vector<VertexData> vertices;
+    // every level of detail back to back, described by lod
+    std::vector<unsigned int> indices;
+    std::vector<MeshLod> lod;
+    std::string material;
+    glm::vec3 offset;
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+};
+
+struct ModelData {
+    std::map<std::string, MeshData> mesh;
+    // texture paths are relative to the working directory rather than to the mtl file
+    std::map<std::string, ObjMaterial> material;
+    std::string mtl_path;
+};
+
 struct ModelTransform {
     Transform base;
     std::map<std::string, Transform> mesh;
+    // layer of the ModelSkins the model is drawn with
+    unsigned int skin;
+
+    ModelTransform();
+};
+
+// Variants of one material's texture, like team colors, packed into the layers of a texture array.
+// Drawing with them replaces the material's maps with the layer each transform picks,
+// so variants of the same model still share instanced draws.
+struct ModelSkins {
+    std::string material;
+    GLuint texture;
+    unsigned int count;
 };
 
 extern GLuint model_null_texture;
+// format used for meshes loaded from now on
+extern VertexFormat model_vertex_format;
+// set every frame before rendering, used to pick a level of detail for each mesh
+extern glm::vec3 model_lod_camera_position;
+// screen height in pixels divided by 2 * tan(fov / 2), turns an error at distance 1 into pixels
+extern float model_lod_projection_scale;
 
 bool model_init();
+bool model_import(ModelData* model_data, std::string path);
 bool model_load(Model* model, std::string paths);
+unsigned int model_vertex_size(VertexFormat vertex_format);
+glm::vec3 model_position_scale(const MeshData& mesh_data);
+void model_vertices_compact(std::vector<CompactVertexData>* compact_vertices, const std::vector<VertexData>& vertices, glm::vec3 position_scale);
+unsigned int model_index_size(GLenum index_type);
+// reserves room for the mesh in the shared mesh buffers with uninitialized contents, for uploading in pieces
+void model_mesh_create(Mesh* mesh, unsigned int vertex_count, unsigned int index_count, GLenum index_type);
+void model_mesh_bounds(Mesh* mesh, glm::vec3 bounds_min, glm::vec3 bounds_max);
+// a local box around every mesh however its mesh transform turns it about its center, zero sized while the model streams in
+void model_bounds(const Model& model, glm::vec3* bounds_min, glm::vec3* bounds_max);
+void model_mesh_upload(Mesh* mesh, const void* vertices, unsigned int vertex_count, const void* indices, unsigned int index_count, GLenum index_type);
+// fills in everything but the buffers, which are still to be allocated and uploaded
+void model_mesh_from_cache(Mesh* mesh, const MeshCacheMesh& cache_mesh);
+// the material without its maps, which are loaded from the paths that pass model_material_map_supported
+Material model_material(const ObjMaterial& material_data);
+bool model_material_map_supported(const std::string& path);
+void model_material_load(Model* model, std::string name, const ObjMaterial& material_data);
 bool model_texture_load(GLuint* texture, std::string path);
-void model_render(Model& model, ModelTransform& transform);
\ No newline at end of file
+// the images must all be the same size, layer i is paths[i]
+bool model_skins_load(ModelSkins* skins, std::string material, const std::vector<std::string>& paths);
+// submits one instanced packet per mesh and level of detail, covering the transforms listed in visible that pass cull_visible_boxes. skins may be NULL
+void model_render_instanced(Model& model, const std::vector<ModelTransform>& transforms, const std::vector<unsigned int>& visible, const ModelSkins* skins);
\ No newline at end of file
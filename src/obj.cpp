@@ -0,0 +1,549 @@
+#include "obj.hpp"
+
+#include "mapped_file.hpp"
+#include "worker.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+
+// A word inside of the mapped file. Tokens point straight into the file data so no strings are allocated while parsing
+struct Token {
+    const char* begin;
+    const char* end;
+};
+
+static const float POWERS_OF_TEN[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static Token next_token(const char** cursor, const char* end) {
+    while (*cursor != end && is_space(**cursor)) {
+        (*cursor)++;
+    }
+    Token token;
+    token.begin = *cursor;
+    while (*cursor != end && !is_space(**cursor)) {
+        (*cursor)++;
+    }
+    token.end = *cursor;
+
+    return token;
+}
+
+// returns everything left on the line, with surrounding whitespace removed
+static Token rest_of_line(const char* cursor, const char* end) {
+    while (cursor != end && is_space(*cursor)) {
+        cursor++;
+    }
+    while (end != cursor && is_space(*(end - 1))) {
+        end--;
+    }
+
+    return (Token) { .begin = cursor, .end = end };
+}
+
+static bool token_equals(Token token, const char* word) {
+    std::size_t length = std::strlen(word);
+    return (std::size_t)(token.end - token.begin) == length && std::memcmp(token.begin, word, length) == 0;
+}
+
+static std::string token_to_string(Token token) {
+    return std::string(token.begin, token.end - token.begin);
+}
+
+static bool parse_float(Token token, float* value) {
+    const char* cursor = token.begin;
+    bool negative = false;
+    if (cursor != token.end && (*cursor == '-' || *cursor == '+')) {
+        negative = *cursor == '-';
+        cursor++;
+    }
+
+    // accumulate the significant digits into an integer, tracking the decimal exponent separately
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digit_count = 0;
+    bool has_digits = false;
+    bool truncated = false;
+    while (cursor != token.end && is_digit(*cursor)) {
+        if (digit_count < 19) {
+            mantissa = (mantissa * 10) + (*cursor - '0');
+            if (mantissa != 0) {
+                digit_count++;
+            }
+        } else {
+            exponent++;
+            truncated = true;
+        }
+        has_digits = true;
+        cursor++;
+    }
+    if (cursor != token.end && *cursor == '.') {
+        cursor++;
+        while (cursor != token.end && is_digit(*cursor)) {
+            if (digit_count < 19) {
+                mantissa = (mantissa * 10) + (*cursor - '0');
+                if (mantissa != 0) {
+                    digit_count++;
+                }
+                exponent--;
+            } else {
+                truncated = true;
+            }
+            has_digits = true;
+            cursor++;
+        }
+    }
+    if (has_digits && cursor != token.end && (*cursor == 'e' || *cursor == 'E')) {
+        cursor++;
+        bool exponent_negative = false;
+        if (cursor != token.end && (*cursor == '-' || *cursor == '+')) {
+            exponent_negative = *cursor == '-';
+            cursor++;
+        }
+        if (cursor == token.end || !is_digit(*cursor)) {
+            return false;
+        }
+        int explicit_exponent = 0;
+        while (cursor != token.end && is_digit(*cursor)) {
+            if (explicit_exponent < 10000) {
+                explicit_exponent = (explicit_exponent * 10) + (*cursor - '0');
+            }
+            cursor++;
+        }
+        exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+    }
+
+    // fast path: both the mantissa and the power of ten are exact floats, so a single float multiply or divide rounds correctly.
+    // going through double instead would round twice
+    if (has_digits && cursor == token.end && !truncated && mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10) {
+        float result = (float)mantissa;
+        if (exponent < 0) {
+            result /= POWERS_OF_TEN[-exponent];
+        } else {
+            result *= POWERS_OF_TEN[exponent];
+        }
+        *value = negative ? -result : result;
+        return true;
+    }
+
+    // slow path for anything unusual (long mantissas, huge exponents, inf / nan), copied to the stack so strtof has a terminator
+    char buffer[64];
+    std::size_t length = token.end - token.begin;
+    if (length == 0 || length >= sizeof(buffer)) {
+        return false;
+    }
+    std::memcpy(buffer, token.begin, length);
+    buffer[length] = '\0';
+    char* parse_end;
+    *value = std::strtof(buffer, &parse_end);
+
+    return parse_end == buffer + length;
+}
+
+static bool parse_int(const char** cursor, const char* end, int* value) {
+    bool negative = false;
+    if (*cursor != end && (**cursor == '-' || **cursor == '+')) {
+        negative = **cursor == '-';
+        (*cursor)++;
+    }
+    if (*cursor == end || !is_digit(**cursor)) {
+        return false;
+    }
+    int result = 0;
+    while (*cursor != end && is_digit(**cursor)) {
+        int digit = **cursor - '0';
+        if (result > (INT_MAX - digit) / 10) {
+            return false;
+        }
+        result = (result * 10) + digit;
+        (*cursor)++;
+    }
+    *value = negative ? -result : result;
+
+    return true;
+}
+
+static bool parse_floats(const char** cursor, const char* end, float* values, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        if (!parse_float(next_token(cursor, end), &values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A newline aligned slice of the file which is parsed by a single worker
+struct ObjChunk {
+    const char* begin;
+    const char* end;
+
+    // how many of each vertex attribute the chunk declares, and how many were declared before it
+    unsigned int position_count;
+    unsigned int texture_coordinate_count;
+    unsigned int normal_count;
+    unsigned int position_offset;
+    unsigned int texture_coordinate_offset;
+    unsigned int normal_offset;
+
+    // faces grouped by the o / usemtl statements that precede them.
+    // the first segment continues whichever object the previous chunk ended in
+    struct Segment {
+        bool sets_object;
+        std::string object_name;
+        bool sets_material;
+        std::string material;
+        std::vector<ObjFace> faces;
+    };
+    std::vector<Segment> segments;
+    std::string mtllib;
+
+    // the line which failed to parse, or NULL
+    const char* error;
+};
+
+// chunks smaller than this aren't worth handing to another thread
+static const std::size_t OBJ_MIN_CHUNK_SIZE = 256 * 1024;
+// split the file a few times more than there are threads so that uneven chunks balance out
+static const unsigned int OBJ_CHUNKS_PER_THREAD = 4;
+
+// converts an OBJ index, which starts at 1 or is negative to count back from the current end, into a zero-based index
+// a missing index (0) becomes -1, and the result must be less than total
+static bool resolve_index(int index, unsigned int count, unsigned int total, int* resolved) {
+    if (index > 0) {
+        *resolved = index - 1;
+    } else if (index < 0) {
+        *resolved = (int)count + index;
+        if (*resolved < 0) {
+            return false;
+        }
+    } else {
+        *resolved = -1;
+    }
+
+    return *resolved < (int)total;
+}
+
+// parses a face corner in the form v, v/vt, v//vn or v/vt/vn
+static bool parse_face_corner(Token token, const unsigned int counts[3], const unsigned int totals[3], int* position_index, int* texture_coordinate_index, int* normal_index) {
+    const char* cursor = token.begin;
+    int index;
+
+    if (!parse_int(&cursor, token.end, &index) || index == 0 || !resolve_index(index, counts[0], totals[0], position_index)) {
+        return false;
+    }
+    *texture_coordinate_index = -1;
+    *normal_index = -1;
+
+    if (cursor == token.end) {
+        return true;
+    } else if (*cursor != '/') {
+        return false;
+    }
+    cursor++;
+    if (cursor != token.end && *cursor != '/') {
+        if (!parse_int(&cursor, token.end, &index) || !resolve_index(index, counts[1], totals[1], texture_coordinate_index)) {
+            return false;
+        }
+    }
+
+    if (cursor == token.end) {
+        return true;
+    } else if (*cursor != '/') {
+        return false;
+    }
+    cursor++;
+    if (!parse_int(&cursor, token.end, &index) || !resolve_index(index, counts[2], totals[2], normal_index)) {
+        return false;
+    }
+
+    return cursor == token.end;
+}
+
+static unsigned int line_number_at(const MappedFile& file, const char* position) {
+    unsigned int line_number = 1;
+    for (const char* cursor = file.data; cursor != position; cursor++) {
+        if (*cursor == '\n') {
+            line_number++;
+        }
+    }
+    return line_number;
+}
+
+// first pass: count the vertex attributes so that every chunk knows where its vertices land in the final arrays
+static void obj_chunk_count(ObjChunk* chunk) {
+    chunk->position_count = 0;
+    chunk->texture_coordinate_count = 0;
+    chunk->normal_count = 0;
+
+    const char* line_begin = chunk->begin;
+    while (line_begin < chunk->end) {
+        const char* line_end = (const char*)std::memchr(line_begin, '\n', chunk->end - line_begin);
+        if (line_end == NULL) {
+            line_end = chunk->end;
+        }
+
+        const char* cursor = line_begin;
+        while (cursor != line_end && is_space(*cursor)) {
+            cursor++;
+        }
+        if (line_end - cursor >= 2 && cursor[0] == 'v') {
+            if (is_space(cursor[1])) {
+                chunk->position_count++;
+            } else if (line_end - cursor >= 3 && is_space(cursor[2])) {
+                if (cursor[1] == 't') {
+                    chunk->texture_coordinate_count++;
+                } else if (cursor[1] == 'n') {
+                    chunk->normal_count++;
+                }
+            }
+        }
+
+        line_begin = line_end + 1;
+    }
+}
+
+// second pass: parse vertex attributes straight into their final place and collect faces into segments
+static void obj_chunk_parse(ObjChunk* chunk, ObjData* obj) {
+    unsigned int counts[3] = { chunk->position_offset, chunk->texture_coordinate_offset, chunk->normal_offset };
+    const unsigned int totals[3] = { (unsigned int)obj->positions.size(), (unsigned int)obj->texture_coordinates.size(), (unsigned int)obj->normals.size() };
+
+    chunk->segments.push_back(ObjChunk::Segment());
+    chunk->segments.back().sets_object = false;
+    chunk->segments.back().sets_material = false;
+    chunk->error = NULL;
+
+    const char* line_begin = chunk->begin;
+    while (line_begin < chunk->end) {
+        const char* line_end = (const char*)std::memchr(line_begin, '\n', chunk->end - line_begin);
+        if (line_end == NULL) {
+            line_end = chunk->end;
+        }
+
+        const char* cursor = line_begin;
+        Token keyword = next_token(&cursor, line_end);
+        bool success = true;
+
+        // ignore comments and empty lines
+        if (keyword.begin == keyword.end || *keyword.begin == '#') {
+        } else if (token_equals(keyword, "v")) {
+            success = parse_floats(&cursor, line_end, &obj->positions[counts[0]][0], 3);
+            counts[0]++;
+        } else if (token_equals(keyword, "vt")) {
+            success = parse_floats(&cursor, line_end, &obj->texture_coordinates[counts[1]][0], 2);
+            counts[1]++;
+        } else if (token_equals(keyword, "vn")) {
+            success = parse_floats(&cursor, line_end, &obj->normals[counts[2]][0], 3);
+            counts[2]++;
+        } else if (token_equals(keyword, "f")) {
+            std::vector<ObjFace>& faces = chunk->segments.back().faces;
+
+            // triangulate the polygon as a fan around its first corner
+            ObjFace face;
+            unsigned int corner_count = 0;
+            Token corner = next_token(&cursor, line_end);
+            while (corner.begin != corner.end) {
+                unsigned int i = corner_count < 2 ? corner_count : 2;
+                if (!parse_face_corner(corner, counts, totals, &face.position_indices[i], &face.texture_coordinate_indices[i], &face.normal_indices[i])) {
+                    success = false;
+                    break;
+                }
+                corner_count++;
+                if (corner_count >= 3) {
+                    faces.push_back(face);
+                    face.position_indices[1] = face.position_indices[2];
+                    face.texture_coordinate_indices[1] = face.texture_coordinate_indices[2];
+                    face.normal_indices[1] = face.normal_indices[2];
+                }
+                corner = next_token(&cursor, line_end);
+            }
+            if (corner_count < 3) {
+                success = false;
+            }
+        } else if (token_equals(keyword, "o") || token_equals(keyword, "usemtl")) {
+            ObjChunk::Segment segment;
+            segment.sets_object = token_equals(keyword, "o");
+            segment.sets_material = !segment.sets_object;
+            if (segment.sets_object) {
+                segment.object_name = token_to_string(rest_of_line(cursor, line_end));
+            } else {
+                segment.material = token_to_string(rest_of_line(cursor, line_end));
+            }
+            chunk->segments.push_back(segment);
+        } else if (token_equals(keyword, "mtllib")) {
+            chunk->mtllib = token_to_string(rest_of_line(cursor, line_end));
+        }
+
+        if (!success) {
+            chunk->error = line_begin;
+            return;
+        }
+
+        line_begin = line_end + 1;
+    }
+}
+
+bool obj_load(ObjData* obj, std::string path) {
+    MappedFile file;
+    if (!mapped_file_open(&file, path)) {
+        printf("Unable to open model %s\n", path.c_str());
+        return false;
+    }
+    const char* file_end = file.data + file.size;
+
+    // split the file into chunks that each end on a newline
+    unsigned int chunk_count = worker_thread_count() * OBJ_CHUNKS_PER_THREAD;
+    if (file.size / OBJ_MIN_CHUNK_SIZE < chunk_count) {
+        chunk_count = std::max((unsigned int)(file.size / OBJ_MIN_CHUNK_SIZE), 1u);
+    }
+    std::vector<ObjChunk> chunks;
+    const char* chunk_begin = file.data;
+    for (unsigned int i = 0; i < chunk_count && chunk_begin < file_end; i++) {
+        const char* chunk_end = file_end;
+        if (i != chunk_count - 1) {
+            std::size_t target = (file.size * (i + 1)) / chunk_count;
+            const char* newline = target > (std::size_t)(chunk_begin - file.data) ? (const char*)std::memchr(file.data + target, '\n', file_end - (file.data + target)) : NULL;
+            if (newline != NULL) {
+                chunk_end = newline + 1;
+            }
+        }
+
+        ObjChunk chunk;
+        chunk.begin = chunk_begin;
+        chunk.end = chunk_end;
+        chunks.push_back(chunk);
+        chunk_begin = chunk_end;
+    }
+
+    worker_parallel_for(chunks.size(), [&chunks](unsigned int i) {
+        obj_chunk_count(&chunks[i]);
+    });
+
+    unsigned int position_count = 0;
+    unsigned int texture_coordinate_count = 0;
+    unsigned int normal_count = 0;
+    for (ObjChunk& chunk : chunks) {
+        chunk.position_offset = position_count;
+        chunk.texture_coordinate_offset = texture_coordinate_count;
+        chunk.normal_offset = normal_count;
+        position_count += chunk.position_count;
+        texture_coordinate_count += chunk.texture_coordinate_count;
+        normal_count += chunk.normal_count;
+    }
+    obj->positions.resize(position_count);
+    obj->texture_coordinates.resize(texture_coordinate_count);
+    obj->normals.resize(normal_count);
+
+    worker_parallel_for(chunks.size(), [&chunks, obj](unsigned int i) {
+        obj_chunk_parse(&chunks[i], obj);
+    });
+
+    for (const ObjChunk& chunk : chunks) {
+        if (chunk.error != NULL) {
+            printf("Error parsing model %s on line %u\n", path.c_str(), line_number_at(file, chunk.error));
+            mapped_file_close(&file);
+            return false;
+        }
+    }
+    mapped_file_close(&file);
+
+    // stitch the segments back together in file order
+    std::string current_object_name = "";
+    ObjObject* current_object = NULL;
+    for (ObjChunk& chunk : chunks) {
+        if (chunk.mtllib != "") {
+            obj->mtllib = chunk.mtllib;
+        }
+        for (ObjChunk::Segment& segment : chunk.segments) {
+            if (segment.sets_object) {
+                current_object_name = segment.object_name;
+                current_object = &obj->objects[current_object_name];
+            }
+            if (segment.sets_material || !segment.faces.empty()) {
+                if (current_object == NULL) {
+                    current_object = &obj->objects[current_object_name];
+                }
+            }
+            if (segment.sets_material) {
+                current_object->material = segment.material;
+            }
+            if (!segment.faces.empty()) {
+                if (current_object->faces.empty()) {
+                    current_object->faces.swap(segment.faces);
+                } else {
+                    current_object->faces.insert(current_object->faces.end(), segment.faces.begin(), segment.faces.end());
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool obj_load_mtl(std::map<std::string, ObjMaterial>* materials, std::string path) {
+    MappedFile file;
+    if (!mapped_file_open(&file, path)) {
+        printf("Unable to open material lib %s\n", path.c_str());
+        return false;
+    }
+
+    ObjMaterial* current_material = NULL;
+
+    const char* file_end = file.data + file.size;
+    const char* line_begin = file.data;
+    while (line_begin < file_end) {
+        const char* line_end = (const char*)std::memchr(line_begin, '\n', file_end - line_begin);
+        if (line_end == NULL) {
+            line_end = file_end;
+        }
+
+        const char* cursor = line_begin;
+        Token keyword = next_token(&cursor, line_end);
+        bool success = true;
+
+        // ignore comments, empty lines and any properties that appear before the first material
+        if (keyword.begin == keyword.end || *keyword.begin == '#') {
+        } else if (token_equals(keyword, "newmtl")) {
+            current_material = &(*materials)[token_to_string(rest_of_line(cursor, line_end))];
+            current_material->ka = glm::vec3(0.2f);
+            current_material->kd = glm::vec3(0.8f);
+            current_material->ks = glm::vec3(1.0f);
+            current_material->map_ka = "";
+            current_material->map_kd = "";
+        } else if (current_material == NULL) {
+        } else if (token_equals(keyword, "Ka")) {
+            success = parse_floats(&cursor, line_end, &current_material->ka[0], 3);
+        } else if (token_equals(keyword, "Kd")) {
+            success = parse_floats(&cursor, line_end, &current_material->kd[0], 3);
+        } else if (token_equals(keyword, "Ks")) {
+            success = parse_floats(&cursor, line_end, &current_material->ks[0], 3);
+        } else if (token_equals(keyword, "map_Ka")) {
+            current_material->map_ka = token_to_string(rest_of_line(cursor, line_end));
+        } else if (token_equals(keyword, "map_Kd")) {
+            current_material->map_kd = token_to_string(rest_of_line(cursor, line_end));
+        }
+
+        if (!success) {
+            printf("Error parsing material lib %s on line %u\n", path.c_str(), line_number_at(file, line_begin));
+            mapped_file_close(&file);
+            return false;
+        }
+
+        line_begin = line_end + 1;
+    }
+    mapped_file_close(&file);
+
+    return true;
+}
\ No newline at end of file
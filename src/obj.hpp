@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <map>
+
+// Raw OBJ / MTL data, parsed on the CPU without touching OpenGL
+
+struct ObjFace {
+    // zero-based indices, -1 if the face corner does not reference that attribute
+    int position_indices[3];
+    int texture_coordinate_indices[3];
+    int normal_indices[3];
+};
+
+struct ObjObject {
+    std::string material;
+    std::vector<ObjFace> faces;
+};
+
+struct ObjData {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texture_coordinates;
+    std::vector<glm::vec3> normals;
+    std::map<std::string, ObjObject> objects;
+    std::string mtllib;
+};
+
+struct ObjMaterial {
+    glm::vec3 ka;
+    glm::vec3 kd;
+    glm::vec3 ks;
+    std::string map_ka;
+    std::string map_kd;
+};
+
+bool obj_load(ObjData* obj, std::string path);
+bool obj_load_mtl(std::map<std::string, ObjMaterial>* materials, std::string path);
\ No newline at end of file
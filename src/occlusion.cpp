@@ -0,0 +1,359 @@
+#include "occlusion.hpp"
+
+#include "worker.hpp"
+#include "cull.hpp"
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+
+struct OcclusionVertex {
+    float x;
+    float y;
+    float depth;
+    // behind or too close to the camera to project, any triangle using it is skipped
+    bool clipped;
+};
+
+struct OcclusionTriangle {
+    // edge functions a * x + b * y + c, which are positive inside the triangle
+    float edge_a[3];
+    float edge_b[3];
+    float edge_c[3];
+    // 1 / w as a plane over the screen
+    float depth_x;
+    float depth_y;
+    float depth_c;
+    // inclusive pixel bounds. min_y is past max_y for skipped triangles
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+};
+
+struct OcclusionOccluder {
+    unsigned int first_vertex;
+    unsigned int vertex_count;
+    unsigned int first_index;
+    unsigned int index_count;
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+};
+
+// occluders whose w gets this close to 0 would need clipping, so they're skipped instead, which can only make them occlude less
+const float OCCLUSION_NEAR_W = 0.01f;
+// occluders per job when transforming and setting up triangles
+const unsigned int OCCLUSION_CHUNK_SIZE = 256;
+const unsigned int OCCLUSION_BLOCK_COLUMNS = (OCCLUSION_WIDTH + OCCLUSION_BLOCK_SIZE - 1) / OCCLUSION_BLOCK_SIZE;
+const unsigned int OCCLUSION_BLOCK_ROWS = (OCCLUSION_HEIGHT + OCCLUSION_BLOCK_SIZE - 1) / OCCLUSION_BLOCK_SIZE;
+
+bool occlusion_enabled = true;
+std::vector<glm::vec3> occlusion_occluder_vertices;
+std::vector<unsigned int> occlusion_occluder_indices;
+std::vector<OcclusionOccluder> occlusion_occluders;
+// occluders inside the frustum this frame, and where each one's triangles start
+std::vector<unsigned int> occlusion_visible_occluders;
+std::vector<unsigned int> occlusion_triangle_offsets;
+std::vector<OcclusionVertex> occlusion_vertices;
+std::vector<OcclusionTriangle> occlusion_triangles;
+// triangles touching each row of blocks
+std::vector<unsigned int> occlusion_band_triangles[OCCLUSION_BLOCK_ROWS];
+glm::mat4 occlusion_projection_view;
+float occlusion_depth[OCCLUSION_WIDTH * OCCLUSION_HEIGHT];
+// farthest depth of every block
+float occlusion_block_depth[OCCLUSION_BLOCK_COLUMNS * OCCLUSION_BLOCK_ROWS];
+OcclusionStats occlusion_current_stats;
+
+void occlusion_add_occluder(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices) {
+    OcclusionOccluder occluder;
+    occluder.first_vertex = occlusion_occluder_vertices.size();
+    occluder.vertex_count = vertices.size();
+    occluder.first_index = occlusion_occluder_indices.size();
+    occluder.index_count = indices.size();
+    occluder.bounds_min = vertices[0];
+    occluder.bounds_max = vertices[0];
+    for (glm::vec3 vertex : vertices) {
+        occluder.bounds_min = glm::min(occluder.bounds_min, vertex);
+        occluder.bounds_max = glm::max(occluder.bounds_max, vertex);
+    }
+    occlusion_occluders.push_back(occluder);
+    occlusion_occluder_vertices.insert(occlusion_occluder_vertices.end(), vertices.begin(), vertices.end());
+    for (unsigned int index : indices) {
+        occlusion_occluder_indices.push_back(occluder.first_vertex + index);
+    }
+}
+
+void occlusion_add_box(const glm::mat4& transform, glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    std::vector<glm::vec3> vertices;
+    for (unsigned int corner = 0; corner < 8; corner++) {
+        glm::vec3 position = glm::vec3(corner & 1 ? bounds_max.x : bounds_min.x, corner & 2 ? bounds_max.y : bounds_min.y, corner & 4 ? bounds_max.z : bounds_min.z);
+        vertices.push_back(glm::vec3(transform * glm::vec4(position, 1.0f)));
+    }
+    // two triangles per face, winding doesn't matter since both sides are drawn
+    std::vector<unsigned int> indices = {
+        0, 1, 3, 0, 3, 2,
+        4, 6, 7, 4, 7, 5,
+        0, 4, 5, 0, 5, 1,
+        2, 3, 7, 2, 7, 6,
+        0, 2, 6, 0, 6, 4,
+        1, 5, 7, 1, 7, 3
+    };
+    occlusion_add_occluder(vertices, indices);
+}
+
+void occlusion_clear_occluders() {
+    occlusion_occluder_vertices.clear();
+    occlusion_occluder_indices.clear();
+    occlusion_occluders.clear();
+}
+
+static OcclusionVertex occlusion_project(glm::vec3 position) {
+    glm::vec4 clip = occlusion_projection_view * glm::vec4(position, 1.0f);
+    if (clip.w < OCCLUSION_NEAR_W) {
+        return (OcclusionVertex) { .x = 0.0f, .y = 0.0f, .depth = 0.0f, .clipped = true };
+    }
+
+    float depth = 1.0f / clip.w;
+    return (OcclusionVertex) {
+        .x = ((clip.x * depth * 0.5f) + 0.5f) * (float)OCCLUSION_WIDTH,
+        .y = ((clip.y * depth * 0.5f) + 0.5f) * (float)OCCLUSION_HEIGHT,
+        .depth = depth,
+        .clipped = false
+    };
+}
+
+static void occlusion_setup_triangle(OcclusionTriangle* triangle, const OcclusionVertex& v0, const OcclusionVertex& v1, const OcclusionVertex& v2) {
+    triangle->min_y = 1;
+    triangle->max_y = 0;
+    if (v0.clipped || v1.clipped || v2.clipped) {
+        return;
+    }
+
+    int min_x = std::max((int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))), 0);
+    int min_y = std::max((int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))), 0);
+    int max_x = std::min((int)std::floor(std::max(v0.x, std::max(v1.x, v2.x))), (int)OCCLUSION_WIDTH - 1);
+    int max_y = std::min((int)std::floor(std::max(v0.y, std::max(v1.y, v2.y))), (int)OCCLUSION_HEIGHT - 1);
+    float area = ((v1.x - v0.x) * (v2.y - v0.y)) - ((v2.x - v0.x) * (v1.y - v0.y));
+    if (min_x > max_x || min_y > max_y || area == 0.0f) {
+        return;
+    }
+
+    // swapping two vertices of clockwise triangles makes every edge function positive inside
+    const OcclusionVertex* vertices[3] = { &v0, &v1, &v2 };
+    if (area < 0.0f) {
+        std::swap(vertices[1], vertices[2]);
+        area = -area;
+    }
+    for (unsigned int edge = 0; edge < 3; edge++) {
+        const OcclusionVertex& a = *vertices[edge];
+        const OcclusionVertex& b = *vertices[(edge + 1) % 3];
+        triangle->edge_a[edge] = a.y - b.y;
+        triangle->edge_b[edge] = b.x - a.x;
+        triangle->edge_c[edge] = -((triangle->edge_a[edge] * a.x) + (triangle->edge_b[edge] * a.y));
+    }
+    // each vertex is weighted by the edge facing it
+    triangle->depth_x = ((triangle->edge_a[1] * vertices[0]->depth) + (triangle->edge_a[2] * vertices[1]->depth) + (triangle->edge_a[0] * vertices[2]->depth)) / area;
+    triangle->depth_y = ((triangle->edge_b[1] * vertices[0]->depth) + (triangle->edge_b[2] * vertices[1]->depth) + (triangle->edge_b[0] * vertices[2]->depth)) / area;
+    triangle->depth_c = ((triangle->edge_c[1] * vertices[0]->depth) + (triangle->edge_c[2] * vertices[1]->depth) + (triangle->edge_c[0] * vertices[2]->depth)) / area;
+    triangle->min_x = min_x;
+    triangle->min_y = min_y;
+    triangle->max_x = max_x;
+    triangle->max_y = max_y;
+}
+
+// draws the part of the triangle in rows [band_min_y, band_max_y], keeping the nearest depth of every covered pixel center
+static void occlusion_rasterize(const OcclusionTriangle& triangle, int band_min_y, int band_max_y) {
+    int min_y = std::max(triangle.min_y, band_min_y);
+    int max_y = std::min(triangle.max_y, band_max_y);
+    for (int y = min_y; y <= max_y; y++) {
+        float center_y = (float)y + 0.5f;
+        float* row = &occlusion_depth[y * OCCLUSION_WIDTH];
+        // narrow the row down to where each edge is positive, give or take a pixel, so big triangles don't walk their whole bounding box
+        float span_min = (float)triangle.min_x;
+        float span_max = (float)triangle.max_x;
+        for (unsigned int edge = 0; edge < 3; edge++) {
+            float edge_row = (triangle.edge_b[edge] * center_y) + triangle.edge_c[edge];
+            if (triangle.edge_a[edge] > 0.0f) {
+                span_min = std::max(span_min, (-edge_row / triangle.edge_a[edge]) - 1.5f);
+            } else if (triangle.edge_a[edge] < 0.0f) {
+                span_max = std::min(span_max, (-edge_row / triangle.edge_a[edge]) + 0.5f);
+            } else if (edge_row < 0.0f) {
+                span_max = -1.0f;
+            }
+        }
+        if (span_min > span_max) {
+            continue;
+        }
+        // rows are a multiple of 4 wide, so starting on a multiple of 4 keeps every group of 4 pixels inside the row
+        int min_x = (int)span_min & ~3;
+        int max_x = (int)span_max;
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        glm_vec4 zero = _mm_setzero_ps();
+        glm_vec4 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        glm_vec4 edge_row[3];
+        glm_vec4 edge_a[3];
+        for (unsigned int edge = 0; edge < 3; edge++) {
+            edge_row[edge] = _mm_set1_ps((triangle.edge_b[edge] * center_y) + triangle.edge_c[edge]);
+            edge_a[edge] = _mm_set1_ps(triangle.edge_a[edge]);
+        }
+        glm_vec4 depth_row = _mm_set1_ps((triangle.depth_y * center_y) + triangle.depth_c);
+        glm_vec4 depth_x = _mm_set1_ps(triangle.depth_x);
+        for (int x = min_x; x <= max_x; x += 4) {
+            glm_vec4 center_x = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+            glm_vec4 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edge_a[0], center_x), edge_row[0]), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edge_a[1], center_x), edge_row[1]), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edge_a[2], center_x), edge_row[2]), zero));
+            glm_vec4 depth = _mm_add_ps(_mm_mul_ps(depth_x, center_x), depth_row);
+            glm_vec4 previous = _mm_loadu_ps(row + x);
+            glm_vec4 nearest = _mm_max_ps(previous, depth);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+        }
+#else
+        for (int x = min_x; x <= max_x; x++) {
+            float center_x = (float)x + 0.5f;
+            bool inside = true;
+            for (unsigned int edge = 0; edge < 3; edge++) {
+                inside = inside && (triangle.edge_a[edge] * center_x) + (triangle.edge_b[edge] * center_y) + triangle.edge_c[edge] >= 0.0f;
+            }
+            if (inside) {
+                row[x] = std::max(row[x], (triangle.depth_x * center_x) + (triangle.depth_y * center_y) + triangle.depth_c);
+            }
+        }
+#endif
+    }
+}
+
+void occlusion_render(const glm::mat4& projection_view) {
+    occlusion_current_stats = (OcclusionStats) { .triangles = 0, .tested = 0, .occluded = 0, .milliseconds = 0.0f };
+    if (!occlusion_enabled) {
+        return;
+    }
+    Uint64 start_time = SDL_GetPerformanceCounter();
+    occlusion_projection_view = projection_view;
+
+    // occluders outside the frustum can't cover anything on screen
+    CullFrustum frustum;
+    cull_frustum_extract(&frustum, projection_view);
+    occlusion_visible_occluders.clear();
+    occlusion_triangle_offsets.clear();
+    unsigned int triangle_count = 0;
+    for (unsigned int i = 0; i < occlusion_occluders.size(); i++) {
+        if (cull_frustum_box(frustum, occlusion_occluders[i].bounds_min, occlusion_occluders[i].bounds_max)) {
+            occlusion_visible_occluders.push_back(i);
+            occlusion_triangle_offsets.push_back(triangle_count);
+            triangle_count += occlusion_occluders[i].index_count / 3;
+        }
+    }
+
+    occlusion_vertices.resize(occlusion_occluder_vertices.size());
+    occlusion_triangles.resize(triangle_count);
+    unsigned int occluder_count = occlusion_visible_occluders.size();
+    worker_parallel_for((occluder_count + OCCLUSION_CHUNK_SIZE - 1) / OCCLUSION_CHUNK_SIZE, [occluder_count](unsigned int chunk) {
+        for (unsigned int i = chunk * OCCLUSION_CHUNK_SIZE; i < std::min((chunk + 1) * OCCLUSION_CHUNK_SIZE, occluder_count); i++) {
+            const OcclusionOccluder& occluder = occlusion_occluders[occlusion_visible_occluders[i]];
+            for (unsigned int vertex = occluder.first_vertex; vertex < occluder.first_vertex + occluder.vertex_count; vertex++) {
+                occlusion_vertices[vertex] = occlusion_project(occlusion_occluder_vertices[vertex]);
+            }
+            for (unsigned int triangle = 0; triangle < occluder.index_count / 3; triangle++) {
+                const unsigned int* indices = &occlusion_occluder_indices[occluder.first_index + (triangle * 3)];
+                occlusion_setup_triangle(&occlusion_triangles[occlusion_triangle_offsets[i] + triangle], occlusion_vertices[indices[0]], occlusion_vertices[indices[1]], occlusion_vertices[indices[2]]);
+            }
+        }
+    });
+
+    for (unsigned int block_row = 0; block_row < OCCLUSION_BLOCK_ROWS; block_row++) {
+        occlusion_band_triangles[block_row].clear();
+    }
+    for (unsigned int i = 0; i < triangle_count; i++) {
+        const OcclusionTriangle& triangle = occlusion_triangles[i];
+        if (triangle.min_y > triangle.max_y) {
+            continue;
+        }
+        occlusion_current_stats.triangles++;
+        for (unsigned int block_row = triangle.min_y / OCCLUSION_BLOCK_SIZE; block_row <= triangle.max_y / OCCLUSION_BLOCK_SIZE; block_row++) {
+            occlusion_band_triangles[block_row].push_back(i);
+        }
+    }
+
+    // every job owns one row of blocks, so jobs never write the same pixels and each can build its own part of the hierarchy
+    worker_parallel_for(OCCLUSION_BLOCK_ROWS, [](unsigned int block_row) {
+        int band_min_y = block_row * OCCLUSION_BLOCK_SIZE;
+        int band_max_y = std::min((block_row + 1) * OCCLUSION_BLOCK_SIZE, OCCLUSION_HEIGHT) - 1;
+        std::fill(&occlusion_depth[band_min_y * OCCLUSION_WIDTH], &occlusion_depth[(band_max_y + 1) * OCCLUSION_WIDTH], 0.0f);
+        for (unsigned int triangle : occlusion_band_triangles[block_row]) {
+            occlusion_rasterize(occlusion_triangles[triangle], band_min_y, band_max_y);
+        }
+
+        for (unsigned int block_column = 0; block_column < OCCLUSION_BLOCK_COLUMNS; block_column++) {
+            float farthest = INFINITY;
+            unsigned int max_x = std::min((block_column + 1) * OCCLUSION_BLOCK_SIZE, OCCLUSION_WIDTH);
+            for (int y = band_min_y; y <= band_max_y; y++) {
+                for (unsigned int x = block_column * OCCLUSION_BLOCK_SIZE; x < max_x; x++) {
+                    farthest = std::min(farthest, occlusion_depth[(y * OCCLUSION_WIDTH) + x]);
+                }
+            }
+            occlusion_block_depth[(block_row * OCCLUSION_BLOCK_COLUMNS) + block_column] = farthest;
+        }
+    });
+
+    occlusion_current_stats.milliseconds = (float)(SDL_GetPerformanceCounter() - start_time) * 1000.0f / (float)SDL_GetPerformanceFrequency();
+}
+
+bool occlusion_visible_box(glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    if (!occlusion_enabled) {
+        return true;
+    }
+    occlusion_current_stats.tested++;
+
+    // w is linear over the box, so its nearest point is one of the corners
+    float min_x = INFINITY;
+    float min_y = INFINITY;
+    float max_x = -INFINITY;
+    float max_y = -INFINITY;
+    float nearest_depth = 0.0f;
+    for (unsigned int corner = 0; corner < 8; corner++) {
+        OcclusionVertex vertex = occlusion_project(glm::vec3(corner & 1 ? bounds_max.x : bounds_min.x, corner & 2 ? bounds_max.y : bounds_min.y, corner & 4 ? bounds_max.z : bounds_min.z));
+        if (vertex.clipped) {
+            return true;
+        }
+        min_x = std::min(min_x, vertex.x);
+        min_y = std::min(min_y, vertex.y);
+        max_x = std::max(max_x, vertex.x);
+        max_y = std::max(max_y, vertex.y);
+        nearest_depth = std::max(nearest_depth, vertex.depth);
+    }
+    // boxes reaching off screen are left to frustum culling
+    if (min_x < 0.0f || min_y < 0.0f || max_x >= (float)OCCLUSION_WIDTH || max_y >= (float)OCCLUSION_HEIGHT) {
+        return true;
+    }
+
+    // every pixel the box touches has to hold something nearer than the nearest point of the box,
+    // which whole blocks usually settle through their farthest depth
+    unsigned int pixel_min_x = (unsigned int)min_x;
+    unsigned int pixel_min_y = (unsigned int)min_y;
+    unsigned int pixel_max_x = (unsigned int)max_x;
+    unsigned int pixel_max_y = (unsigned int)max_y;
+    for (unsigned int block_row = pixel_min_y / OCCLUSION_BLOCK_SIZE; block_row <= pixel_max_y / OCCLUSION_BLOCK_SIZE; block_row++) {
+        for (unsigned int block_column = pixel_min_x / OCCLUSION_BLOCK_SIZE; block_column <= pixel_max_x / OCCLUSION_BLOCK_SIZE; block_column++) {
+            if (occlusion_block_depth[(block_row * OCCLUSION_BLOCK_COLUMNS) + block_column] > nearest_depth) {
+                continue;
+            }
+            unsigned int block_max_y = std::min(((block_row + 1) * OCCLUSION_BLOCK_SIZE) - 1, pixel_max_y);
+            unsigned int block_max_x = std::min(((block_column + 1) * OCCLUSION_BLOCK_SIZE) - 1, pixel_max_x);
+            for (unsigned int y = std::max(block_row * OCCLUSION_BLOCK_SIZE, pixel_min_y); y <= block_max_y; y++) {
+                for (unsigned int x = std::max(block_column * OCCLUSION_BLOCK_SIZE, pixel_min_x); x <= block_max_x; x++) {
+                    if (occlusion_depth[(y * OCCLUSION_WIDTH) + x] <= nearest_depth) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    occlusion_current_stats.occluded++;
+    return false;
+}
+
+OcclusionStats occlusion_stats() {
+    return occlusion_current_stats;
+}
\ No newline at end of file
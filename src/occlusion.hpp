@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Software occlusion culling. Occluders are simplified world space meshes, like the boxes of props,
+// which occlusion_render rasterizes into a small depth buffer on the worker threads every frame.
+// occlusion_visible_box then checks an object's bounds against it before the object is submitted.
+//
+// The buffer stores 1 / w, so larger is nearer and it clears to 0. Each block of pixels also keeps its farthest depth,
+// which decides most boxes without looking at single pixels. Everything runs on the CPU, so it works without a GPU too.
+
+// half the screen resolution
+const unsigned int OCCLUSION_WIDTH = 320;
+const unsigned int OCCLUSION_HEIGHT = 180;
+// width and height of a block of the hierarchy, and the height of the band of rows each job rasterizes
+const unsigned int OCCLUSION_BLOCK_SIZE = 8;
+
+struct OcclusionStats {
+    // occluder triangles that reached the rasterizer
+    unsigned int triangles;
+    unsigned int tested;
+    unsigned int occluded;
+    float milliseconds;
+};
+
+// when false nothing is occluded, set before rendering
+extern bool occlusion_enabled;
+
+// indices are triangles of vertices
+void occlusion_add_occluder(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices);
+// the box bounds_min, bounds_max transformed by transform
+void occlusion_add_box(const glm::mat4& transform, glm::vec3 bounds_min, glm::vec3 bounds_max);
+void occlusion_clear_occluders();
+// clears the depth buffer and draws every occluder into it
+void occlusion_render(const glm::mat4& projection_view);
+// false when the world space box is hidden behind occluders everywhere it covers
+bool occlusion_visible_box(glm::vec3 bounds_min, glm::vec3 bounds_max);
+// since the last occlusion_render
+OcclusionStats occlusion_stats();
\ No newline at end of file
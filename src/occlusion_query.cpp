@@ -0,0 +1,256 @@
+#include "occlusion_query.hpp"
+
+#include "gl_state.hpp"
+#include "shader.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+#include <cstdio>
+
+// 4.3, past what the gl loader covers. it lets the driver answer from coarse depth, which is all a bounding box needs
+const GLenum OCCLUSION_QUERY_ANY_SAMPLES_PASSED_CONSERVATIVE = 0x8D6A;
+
+struct OcclusionQueryGroup {
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    GLuint query;
+    // a query was issued and its result hasn't been read yet
+    bool pending;
+    // the last result read
+    bool visible;
+    // the frame a visible group is queried again on
+    unsigned int next_query_frame;
+    // the last frame the group was in view, and what was decided for it that frame
+    unsigned int seen_frame;
+    bool draw;
+    GLuint condition;
+    bool due;
+};
+
+bool occlusion_query_enabled = false;
+
+GLenum occlusion_query_target;
+GLuint occlusion_query_vao = 0;
+GLuint occlusion_query_vbo;
+GLuint occlusion_query_ebo;
+std::vector<OcclusionQueryGroup> occlusion_query_groups;
+// starts at 1 so that no group has been seen yet
+unsigned int occlusion_query_frame = 1;
+glm::vec3 occlusion_query_camera_position;
+float occlusion_query_near_distance;
+OcclusionQueryStats occlusion_query_current_stats;
+
+bool occlusion_query_init() {
+    if (!occlusion_query_enabled) {
+        return true;
+    }
+
+    GLint major_version;
+    GLint minor_version;
+    glGetIntegerv(GL_MAJOR_VERSION, &major_version);
+    glGetIntegerv(GL_MINOR_VERSION, &minor_version);
+    bool conservative = major_version > 4 || (major_version == 4 && minor_version >= 3);
+    occlusion_query_target = conservative ? OCCLUSION_QUERY_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED;
+    printf("Occlusion queries on, %s\n", conservative ? "conservative" : "exact, since conservative queries need GL 4.3");
+
+    // a unit box, scaled onto each group's
+    const GLfloat corners[] = {
+        0.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        1.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 1.0f,
+        1.0f, 0.0f, 1.0f,
+        0.0f, 1.0f, 1.0f,
+        1.0f, 1.0f, 1.0f
+    };
+    const GLubyte indices[] = {
+        0, 2, 1, 1, 2, 3,
+        4, 5, 6, 5, 7, 6,
+        0, 1, 4, 1, 5, 4,
+        2, 6, 3, 3, 6, 7,
+        0, 4, 2, 2, 4, 6,
+        1, 3, 5, 3, 7, 5
+    };
+    glGenVertexArrays(1, &occlusion_query_vao);
+    glGenBuffers(1, &occlusion_query_vbo);
+    glGenBuffers(1, &occlusion_query_ebo);
+    gl_state_bind_vertex_array(occlusion_query_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, occlusion_query_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, occlusion_query_ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return true;
+}
+
+void occlusion_query_quit() {
+    occlusion_query_group_clear();
+    if (occlusion_query_vao != 0) {
+        gl_state_forget_vertex_array(occlusion_query_vao);
+        glDeleteVertexArrays(1, &occlusion_query_vao);
+        glDeleteBuffers(1, &occlusion_query_vbo);
+        glDeleteBuffers(1, &occlusion_query_ebo);
+        occlusion_query_vao = 0;
+    }
+}
+
+unsigned int occlusion_query_group_create(glm::vec3 bounds_min, glm::vec3 bounds_max) {
+    OcclusionQueryGroup group = (OcclusionQueryGroup) {
+        .bounds_min = bounds_min - glm::vec3(OCCLUSION_QUERY_BOX_MARGIN),
+        .bounds_max = bounds_max + glm::vec3(OCCLUSION_QUERY_BOX_MARGIN),
+        .query = 0,
+        .pending = false,
+        .visible = true,
+        .next_query_frame = 0,
+        .seen_frame = 0,
+        .draw = true,
+        .condition = 0,
+        .due = false
+    };
+    if (occlusion_query_enabled) {
+        glGenQueries(1, &group.query);
+    }
+    occlusion_query_groups.push_back(group);
+
+    return occlusion_query_groups.size() - 1;
+}
+
+void occlusion_query_group_clear() {
+    for (const OcclusionQueryGroup& group : occlusion_query_groups) {
+        if (group.query != 0) {
+            glDeleteQueries(1, &group.query);
+        }
+    }
+    occlusion_query_groups.clear();
+}
+
+void occlusion_query_begin(glm::vec3 camera_position, float near_distance) {
+    occlusion_query_frame++;
+    occlusion_query_camera_position = camera_position;
+    occlusion_query_near_distance = near_distance;
+    occlusion_query_current_stats = (OcclusionQueryStats) {
+        .groups = 0,
+        .queries = 0,
+        .conditional = 0,
+        .occluded = 0
+    };
+    if (!occlusion_query_enabled) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < occlusion_query_groups.size(); i++) {
+        OcclusionQueryGroup& group = occlusion_query_groups[i];
+        if (!group.pending) {
+            continue;
+        }
+        GLuint available;
+        glGetQueryObjectuiv(group.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint any_samples_passed;
+        glGetQueryObjectuiv(group.query, GL_QUERY_RESULT, &any_samples_passed);
+        group.pending = false;
+        group.visible = any_samples_passed != 0;
+        if (group.visible) {
+            group.next_query_frame = occlusion_query_frame + OCCLUSION_QUERY_VISIBLE_FRAMES + (i % OCCLUSION_QUERY_VISIBLE_FRAMES);
+        }
+    }
+}
+
+// decides a group's draws for the frame the first time it's seen in it
+static void occlusion_query_group_decide(OcclusionQueryGroup& group) {
+    bool returning = group.seen_frame + 1 != occlusion_query_frame;
+    group.seen_frame = occlusion_query_frame;
+    group.draw = true;
+    group.condition = 0;
+    group.due = false;
+    occlusion_query_current_stats.groups++;
+
+    glm::vec3 nearest = glm::clamp(occlusion_query_camera_position, group.bounds_min, group.bounds_max);
+    if (glm::distance(nearest, occlusion_query_camera_position) <= occlusion_query_near_distance) {
+        // anything pending was queried from somewhere else, so it's dropped. the next query replaces it
+        group.pending = false;
+        group.visible = true;
+        group.next_query_frame = occlusion_query_frame;
+        return;
+    }
+    // whatever was learned before the group left view is stale, so it starts over as visible
+    if (returning) {
+        group.pending = false;
+        group.visible = true;
+        group.due = true;
+        return;
+    }
+
+    if (group.pending) {
+        group.condition = group.query;
+        occlusion_query_current_stats.conditional++;
+    } else if (!group.visible) {
+        group.draw = false;
+        group.due = true;
+        occlusion_query_current_stats.occluded++;
+    } else {
+        group.due = occlusion_query_frame >= group.next_query_frame;
+    }
+}
+
+bool occlusion_query_group_visible(unsigned int group_index, GLuint* condition_query) {
+    *condition_query = 0;
+    if (!occlusion_query_enabled) {
+        return true;
+    }
+
+    OcclusionQueryGroup& group = occlusion_query_groups[group_index];
+    if (group.seen_frame != occlusion_query_frame) {
+        occlusion_query_group_decide(group);
+    }
+    *condition_query = group.condition;
+
+    return group.draw;
+}
+
+void occlusion_query_issue() {
+    if (!occlusion_query_enabled) {
+        return;
+    }
+
+    bool started = false;
+    for (OcclusionQueryGroup& group : occlusion_query_groups) {
+        if (group.seen_frame != occlusion_query_frame || !group.due) {
+            continue;
+        }
+        if (!started) {
+            // only the depth test matters, and the boxes mustn't hide anything drawn after them
+            gl_state_use_program(light_shader.id);
+            gl_state_bind_vertex_array(occlusion_query_vao);
+            gl_state_enable(GL_DEPTH_TEST, true);
+            gl_state_depth_mask(false);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            started = true;
+        }
+
+        glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), group.bounds_min), group.bounds_max - group.bounds_min);
+        glUniformMatrix4fv(light_shader.uniform[SHADER_UNIFORM_MODEL], 1, GL_FALSE, glm::value_ptr(model));
+        glBeginQuery(occlusion_query_target, group.query);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)0);
+        glEndQuery(occlusion_query_target);
+        group.pending = true;
+        group.due = false;
+        occlusion_query_current_stats.queries++;
+    }
+
+    if (started) {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        gl_state_depth_mask(true);
+    }
+}
+
+OcclusionQueryStats occlusion_query_stats() {
+    return occlusion_query_current_stats;
+}
\ No newline at end of file
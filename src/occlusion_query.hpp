@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Hardware occlusion queries over groups of objects, the GPU side counterpart of occlusion.hpp.
+// After the opaque draws of a frame, the box of every group due a query is drawn into it with color and depth writes off.
+// The group's draws the next frame are wrapped in conditional rendering on that query, so the GPU drops them if no sample of the box passed
+// and the CPU never waits on a result.
+//
+// Results that have come back by the start of a frame are read without blocking, and decide how much the group is trusted.
+// A group found occluded isn't submitted at all and is queried again every frame, since it has to reappear as soon as it's uncovered.
+// A group found visible is drawn without a condition and goes a few frames before its next query, staggered so that groups don't all come due together.
+
+// frames a group found visible goes without a query, up to twice this with the stagger
+const unsigned int OCCLUSION_QUERY_VISIBLE_FRAMES = 8;
+// boxes are grown by this much on every side, so that geometry lying on a face of its own box can't hide it
+const float OCCLUSION_QUERY_BOX_MARGIN = 0.05f;
+
+struct OcclusionQueryStats {
+    // groups in view this frame
+    unsigned int groups;
+    unsigned int queries;
+    // groups drawn under a condition because their result wasn't back yet
+    unsigned int conditional;
+    // groups skipped because their last result was occluded
+    unsigned int occluded;
+};
+
+// off by default, set before occlusion_query_init. when false every group is drawn without a condition
+extern bool occlusion_query_enabled;
+
+bool occlusion_query_init();
+void occlusion_query_quit();
+// returns the index of the group. the box is in world space
+unsigned int occlusion_query_group_create(glm::vec3 bounds_min, glm::vec3 bounds_max);
+// deletes every group
+void occlusion_query_group_clear();
+// starts a frame, reading back whatever results have arrived. groups whose grown box is within near_distance of the camera are always visible,
+// since the near plane would clip their box away
+void occlusion_query_begin(glm::vec3 camera_position, float near_distance);
+// for a group that is in view this frame, any number of times. returns false if its draws should be skipped,
+// otherwise sets condition_query to the query they should be conditional on, 0 for none. see RenderPacket
+bool occlusion_query_group_visible(unsigned int group, GLuint* condition_query);
+// draws the boxes of the groups in view that are due a query. call after the opaque draws, with the frame block up to date
+void occlusion_query_issue();
+// counts since the last occlusion_query_begin
+OcclusionQueryStats occlusion_query_stats();
\ No newline at end of file
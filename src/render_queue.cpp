@@ -0,0 +1,342 @@
+#include "render_queue.hpp"
+
+#include "gl_state.hpp"
+#include "upload_ring.hpp"
+
+#include <SDL2/SDL.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+
+// the gl loader only covers 4.1, so the 4.3 multi draw is loaded by hand
+typedef void (APIENTRYP RenderQueueMultiDrawElementsIndirectFunction)(GLenum mode, GLenum type, const void* indirect, GLsizei draw_count, GLsizei stride);
+
+struct RenderQueueEntry {
+    uint64_t key;
+    unsigned int packet;
+};
+
+struct RenderQueueDrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+// a run of sorted entries that is drawn with one multi draw, or a single entry drawn on its own when command_count is 0
+struct RenderQueueBatch {
+    unsigned int entry;
+    unsigned int command_first;
+    unsigned int command_count;
+};
+
+struct RenderQueueState {
+    const ShaderProgram* program;
+    // uniforms keep their values per program, so they only need setting again when they change or the program does
+    const RenderPacket* previous;
+};
+
+bool render_queue_multi_draw_supported = false;
+RenderQueueMultiDrawElementsIndirectFunction render_queue_multi_draw_elements_indirect = NULL;
+
+// kept between frames so that submitting doesn't allocate once the queue has grown to the scene
+std::vector<RenderPacket> render_queue_packets;
+std::vector<RenderQueueEntry> render_queue_entries;
+std::vector<RenderQueueEntry> render_queue_scratch;
+std::vector<RenderInstance> render_queue_instance_data;
+std::vector<RenderQueueBatch> render_queue_batches;
+std::vector<RenderQueueDrawElementsIndirectCommand> render_queue_commands;
+// where this frame's instances and commands went in the upload ring
+UploadRingRange render_queue_instance_range;
+UploadRingRange render_queue_command_range;
+glm::vec3 render_queue_camera_position;
+glm::vec3 render_queue_camera_front;
+float render_queue_depth_scale;
+RenderQueueStats render_queue_last_stats;
+
+bool render_queue_init() {
+    // base instance in the indirect commands is what lets every draw of a multi draw find its own instances, so this needs all of 4.3
+    GLint major_version;
+    GLint minor_version;
+    glGetIntegerv(GL_MAJOR_VERSION, &major_version);
+    glGetIntegerv(GL_MINOR_VERSION, &minor_version);
+    render_queue_multi_draw_supported = false;
+    if (major_version > 4 || (major_version == 4 && minor_version >= 3)) {
+        render_queue_multi_draw_elements_indirect = (RenderQueueMultiDrawElementsIndirectFunction)SDL_GL_GetProcAddress("glMultiDrawElementsIndirect");
+        render_queue_multi_draw_supported = render_queue_multi_draw_elements_indirect != NULL;
+    }
+    printf("Multi draw indirect %s\n", render_queue_multi_draw_supported ? "available" : "unavailable, drawing packets one at a time");
+
+    return true;
+}
+
+void render_queue_begin(glm::vec3 camera_position, glm::vec3 camera_front, float far_plane) {
+    render_queue_packets.clear();
+    render_queue_entries.clear();
+    render_queue_instance_data.clear();
+    render_queue_camera_position = camera_position;
+    render_queue_camera_front = glm::normalize(camera_front);
+    render_queue_depth_scale = (float)((1u << RENDER_QUEUE_DEPTH_BITS) - 1) / far_plane;
+}
+
+void render_queue_submit(const RenderPacket& packet) {
+    const uint64_t DEPTH_MAX = (1u << RENDER_QUEUE_DEPTH_BITS) - 1;
+    float distance = glm::dot(glm::vec3(packet.model[3]) - render_queue_camera_position, render_queue_camera_front);
+    uint64_t depth = (uint64_t)std::min(std::max(distance * render_queue_depth_scale, 0.0f), (float)DEPTH_MAX);
+    if (packet.pass == RENDER_PASS_TRANSLUCENT) {
+        depth = DEPTH_MAX - depth;
+    }
+    uint64_t material = ((((uint64_t)packet.texture[0] * 251u) + packet.texture[1]) * 251u + packet.skin_texture) & 0xffff;
+
+    render_queue_entries.push_back((RenderQueueEntry) {
+        .key = ((uint64_t)packet.pass << 62) | (((uint64_t)packet.program->id & 0x3f) << 56) | (material << 40) | (((uint64_t)packet.vao & 0xffff) << 24) | depth,
+        .packet = (unsigned int)render_queue_packets.size()
+    });
+    render_queue_packets.push_back(packet);
+    RenderPacket& queued = render_queue_packets.back();
+    queued.key = render_queue_entries.back().key;
+
+    // a single instance, so that the packet can share a multi draw with others
+    if (render_queue_multi_draw_supported && queued.index_type != 0 && queued.instance_count == 0) {
+        RenderInstance instance = (RenderInstance) {
+            .model = queued.model,
+            .position_scale = glm::vec4(queued.position_scale, queued.skin)
+        };
+        queued.instance_count = 1;
+        queued.instance_first = render_queue_instances(&instance, 1);
+    }
+}
+
+unsigned int render_queue_instances(const RenderInstance* instances, unsigned int count) {
+    unsigned int first = render_queue_instance_data.size();
+    render_queue_instance_data.insert(render_queue_instance_data.end(), instances, instances + count);
+
+    return first;
+}
+
+// least significant byte first, skipping any byte that is the same in every key
+static void render_queue_sort() {
+    render_queue_scratch.resize(render_queue_entries.size());
+    for (unsigned int shift = 0; shift < 64; shift += 8) {
+        unsigned int offset[256];
+        std::memset(offset, 0, sizeof(offset));
+        for (const RenderQueueEntry& entry : render_queue_entries) {
+            offset[(entry.key >> shift) & 0xff]++;
+        }
+        if (offset[(render_queue_entries[0].key >> shift) & 0xff] == render_queue_entries.size()) {
+            continue;
+        }
+
+        unsigned int total = 0;
+        for (unsigned int bucket = 0; bucket < 256; bucket++) {
+            unsigned int count = offset[bucket];
+            offset[bucket] = total;
+            total += count;
+        }
+        for (const RenderQueueEntry& entry : render_queue_entries) {
+            render_queue_scratch[offset[(entry.key >> shift) & 0xff]++] = entry;
+        }
+        render_queue_entries.swap(render_queue_scratch);
+    }
+}
+
+// whether b can go in the same multi draw as a. per instance state lives in the instance buffer, so it doesn't count
+static bool render_queue_batchable(const RenderPacket& a, const RenderPacket& b) {
+    return b.instance_count != 0 && b.index_type == a.index_type && b.program == a.program && b.vao == a.vao &&
+           b.texture[0] == a.texture[0] && b.texture[1] == a.texture[1] && b.skin_texture == a.skin_texture && b.octahedral_normal == a.octahedral_normal &&
+           b.condition_query == a.condition_query && b.ka == a.ka && b.kd == a.kd && b.ks == a.ks;
+}
+
+static void render_queue_build_batches() {
+    render_queue_batches.clear();
+    render_queue_commands.clear();
+    unsigned int entry = 0;
+    while (entry < render_queue_entries.size()) {
+        const RenderPacket& first = render_queue_packets[render_queue_entries[entry].packet];
+        RenderQueueBatch batch = (RenderQueueBatch) {
+            .entry = entry,
+            .command_first = (unsigned int)render_queue_commands.size(),
+            .command_count = 0
+        };
+        if (render_queue_multi_draw_supported && first.index_type != 0 && first.instance_count != 0) {
+            while (entry < render_queue_entries.size() && render_queue_batchable(first, render_queue_packets[render_queue_entries[entry].packet])) {
+                const RenderPacket& packet = render_queue_packets[render_queue_entries[entry].packet];
+                render_queue_commands.push_back((RenderQueueDrawElementsIndirectCommand) {
+                    .count = packet.count,
+                    .instance_count = packet.instance_count,
+                    .first_index = packet.first,
+                    .base_vertex = packet.base_vertex,
+                    .base_instance = packet.instance_first
+                });
+                batch.command_count++;
+                entry++;
+            }
+        } else {
+            entry++;
+        }
+        render_queue_batches.push_back(batch);
+    }
+}
+
+static void render_queue_apply(RenderQueueState* state, const RenderPacket& packet) {
+    if (packet.program != state->program) {
+        state->program = packet.program;
+        if (gl_state_use_program(state->program->id)) {
+            render_queue_last_stats.program_changes++;
+        }
+        glUniform1i(state->program->uniform[SHADER_UNIFORM_MATERIAL_MAP_KA], 0);
+        glUniform1i(state->program->uniform[SHADER_UNIFORM_MATERIAL_MAP_KD], 1);
+        glUniform1i(state->program->uniform[SHADER_UNIFORM_SKIN_MAP], RENDER_QUEUE_SKIN_UNIT);
+        state->previous = NULL;
+    }
+    for (unsigned int unit = 0; unit < 2; unit++) {
+        if (gl_state_bind_texture(unit, packet.texture[unit])) {
+            render_queue_last_stats.texture_changes++;
+        }
+    }
+    // left bound when a packet has none, since only skinned draws sample it
+    if (packet.skin_texture != 0 && gl_state_bind_texture_array(RENDER_QUEUE_SKIN_UNIT, packet.skin_texture)) {
+        render_queue_last_stats.texture_changes++;
+    }
+    if (gl_state_bind_vertex_array(packet.vao)) {
+        render_queue_last_stats.vao_changes++;
+    }
+
+    const ShaderProgram* program = state->program;
+    const RenderPacket* previous = state->previous;
+    if (packet.instance_count == 0) {
+        glUniformMatrix4fv(program->uniform[SHADER_UNIFORM_MODEL], 1, GL_FALSE, glm::value_ptr(packet.model));
+        if (previous == NULL || previous->instance_count != 0 || packet.position_scale != previous->position_scale) {
+            glUniform3fv(program->uniform[SHADER_UNIFORM_POSITION_SCALE], 1, glm::value_ptr(packet.position_scale));
+        }
+        if (packet.skin_texture != 0 && (previous == NULL || previous->instance_count != 0 || previous->skin_texture == 0 || packet.skin != previous->skin)) {
+            glUniform1f(program->uniform[SHADER_UNIFORM_SKIN_LAYER], packet.skin);
+        }
+    }
+    if (previous == NULL || (packet.skin_texture != 0) != (previous->skin_texture != 0)) {
+        glUniform1i(program->uniform[SHADER_UNIFORM_SKINNED], packet.skin_texture != 0);
+    }
+    if (previous == NULL || (packet.instance_count == 0) != (previous->instance_count == 0)) {
+        glUniform1i(program->uniform[SHADER_UNIFORM_INSTANCED], packet.instance_count != 0);
+    }
+    if (previous == NULL || packet.octahedral_normal != previous->octahedral_normal) {
+        glUniform1i(program->uniform[SHADER_UNIFORM_OCTAHEDRAL_NORMAL], packet.octahedral_normal);
+    }
+    if (previous == NULL || packet.ka != previous->ka || packet.kd != previous->kd || packet.ks != previous->ks) {
+        glUniform3fv(program->uniform[SHADER_UNIFORM_MATERIAL_KA], 1, glm::value_ptr(packet.ka));
+        glUniform3fv(program->uniform[SHADER_UNIFORM_MATERIAL_KD], 1, glm::value_ptr(packet.kd));
+        glUniform3fv(program->uniform[SHADER_UNIFORM_MATERIAL_KS], 1, glm::value_ptr(packet.ks));
+    }
+    state->previous = &packet;
+}
+
+// points the instance attributes of the bound vertex array at this frame's instances, starting from instance first
+static void render_queue_enable_instances(unsigned int first) {
+    glBindBuffer(GL_ARRAY_BUFFER, render_queue_instance_range.buffer);
+    std::size_t offset = render_queue_instance_range.offset + ((std::size_t)first * sizeof(RenderInstance));
+    for (GLuint column = 0; column < 4; column++) {
+        glEnableVertexAttribArray(RENDER_QUEUE_INSTANCE_ATTRIBUTE + column);
+        glVertexAttribPointer(RENDER_QUEUE_INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(RenderInstance), (void*)(offset + (column * sizeof(glm::vec4))));
+        glVertexAttribDivisor(RENDER_QUEUE_INSTANCE_ATTRIBUTE + column, 1);
+    }
+    glEnableVertexAttribArray(RENDER_QUEUE_INSTANCE_ATTRIBUTE + 4);
+    glVertexAttribPointer(RENDER_QUEUE_INSTANCE_ATTRIBUTE + 4, 4, GL_FLOAT, GL_FALSE, sizeof(RenderInstance), (void*)(offset + offsetof(RenderInstance, position_scale)));
+    glVertexAttribDivisor(RENDER_QUEUE_INSTANCE_ATTRIBUTE + 4, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// vertex arrays are shared between instanced and non-instanced draws, and the latter must never read the instance attributes
+static void render_queue_disable_instances() {
+    for (GLuint attribute = 0; attribute < 5; attribute++) {
+        glDisableVertexAttribArray(RENDER_QUEUE_INSTANCE_ATTRIBUTE + attribute);
+    }
+}
+
+static void render_queue_draw(const RenderPacket& packet) {
+    const void* indices = (void*)(uintptr_t)(packet.first * (packet.index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)));
+    if (packet.instance_count == 0) {
+        if (packet.index_type == 0) {
+            glDrawArrays(GL_TRIANGLES, packet.first, packet.count);
+        } else {
+            glDrawElementsBaseVertex(GL_TRIANGLES, packet.count, packet.index_type, indices, packet.base_vertex);
+        }
+        render_queue_last_stats.instances++;
+    } else {
+        // 4.1 has no base instance, so the attributes are pointed at this packet's instances instead
+        render_queue_enable_instances(packet.instance_first);
+        if (packet.index_type == 0) {
+            glDrawArraysInstanced(GL_TRIANGLES, packet.first, packet.count, packet.instance_count);
+        } else {
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packet.count, packet.index_type, indices, packet.instance_count, packet.base_vertex);
+        }
+        render_queue_disable_instances();
+        render_queue_last_stats.instances += packet.instance_count;
+    }
+    render_queue_last_stats.draws++;
+    render_queue_last_stats.draw_calls++;
+}
+
+void render_queue_execute() {
+    render_queue_last_stats = (RenderQueueStats) {
+        .draws = 0,
+        .draw_calls = 0,
+        .instances = 0,
+        .program_changes = 0,
+        .texture_changes = 0,
+        .vao_changes = 0
+    };
+    if (render_queue_entries.empty()) {
+        return;
+    }
+    render_queue_sort();
+    render_queue_build_batches();
+
+    // every instance and command of the frame goes up in one upload each
+    if (!render_queue_instance_data.empty()) {
+        render_queue_instance_range = upload_ring_upload(&render_queue_instance_data[0], render_queue_instance_data.size() * sizeof(RenderInstance), sizeof(glm::vec4));
+    }
+    if (!render_queue_commands.empty()) {
+        render_queue_command_range = upload_ring_upload(&render_queue_commands[0], render_queue_commands.size() * sizeof(RenderQueueDrawElementsIndirectCommand), sizeof(GLuint));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, render_queue_command_range.buffer);
+    }
+
+    RenderQueueState state = (RenderQueueState) {
+        .program = NULL,
+        .previous = NULL
+    };
+    for (const RenderQueueBatch& batch : render_queue_batches) {
+        const RenderPacket& packet = render_queue_packets[render_queue_entries[batch.entry].packet];
+        render_queue_apply(&state, packet);
+        if (packet.condition_query != 0) {
+            glBeginConditionalRender(packet.condition_query, GL_QUERY_NO_WAIT);
+        }
+        if (batch.command_count == 0) {
+            render_queue_draw(packet);
+        } else {
+            // the base instance of each command picks out its instances, so the attributes start at the beginning of the buffer
+            render_queue_enable_instances(0);
+            render_queue_multi_draw_elements_indirect(GL_TRIANGLES, packet.index_type, (void*)(render_queue_command_range.offset + ((std::size_t)batch.command_first * sizeof(RenderQueueDrawElementsIndirectCommand))), batch.command_count, 0);
+            render_queue_disable_instances();
+            for (unsigned int command = batch.command_first; command < batch.command_first + batch.command_count; command++) {
+                render_queue_last_stats.instances += render_queue_commands[command].instance_count;
+            }
+            render_queue_last_stats.draws += batch.command_count;
+            render_queue_last_stats.draw_calls++;
+        }
+        if (packet.condition_query != 0) {
+            glEndConditionalRender();
+        }
+    }
+
+    if (!render_queue_commands.empty()) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+}
+
+RenderQueueStats render_queue_stats() {
+    return render_queue_last_stats;
+}
\ No newline at end of file
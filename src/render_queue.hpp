@@ -0,0 +1,99 @@
+#pragma once
+
+#include "shader.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+
+// Draws are submitted as packets during the frame, sorted by a 64 bit key and executed in one go,
+// so that draws sharing a program, textures and vertex array run back to back and state only changes between them.
+//
+// key bits, most significant first:
+//   63-62 pass
+//   61-56 program
+//   55-40 material, a hash of the textures
+//   39-24 vertex array
+//   23-0  depth, front to back for opaque draws and back to front for translucent ones
+// GL names are truncated to fit, which can only cost batching since execution compares the real state.
+//
+// When GL 4.3 is available, indexed packets are drawn through the instance buffer even when they aren't instanced,
+// and every run of packets sharing all of their state goes out as a single glMultiDrawElementsIndirect.
+// Otherwise each packet is its own draw call.
+//
+// Packets with a condition_query are drawn inside conditional rendering on it, which never waits on the query's result.
+
+enum RenderPass {
+    RENDER_PASS_OPAQUE,
+    RENDER_PASS_TRANSLUCENT
+};
+
+const unsigned int RENDER_QUEUE_DEPTH_BITS = 24;
+// instanced draws read their model matrix from this attribute and the three after it, then their position scale and skin layer from the one after those
+const GLuint RENDER_QUEUE_INSTANCE_ATTRIBUTE = 3;
+// texture unit the skin array of a packet is bound to, after the two material maps
+const unsigned int RENDER_QUEUE_SKIN_UNIT = 2;
+
+struct RenderInstance {
+    glm::mat4 model;
+    // xyz is the position scale and w the skin layer
+    glm::vec4 position_scale;
+};
+
+struct RenderPacket {
+    uint64_t key;
+    RenderPass pass;
+    const ShaderProgram* program;
+    GLuint vao;
+    // bound to texture units 0 and 1
+    GLuint texture[2];
+    // a GL_TEXTURE_2D_ARRAY replacing both textures when it isn't 0, see ModelSkins
+    GLuint skin_texture;
+
+    glm::mat4 model;
+    // when instance_count isn't 0 the draw is instanced over that many instances from render_queue_instances,
+    // and model and position_scale are only used to sort the packet
+    unsigned int instance_count;
+    unsigned int instance_first;
+    glm::vec3 position_scale;
+    // layer of skin_texture, per instance for instanced draws
+    float skin;
+    bool octahedral_normal;
+    glm::vec3 ka;
+    glm::vec3 kd;
+    glm::vec3 ks;
+
+    // index_type is 0 for non-indexed draws, in which case first is the first vertex rather than the first index
+    GLenum index_type;
+    unsigned int first;
+    unsigned int count;
+    // added to every index, for meshes in the shared mesh buffers
+    int base_vertex;
+    // when this isn't 0 the GPU skips the draw if the occlusion query found no samples, see occlusion_query.hpp
+    GLuint condition_query;
+};
+
+struct RenderQueueStats {
+    unsigned int draws;
+    // draws and multi draws actually issued
+    unsigned int draw_calls;
+    unsigned int instances;
+    unsigned int program_changes;
+    unsigned int texture_changes;
+    unsigned int vao_changes;
+};
+
+// set by render_queue_init
+extern bool render_queue_multi_draw_supported;
+
+bool render_queue_init();
+// clears the queue. depth is measured along camera_front and scaled so that far_plane uses every depth bit
+void render_queue_begin(glm::vec3 camera_position, glm::vec3 camera_front, float far_plane);
+// builds the key from the packet's state and the position of its model matrix
+void render_queue_submit(const RenderPacket& packet);
+// queues instances for this frame's upload and returns the instance_first to draw them with
+unsigned int render_queue_instances(const RenderInstance* instances, unsigned int count);
+// sorts and draws everything submitted since render_queue_begin. binds go through gl_state and are left as they are
+void render_queue_execute();
+// state changes made by the last render_queue_execute
+RenderQueueStats render_queue_stats();
\ No newline at end of file
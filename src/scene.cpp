@@ -3,55 +3,135 @@
 #include "shader.hpp"
 #include "model.hpp"
 #include "global.hpp"
+#include "asset.hpp"
+#include "render_queue.hpp"
+#include "gl_state.hpp"
+#include "static_batch.hpp"
+#include "cull.hpp"
+#include "bvh.hpp"
+#include "occlusion.hpp"
+#include "occlusion_query.hpp"
 
 #include <SDL2/SDL.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glad/glad.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cstdio>
 
 glm::vec3 camera_position = glm::vec3(0.0f, 0.0f, 3.0f);
 glm::vec3 camera_front = glm::vec3(0.0f, 0.0f, -1.0f);
 glm::vec3 camera_up = glm::vec3(0.0f, 1.0f, 0.0f);
+glm::mat4 camera_projection;
+const float CAMERA_NEAR_PLANE = 0.1f;
+const float CAMERA_FAR_PLANE = 100.0f;
 float camera_yaw = -90.0f;
 float camera_pitch = 0.0f;
 
 const Uint8* keys;
 GLuint cube_vao;
-GLuint floor_vao;
-GLuint floor_texture;
+AssetTexture* floor_texture;
+// static geometry keeps pointing at these until it's batched
+MeshData floor_mesh_data;
+MeshData prop_mesh_data;
 glm::vec3 light_pos = glm::vec3(-5.0f, 10.0f, 1.0f);
-Model car_model;
+Model* car_model;
+// the other army drives Car 02, painted in each team's colors
+Model* team_car_model;
+ModelSkins team_car_skins;
+bool team_car_skinned;
 
-ModelTransform car_transform;
+unsigned int scene_army_size = 1;
+unsigned int scene_prop_count = 0;
+std::vector<ModelTransform> car_transforms;
+std::vector<ModelTransform> team_car_transforms;
+// every unit of both armies, car_transforms first and then team_car_transforms. built by scene_init and refit as units move
+Bvh unit_bvh;
+std::vector<glm::vec3> unit_bounds_min;
+std::vector<glm::vec3> unit_bounds_max;
+std::vector<unsigned int> visible_units;
+std::vector<unsigned int> visible_cars;
+std::vector<unsigned int> visible_team_cars;
 
+void scene_cube_mesh_data(MeshData* mesh_data, glm::vec3 size);
+void scene_unit_bounds(std::vector<glm::vec3>* bounds_min, std::vector<glm::vec3>* bounds_max);
 void scene_generate_cube(GLuint* vao, glm::vec3 size);
 
 void scene_init() {
     keys = SDL_GetKeyboardState(NULL);
 
-    glUseProgram(shader);
-    glm::mat4 projection = glm::mat4(1.0f);
-    projection = glm::perspective(glm::radians(45.0f), (float)SCREEN_WIDTH / float(SCREEN_HEIGHT), 0.1f, 100.0f);
-    glUniformMatrix4fv(glGetUniformLocation(shader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    glUniform1i(glGetUniformLocation(shader, "model_texture"), 0);
-    
-    // light uniforms
-    glUniform3fv(glGetUniformLocation(shader, "point_light.position"), 1, glm::value_ptr(light_pos));
-    glUniform1f(glGetUniformLocation(shader, "point_light.constant"), 1.0f);
-    glUniform1f(glGetUniformLocation(shader, "point_light.linear"), 0.022f);
-    glUniform1f(glGetUniformLocation(shader, "point_light.quadratic"), 0.0019f);
-
-    glUseProgram(light_shader);
-    glUniformMatrix4fv(glGetUniformLocation(light_shader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    camera_projection = glm::perspective(glm::radians(45.0f), (float)SCREEN_WIDTH / float(SCREEN_HEIGHT), CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
+    model_lod_projection_scale = (float)SCREEN_HEIGHT / (2.0f * std::tan(glm::radians(45.0f) / 2.0f));
 
-    model_load(&car_model, "./res/car/car.obj");
+    // these show up once they finish streaming in. until then the car has no meshes and the floor uses the null texture
+    car_model = asset_model_stream("./res/car/car.obj");
+    team_car_model = asset_model_stream("./res/Car 02/Car2.obj");
+    team_car_skinned = model_skins_load(&team_car_skins, "car2_mat", {
+        "./res/Car 02/car2.png",
+        "./res/Car 02/car2_black.png",
+        "./res/Car 02/car2_red.png"
+    });
+    floor_texture = asset_texture_stream("./res/floor.png");
     scene_generate_cube(&cube_vao, glm::vec3(0.5f));
-    scene_generate_cube(&floor_vao, glm::vec3(100.0f, 0.01f, 100.0f));
-    model_texture_load(&floor_texture, "./res/floor.png");
 
-    car_transform.mesh["Wheel1"] = Transform();
-    car_transform.base.rotate(3.14f / 4.0f, car_transform.base.get_zbasis());
+    // the floor and props never move, so they're baked into static batches
+    scene_cube_mesh_data(&floor_mesh_data, glm::vec3(100.0f, 0.01f, 100.0f));
+    static_batch_add(&floor_mesh_data, static_batch_material((StaticBatchMaterial) {
+        .map_ka = floor_texture,
+        .map_kd = NULL,
+        .ka = glm::vec3(0.5f),
+        .kd = glm::vec3(0.8f),
+        .ks = glm::vec3(1.0f)
+    }), glm::mat4(1.0f));
+    scene_cube_mesh_data(&prop_mesh_data, glm::vec3(0.5f));
+    unsigned int prop_material = static_batch_material((StaticBatchMaterial) {
+        .map_ka = floor_texture,
+        .map_kd = floor_texture,
+        .ka = glm::vec3(0.3f),
+        .kd = glm::vec3(0.6f),
+        .ks = glm::vec3(0.2f)
+    });
+    // a fixed seed, so the props land in the same places every run
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> random_position(-95.0f, 95.0f);
+    std::uniform_real_distribution<float> random_size(0.3f, 1.5f);
+    std::uniform_real_distribution<float> random_angle(0.0f, 6.283f);
+    for (unsigned int i = 0; i < scene_prop_count; i++) {
+        glm::vec3 size = glm::vec3(random_size(random), random_size(random), random_size(random));
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(random_position(random), size.y * 0.5f, random_position(random)));
+        transform = glm::rotate(transform, random_angle(random), glm::vec3(0.0f, 1.0f, 0.0f));
+        static_batch_add(&prop_mesh_data, prop_material, glm::scale(transform, size));
+        // props are solid boxes, so they're their own occluders
+        occlusion_add_box(glm::scale(transform, size), glm::vec3(-0.5f), glm::vec3(0.5f));
+    }
+    static_batch_build();
+
+    // the first car sits at the origin and the rest of the army lines up in rows behind it
+    const float ARMY_SPACING = 4.0f;
+    unsigned int army_columns = (unsigned int)std::ceil(std::sqrt((float)scene_army_size));
+    car_transforms.resize(scene_army_size);
+    for (unsigned int i = 0; i < scene_army_size; i++) {
+        ModelTransform& car_transform = car_transforms[i];
+        car_transform.mesh["Wheel1"] = Transform();
+        car_transform.base.rotate(3.14f / 4.0f, car_transform.base.get_zbasis());
+        car_transform.base.origin = glm::vec3((float)(i % army_columns) * ARMY_SPACING, 0.0f, -(float)(i / army_columns) * ARMY_SPACING);
+    }
+
+    // the team army lines up the same way to the left, with the teams taking turns
+    const float TEAM_ARMY_SPACING = 8.0f;
+    team_car_transforms.resize(scene_army_size);
+    for (unsigned int i = 0; i < scene_army_size; i++) {
+        ModelTransform& team_car_transform = team_car_transforms[i];
+        team_car_transform.base.origin = glm::vec3(-(float)(1 + (i % army_columns)) * TEAM_ARMY_SPACING, 0.0f, -(float)(i / army_columns) * TEAM_ARMY_SPACING);
+        team_car_transform.skin = team_car_skinned ? i % team_car_skins.count : 0;
+    }
+
+    scene_unit_bounds(&unit_bounds_min, &unit_bounds_max);
+    bvh_build(&unit_bvh, unit_bounds_min, unit_bounds_max);
 }
 
 void scene_handle_input(SDL_Event e) {
@@ -102,51 +182,124 @@ void scene_update(float delta) {
     
     camera_position += camera_velocity * CAMERA_SPEED * delta;
 
-    car_transform.mesh["Wheel1"].rotate(0.1f * delta, glm::vec3(1.0f, 0.0f, 0.0f));
+    for (ModelTransform& car_transform : car_transforms) {
+        car_transform.mesh["Wheel1"].rotate(0.1f * delta, glm::vec3(1.0f, 0.0f, 0.0f));
+    }
+
+    // units report where they are every frame, which also picks up their models' real size once they finish streaming in
+    scene_unit_bounds(&unit_bounds_min, &unit_bounds_max);
+    for (unsigned int i = 0; i < unit_bounds_min.size(); i++) {
+        bvh_update(&unit_bvh, i, unit_bounds_min[i], unit_bounds_max[i]);
+    }
+    bvh_refit(&unit_bvh);
 }
 
 void scene_render() {
     // setup shader
-    glActiveTexture(GL_TEXTURE0);
-    glBlendFunc(GL_ONE, GL_ZERO);
-    glm::mat4 view = glm::lookAt(camera_position, camera_position + camera_front, camera_up);
-    glUseProgram(shader);
-    glUniformMatrix4fv(glGetUniformLocation(shader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniform3fv(glGetUniformLocation(shader, "view_pos"), 1, glm::value_ptr(camera_position));
-
-    // render car
-    model_render(car_model, car_transform);
-
-    // render floor
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, floor_texture);
-    glActiveTexture(GL_TEXTURE0 + 1);
-    glBindTexture(GL_TEXTURE_2D, model_null_texture);
-    glm::mat4 floor_model = glm::mat4(1.0f);
-    glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, glm::value_ptr(floor_model));
-    glUniform3fv(glGetUniformLocation(shader, "material.ka"), 1, glm::value_ptr(glm::vec3(0.5)));
-    glUniform3fv(glGetUniformLocation(shader, "material.kd"), 1, glm::value_ptr(glm::vec3(0.8)));
-    glUniform3fv(glGetUniformLocation(shader, "material.ks"), 1, glm::value_ptr(glm::vec3(1.0)));
-    glUniform1i(glGetUniformLocation(shader, "material.map_ka"), 0);
-    glUniform1i(glGetUniformLocation(shader, "material.map_kd"), 1);
-    glBindVertexArray(floor_vao);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-
-    // render light
-    glUseProgram(light_shader);
-    glUniformMatrix4fv(glGetUniformLocation(light_shader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniform3fv(glGetUniformLocation(light_shader, "view_pos"), 1, glm::value_ptr(camera_position));
-    glm::mat4 light_model = glm::mat4(1.0f);
-    light_model = glm::translate(light_model, light_pos);
-    light_model = glm::scale(light_model, glm::vec3(0.25f));
-    glUniformMatrix4fv(glGetUniformLocation(light_shader, "model"), 1, GL_FALSE, glm::value_ptr(light_model));
-    glBindVertexArray(cube_vao);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+    gl_state_blend_func(GL_ONE, GL_ZERO);
+    ShaderFrameBlock frame;
+    frame.projection = camera_projection;
+    frame.view = glm::lookAt(camera_position, camera_position + camera_front, camera_up);
+    frame.view_pos = camera_position;
+    frame.padding = 0.0f;
+    shader_block_update(SHADER_BLOCK_FRAME, &frame);
+    ShaderLightingBlock lighting;
+    lighting.point_light = (ShaderPointLight) {
+        .position = light_pos,
+        .constant = 1.0f,
+        .linear = 0.022f,
+        .quadratic = 0.0019f,
+        .padding = { 0.0f, 0.0f }
+    };
+    shader_block_update(SHADER_BLOCK_LIGHTING, &lighting);
+    render_queue_begin(camera_position, camera_front, CAMERA_FAR_PLANE);
+    cull_begin(frame.projection * frame.view);
+    occlusion_render(frame.projection * frame.view);
+    occlusion_query_begin(camera_position, CAMERA_NEAR_PLANE);
+
+    // units in view come out of the hierarchy and are checked against the occluders, then each of their meshes is culled on its own
+    if (cull_enabled) {
+        bvh_query_frustum(unit_bvh, cull_camera_frustum, &visible_units);
+    } else {
+        visible_units.resize(unit_bvh.items.size());
+        for (unsigned int i = 0; i < visible_units.size(); i++) {
+            visible_units[i] = i;
+        }
+    }
+    // sorted so that instances keep the same order from frame to frame
+    std::sort(visible_units.begin(), visible_units.end());
+    visible_cars.clear();
+    visible_team_cars.clear();
+    for (unsigned int unit : visible_units) {
+        if (!occlusion_visible_box(unit_bvh.item_min[unit], unit_bvh.item_max[unit])) {
+            continue;
+        }
+        if (unit < car_transforms.size()) {
+            visible_cars.push_back(unit);
+        } else {
+            visible_team_cars.push_back(unit - car_transforms.size());
+        }
+    }
+
+    // car
+    model_lod_camera_position = camera_position;
+    model_render_instanced(*car_model, car_transforms, visible_cars, NULL);
+    model_render_instanced(*team_car_model, team_car_transforms, visible_team_cars, team_car_skinned ? &team_car_skins : NULL);
+
+    // floor and props
+    static_batch_render();
+
+    // light
+    RenderPacket light_packet;
+    light_packet.pass = RENDER_PASS_OPAQUE;
+    light_packet.program = &light_shader;
+    light_packet.vao = cube_vao;
+    light_packet.texture[0] = 0;
+    light_packet.texture[1] = 0;
+    light_packet.skin_texture = 0;
+    light_packet.model = glm::scale(glm::translate(glm::mat4(1.0f), light_pos), glm::vec3(0.25f));
+    light_packet.instance_count = 0;
+    light_packet.instance_first = 0;
+    light_packet.position_scale = glm::vec3(1.0f);
+    light_packet.skin = 0.0f;
+    light_packet.octahedral_normal = false;
+    light_packet.ka = glm::vec3(0.5f);
+    light_packet.kd = glm::vec3(0.8f);
+    light_packet.ks = glm::vec3(1.0f);
+    light_packet.index_type = 0;
+    light_packet.first = 0;
+    light_packet.count = 36;
+    light_packet.base_vertex = 0;
+    light_packet.condition_query = 0;
+    render_queue_submit(light_packet);
+
+    render_queue_execute();
+    // against this frame's depth, for next frame's draws
+    occlusion_query_issue();
 }
 
-void scene_generate_cube(GLuint* vao, glm::vec3 size) {
+// world space boxes of every unit, in unit_bvh order
+void scene_unit_bounds(std::vector<glm::vec3>* bounds_min, std::vector<glm::vec3>* bounds_max) {
+    glm::vec3 car_min;
+    glm::vec3 car_max;
+    glm::vec3 team_car_min;
+    glm::vec3 team_car_max;
+    model_bounds(*car_model, &car_min, &car_max);
+    model_bounds(*team_car_model, &team_car_min, &team_car_max);
+
+    bounds_min->resize(car_transforms.size() + team_car_transforms.size());
+    bounds_max->resize(bounds_min->size());
+    for (unsigned int i = 0; i < car_transforms.size(); i++) {
+        cull_box_transform(&(*bounds_min)[i], &(*bounds_max)[i], car_transforms[i].base.to_model(), car_min, car_max);
+    }
+    for (unsigned int i = 0; i < team_car_transforms.size(); i++) {
+        unsigned int unit = car_transforms.size() + i;
+        cull_box_transform(&(*bounds_min)[unit], &(*bounds_max)[unit], team_car_transforms[i].base.to_model(), team_car_min, team_car_max);
+    }
+}
+
+// 36 vertices, two triangles per face
+void scene_cube_vertices(std::vector<VertexData>* cube_vertices, glm::vec3 size) {
     float vertices[] = {
         // positions          // normals           // texture coords
         -size.x, -size.y, -size.z,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
@@ -192,12 +345,38 @@ void scene_generate_cube(GLuint* vao, glm::vec3 size) {
         -size.x,  size.y, -size.z,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
     };
 
+    cube_vertices->resize(36);
+    for (unsigned int i = 0; i < 36; i++) {
+        (*cube_vertices)[i] = (VertexData) {
+            .position = glm::vec3(vertices[(i * 8) + 0], vertices[(i * 8) + 1], vertices[(i * 8) + 2]),
+            .normal = glm::vec3(vertices[(i * 8) + 3], vertices[(i * 8) + 4], vertices[(i * 8) + 5]),
+            .texture_coordinates = glm::vec2(vertices[(i * 8) + 6], vertices[(i * 8) + 7])
+        };
+    }
+}
+
+void scene_cube_mesh_data(MeshData* mesh_data, glm::vec3 size) {
+    scene_cube_vertices(&mesh_data->vertices, size);
+    mesh_data->indices.resize(36);
+    for (unsigned int i = 0; i < 36; i++) {
+        mesh_data->indices[i] = i;
+    }
+    mesh_data->lod.clear();
+    mesh_data->offset = glm::vec3(0.0f);
+    mesh_data->bounds_min = -size;
+    mesh_data->bounds_max = size;
+}
+
+void scene_generate_cube(GLuint* vao, glm::vec3 size) {
+    std::vector<VertexData> vertices;
+    scene_cube_vertices(&vertices, size);
+
     GLuint vbo;
     glGenVertexArrays(1, vao);
     glGenBuffers(1, &vbo);
-    glBindVertexArray(*vao);
+    gl_state_bind_vertex_array(*vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(VertexData), &vertices[0], GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
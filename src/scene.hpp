@@ -2,6 +2,11 @@
 
 #include <SDL2/SDL.h>
 
+// number of cars to draw, set before scene_init
+extern unsigned int scene_army_size;
+// number of static props scattered over the floor, set before scene_init
+extern unsigned int scene_prop_count;
+
 void scene_init();
 void scene_handle_input(SDL_Event e);
 void scene_update(float delta);
@@ -1,22 +1,63 @@
 #include "shader.hpp"
 
+#include "upload_ring.hpp"
+
 #include <fstream>
 #include <cstdio>
 #include <fstream>
 #include <map>
 #include <vector>
+#include <cstddef>
 
-GLuint shader;
-GLuint text_shader;
-GLuint screen_shader;
-GLuint light_shader;
+ShaderProgram shader;
+ShaderProgram text_shader;
+ShaderProgram screen_shader;
+ShaderProgram light_shader;
 
 const std::map<std::string, GLenum> SHADER_TYPE = {
     { "vertex", GL_VERTEX_SHADER },
     { "fragment", GL_FRAGMENT_SHADER }
 };
 
-bool shader_compile(unsigned int* id, const char* path);
+struct ShaderBlockName {
+    const char* name;
+    std::size_t size;
+};
+
+// indexed by ShaderBlock
+const ShaderBlockName SHADER_BLOCK_NAME[SHADER_BLOCK_COUNT] = {
+    { "Frame", sizeof(ShaderFrameBlock) },
+    { "Lighting", sizeof(ShaderLightingBlock) }
+};
+
+struct ShaderUniformName {
+    const char* name;
+    GLenum type;
+};
+
+// indexed by ShaderUniform
+const ShaderUniformName SHADER_UNIFORM_NAME[SHADER_UNIFORM_COUNT] = {
+    { "model", GL_FLOAT_MAT4 },
+    { "instanced", GL_BOOL },
+    { "position_scale", GL_FLOAT_VEC3 },
+    { "octahedral_normal", GL_BOOL },
+    { "material.ka", GL_FLOAT_VEC3 },
+    { "material.kd", GL_FLOAT_VEC3 },
+    { "material.ks", GL_FLOAT_VEC3 },
+    { "material.map_ka", GL_SAMPLER_2D },
+    { "material.map_kd", GL_SAMPLER_2D },
+    { "skinned", GL_BOOL },
+    { "skin_layer", GL_FLOAT },
+    { "skin_map", GL_SAMPLER_2D_ARRAY },
+    { "screen_texture", GL_SAMPLER_2D },
+    { "screen_size", GL_FLOAT_VEC2 },
+    { "render_size", GL_FLOAT_VEC2 },
+    { "atlas_size", GL_FLOAT_VEC2 },
+    { "u_texture", GL_SAMPLER_2D }
+};
+
+bool shader_compile(ShaderProgram* program, const char* path);
+bool shader_reflect(ShaderProgram* program, const char* path);
 
 bool shader_init() {
     if (!shader_compile(&shader, "./shader/shader.glsl")) {
@@ -35,7 +76,12 @@ bool shader_init() {
     return true;
 }
 
-bool shader_compile(unsigned int* id, const char* path) {
+void shader_block_update(ShaderBlock block, const void* data) {
+    UploadRingRange range = upload_ring_upload(data, SHADER_BLOCK_NAME[block].size, upload_ring_uniform_alignment);
+    glBindBufferRange(GL_UNIFORM_BUFFER, block, range.buffer, range.offset, SHADER_BLOCK_NAME[block].size);
+}
+
+bool shader_compile(ShaderProgram* program_data, const char* path) {
     std::ifstream shader_file;
     std::string line;
     std::string version_string;
@@ -106,6 +152,68 @@ bool shader_compile(unsigned int* id, const char* path) {
         glDeleteShader(itr->second.id);
     }
 
-    *id = program;
+    program_data->id = program;
+    return shader_reflect(program_data, path);
+}
+
+bool shader_reflect(ShaderProgram* program, const char* path) {
+    GLint uniform_count;
+    GLint max_name_length;
+    glGetProgramiv(program->id, GL_ACTIVE_UNIFORMS, &uniform_count);
+    glGetProgramiv(program->id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+    // 4.1 has no binding layout qualifier, so blocks are bound to their binding points by name
+    for (unsigned int i = 0; i < SHADER_BLOCK_COUNT; i++) {
+        GLuint block_index = glGetUniformBlockIndex(program->id, SHADER_BLOCK_NAME[i].name);
+        if (block_index == GL_INVALID_INDEX) {
+            continue;
+        }
+        GLint block_size;
+        glGetActiveUniformBlockiv(program->id, block_index, GL_UNIFORM_BLOCK_DATA_SIZE, &block_size);
+        // drivers may leave off the padding at the end, but a larger block means the struct is out of sync with the shader
+        if ((std::size_t)block_size > SHADER_BLOCK_NAME[i].size) {
+            printf("Error: uniform block %s of shader %s needs %i bytes but the renderer uploads %zu bytes.\n", SHADER_BLOCK_NAME[i].name, path, block_size, SHADER_BLOCK_NAME[i].size);
+            return false;
+        }
+        glUniformBlockBinding(program->id, block_index, i);
+    }
+
+    program->active_uniform.clear();
+    std::vector<char> name_buffer(max_name_length + 1);
+    for (GLint i = 0; i < uniform_count; i++) {
+        GLsizei name_length;
+        ShaderUniformInfo info;
+        glGetActiveUniform(program->id, i, name_buffer.size(), &name_length, &info.size, &info.type, &name_buffer[0]);
+        std::string name(&name_buffer[0], name_length);
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            name.erase(name.size() - 3);
+        }
+        // uniforms in blocks have no location of their own
+        info.location = glGetUniformLocation(program->id, name.c_str());
+        program->active_uniform[name] = info;
+    }
+
+    for (unsigned int i = 0; i < SHADER_UNIFORM_COUNT; i++) {
+        program->uniform[i] = -1;
+        std::map<std::string, ShaderUniformInfo>::iterator it = program->active_uniform.find(SHADER_UNIFORM_NAME[i].name);
+        if (it == program->active_uniform.end()) {
+            continue;
+        }
+        if (it->second.type != SHADER_UNIFORM_NAME[i].type) {
+            printf("Error: uniform %s of shader %s is declared with type 0x%x but the renderer sets it as type 0x%x.\n", SHADER_UNIFORM_NAME[i].name, path, it->second.type, SHADER_UNIFORM_NAME[i].type);
+            return false;
+        }
+        program->uniform[i] = it->second.location;
+    }
+
     return true;
 }
+
+GLint shader_uniform_location(const ShaderProgram& program, std::string name) {
+    std::map<std::string, ShaderUniformInfo>::const_iterator it = program.active_uniform.find(name);
+    if (it == program.active_uniform.end()) {
+        return -1;
+    }
+
+    return it->second.location;
+}
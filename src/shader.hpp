@@ -1,12 +1,84 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 
 #include <string>
+#include <map>
 
-extern GLuint shader;
-extern GLuint text_shader;
-extern GLuint screen_shader;
-extern GLuint light_shader;
+// Every uniform the renderer sets. Programs look up the location of each one when they're linked,
+// so setting a uniform never goes through the driver's name lookup.
+enum ShaderUniform {
+    SHADER_UNIFORM_MODEL,
+    SHADER_UNIFORM_INSTANCED,
+    SHADER_UNIFORM_POSITION_SCALE,
+    SHADER_UNIFORM_OCTAHEDRAL_NORMAL,
+    SHADER_UNIFORM_MATERIAL_KA,
+    SHADER_UNIFORM_MATERIAL_KD,
+    SHADER_UNIFORM_MATERIAL_KS,
+    SHADER_UNIFORM_MATERIAL_MAP_KA,
+    SHADER_UNIFORM_MATERIAL_MAP_KD,
+    SHADER_UNIFORM_SKINNED,
+    SHADER_UNIFORM_SKIN_LAYER,
+    SHADER_UNIFORM_SKIN_MAP,
+    SHADER_UNIFORM_SCREEN_TEXTURE,
+    SHADER_UNIFORM_SCREEN_SIZE,
+    SHADER_UNIFORM_RENDER_SIZE,
+    SHADER_UNIFORM_ATLAS_SIZE,
+    SHADER_UNIFORM_U_TEXTURE,
+    SHADER_UNIFORM_COUNT
+};
+
+// Uniform blocks shared by every program. Each one is bound to the binding point of the same number and
+// backed by a single buffer, so it's uploaded once a frame no matter how many programs read it.
+enum ShaderBlock {
+    SHADER_BLOCK_FRAME,
+    SHADER_BLOCK_LIGHTING,
+    SHADER_BLOCK_COUNT
+};
+
+// these mirror the std140 layout of the blocks
+struct ShaderFrameBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 view_pos;
+    float padding;
+};
+
+struct ShaderPointLight {
+    glm::vec3 position;
+    float constant;
+    float linear;
+    float quadratic;
+    float padding[2];
+};
+
+struct ShaderLightingBlock {
+    ShaderPointLight point_light;
+};
+
+struct ShaderUniformInfo {
+    GLint location;
+    GLenum type;
+    // number of elements for arrays, 1 otherwise
+    GLint size;
+};
+
+struct ShaderProgram {
+    GLuint id;
+    // every active uniform as reported by the driver, with array names trimmed of their [0]
+    std::map<std::string, ShaderUniformInfo> active_uniform;
+    // location of each ShaderUniform, or -1 if the program doesn't use it. setting a uniform at -1 does nothing
+    GLint uniform[SHADER_UNIFORM_COUNT];
+};
+
+extern ShaderProgram shader;
+extern ShaderProgram text_shader;
+extern ShaderProgram screen_shader;
+extern ShaderProgram light_shader;
 
 bool shader_init();
+// uploads the block for every program that uses it. the upload only lasts the frame, so every block has to be updated every frame
+void shader_block_update(ShaderBlock block, const void* data);
+// looks a uniform up in the reflected uniforms, for ones that aren't in ShaderUniform. returns -1 if it isn't active
+GLint shader_uniform_location(const ShaderProgram& program, std::string name);
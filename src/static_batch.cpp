@@ -0,0 +1,213 @@
+#include "static_batch.hpp"
+
+#include "mesh_buffer.hpp"
+#include "render_queue.hpp"
+#include "shader.hpp"
+#include "cull.hpp"
+#include "occlusion_query.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <map>
+#include <tuple>
+#include <cmath>
+#include <cstdio>
+
+struct StaticBatchObject {
+    const MeshData* mesh_data;
+    unsigned int material;
+    glm::mat4 transform;
+};
+
+// material, then chunk x, y and z
+typedef std::tuple<unsigned int, int, int, int> StaticBatchKey;
+typedef std::tuple<int, int, int> StaticBatchChunk;
+
+std::vector<StaticBatch> static_batches;
+std::vector<StaticBatchMaterial> static_batch_materials;
+// bounds of every batch, in the same order
+CullBoxes static_batch_bounds;
+std::vector<unsigned int> static_batch_visible;
+// added since the last static_batch_build
+std::vector<StaticBatchObject> static_batch_objects;
+
+unsigned int static_batch_material(const StaticBatchMaterial& material) {
+    for (unsigned int i = 0; i < static_batch_materials.size(); i++) {
+        const StaticBatchMaterial& other = static_batch_materials[i];
+        if (other.map_ka == material.map_ka && other.map_kd == material.map_kd && other.ka == material.ka && other.kd == material.kd && other.ks == material.ks) {
+            return i;
+        }
+    }
+    static_batch_materials.push_back(material);
+
+    return static_batch_materials.size() - 1;
+}
+
+void static_batch_add(const MeshData* mesh_data, unsigned int material, const glm::mat4& transform) {
+    static_batch_objects.push_back((StaticBatchObject) {
+        .mesh_data = mesh_data,
+        .material = material,
+        // imported meshes are centered around 0 with their real position in offset
+        .transform = glm::translate(transform, mesh_data->offset)
+    });
+}
+
+// the range of mesh_data.indices making up the finest level of detail
+static void static_batch_lod_range(const MeshData& mesh_data, unsigned int* index_offset, unsigned int* index_count) {
+    if (mesh_data.lod.empty()) {
+        *index_offset = 0;
+        *index_count = mesh_data.indices.size();
+    } else {
+        *index_offset = mesh_data.lod[0].index_offset;
+        *index_count = mesh_data.lod[0].index_count;
+    }
+}
+
+void static_batch_build() {
+    std::map<StaticBatchKey, std::vector<unsigned int>> groups;
+    for (unsigned int i = 0; i < static_batch_objects.size(); i++) {
+        const StaticBatchObject& object = static_batch_objects[i];
+        glm::vec3 center = glm::vec3(object.transform * glm::vec4((object.mesh_data->bounds_min + object.mesh_data->bounds_max) * 0.5f, 1.0f));
+        glm::ivec3 chunk = glm::ivec3(glm::floor(center / STATIC_BATCH_CHUNK_SIZE));
+        groups[StaticBatchKey(object.material, chunk.x, chunk.y, chunk.z)].push_back(i);
+    }
+
+    std::vector<VertexData> vertices;
+    std::vector<unsigned int> indices;
+    unsigned int first_batch = static_batches.size();
+    // bounds of every chunk built, which become its occlusion query group once all of its batches are done
+    std::map<StaticBatchChunk, unsigned int> chunks;
+    std::vector<glm::vec3> chunk_min;
+    std::vector<glm::vec3> chunk_max;
+    for (std::map<StaticBatchKey, std::vector<unsigned int>>::iterator it = groups.begin(); it != groups.end(); ++it) {
+        vertices.clear();
+        indices.clear();
+        glm::vec3 bounds_min = glm::vec3(INFINITY);
+        glm::vec3 bounds_max = glm::vec3(-INFINITY);
+        for (unsigned int object_index : it->second) {
+            const StaticBatchObject& object = static_batch_objects[object_index];
+            const MeshData& mesh_data = *object.mesh_data;
+            glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(object.transform)));
+            unsigned int base_vertex = vertices.size();
+            for (const VertexData& vertex : mesh_data.vertices) {
+                glm::vec3 position = glm::vec3(object.transform * glm::vec4(vertex.position, 1.0f));
+                bounds_min = glm::min(bounds_min, position);
+                bounds_max = glm::max(bounds_max, position);
+                vertices.push_back((VertexData) {
+                    .position = position,
+                    .normal = glm::normalize(normal_matrix * vertex.normal),
+                    .texture_coordinates = vertex.texture_coordinates
+                });
+            }
+
+            unsigned int index_offset;
+            unsigned int index_count;
+            static_batch_lod_range(mesh_data, &index_offset, &index_count);
+            for (unsigned int i = index_offset; i < index_offset + index_count; i++) {
+                indices.push_back(base_vertex + mesh_data.indices[i]);
+            }
+        }
+        if (indices.empty()) {
+            continue;
+        }
+
+        StaticBatch batch;
+        batch.material = std::get<0>(it->first);
+        batch.center = (bounds_min + bounds_max) * 0.5f;
+        batch.bounds_min = bounds_min;
+        batch.bounds_max = bounds_max;
+        batch.object_count = it->second.size();
+        StaticBatchChunk chunk = StaticBatchChunk(std::get<1>(it->first), std::get<2>(it->first), std::get<3>(it->first));
+        std::map<StaticBatchChunk, unsigned int>::iterator chunk_it = chunks.find(chunk);
+        if (chunk_it == chunks.end()) {
+            chunk_it = chunks.insert(std::make_pair(chunk, (unsigned int)chunk_min.size())).first;
+            chunk_min.push_back(bounds_min);
+            chunk_max.push_back(bounds_max);
+        }
+        chunk_min[chunk_it->second] = glm::min(chunk_min[chunk_it->second], bounds_min);
+        chunk_max[chunk_it->second] = glm::max(chunk_max[chunk_it->second], bounds_max);
+        batch.occlusion_group = chunk_it->second;
+        for (VertexData& vertex : vertices) {
+            vertex.position -= batch.center;
+        }
+
+        batch.mesh.vertex_format = VERTEX_FORMAT_FLOAT;
+        batch.mesh.position_scale = glm::vec3(1.0f);
+        batch.mesh.offset = glm::vec3(0.0f);
+        model_mesh_bounds(&batch.mesh, bounds_min - batch.center, bounds_max - batch.center);
+        batch.mesh.lod.push_back((MeshLod) {
+            .index_offset = 0,
+            .index_count = (unsigned int)indices.size(),
+            .error = 0.0f
+        });
+        if (vertices.size() <= 0xffff) {
+            std::vector<GLushort> short_indices(indices.begin(), indices.end());
+            model_mesh_upload(&batch.mesh, &vertices[0], vertices.size(), &short_indices[0], short_indices.size(), GL_UNSIGNED_SHORT);
+        } else {
+            model_mesh_upload(&batch.mesh, &vertices[0], vertices.size(), &indices[0], indices.size(), GL_UNSIGNED_INT);
+        }
+        static_batches.push_back(batch);
+        cull_boxes_add(&static_batch_bounds, batch.bounds_min, batch.bounds_max);
+    }
+    std::vector<unsigned int> chunk_groups;
+    for (unsigned int i = 0; i < chunk_min.size(); i++) {
+        chunk_groups.push_back(occlusion_query_group_create(chunk_min[i], chunk_max[i]));
+    }
+    for (unsigned int i = first_batch; i < static_batches.size(); i++) {
+        static_batches[i].occlusion_group = chunk_groups[static_batches[i].occlusion_group];
+    }
+
+    printf("Static batching merged %u objects into %u batches\n", (unsigned int)static_batch_objects.size(), (unsigned int)(static_batches.size() - first_batch));
+    static_batch_objects.clear();
+}
+
+static GLuint static_batch_texture(const AssetTexture* texture) {
+    return texture != NULL && texture->texture != 0 ? texture->texture : model_null_texture;
+}
+
+void static_batch_render() {
+    cull_visible_boxes(static_batch_bounds, &static_batch_visible);
+    for (unsigned int i : static_batch_visible) {
+        const StaticBatch& batch = static_batches[i];
+        const StaticBatchMaterial& material = static_batch_materials[batch.material];
+        GLuint condition_query;
+        if (!occlusion_query_group_visible(batch.occlusion_group, &condition_query)) {
+            continue;
+        }
+
+        RenderPacket packet;
+        packet.pass = RENDER_PASS_OPAQUE;
+        packet.program = &shader;
+        packet.vao = batch.mesh.vao;
+        // if no ambient map, try using diffuse map
+        packet.texture[0] = static_batch_texture(material.map_ka != NULL ? material.map_ka : material.map_kd);
+        packet.texture[1] = static_batch_texture(material.map_kd);
+        packet.skin_texture = 0;
+        packet.model = glm::translate(glm::mat4(1.0f), batch.center);
+        packet.instance_count = 0;
+        packet.instance_first = 0;
+        packet.position_scale = batch.mesh.position_scale;
+        packet.skin = 0.0f;
+        packet.octahedral_normal = false;
+        packet.ka = material.ka;
+        packet.kd = material.kd;
+        packet.ks = material.ks;
+        packet.index_type = batch.mesh.index_type;
+        packet.first = batch.mesh.first_index;
+        packet.count = batch.mesh.index_count;
+        packet.base_vertex = batch.mesh.base_vertex;
+        packet.condition_query = condition_query;
+        render_queue_submit(packet);
+    }
+}
+
+void static_batch_clear() {
+    for (const StaticBatch& batch : static_batches) {
+        mesh_buffer_free(batch.mesh);
+    }
+    static_batches.clear();
+    cull_boxes_clear(&static_batch_bounds);
+    // static batches are the only groups there are
+    occlusion_query_group_clear();
+    static_batch_materials.clear();
+    static_batch_objects.clear();
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "model.hpp"
+#include "asset.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Scenery that never moves, baked into world space and merged into one mesh per material and chunk of the world.
+// Objects are added one by one, then static_batch_build merges everything added since the last build,
+// so a map with thousands of props costs a draw per material per chunk rather than one per prop.
+// Chunks keep every batch small enough in space to be culled on its own, and the batches of a chunk share an occlusion query group.
+
+// width of a chunk in world units. objects go in the chunk holding the center of their bounds
+const float STATIC_BATCH_CHUNK_SIZE = 32.0f;
+
+struct StaticBatchMaterial {
+    // looked up when drawing since they may still be streaming in, NULL for the null texture
+    AssetTexture* map_ka;
+    AssetTexture* map_kd;
+    glm::vec3 ka;
+    glm::vec3 kd;
+    glm::vec3 ks;
+};
+
+struct StaticBatch {
+    unsigned int material;
+    // float vertices relative to center, so positions far from the origin keep their precision
+    Mesh mesh;
+    glm::vec3 center;
+    // world space
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    unsigned int object_count;
+    // see occlusion_query.hpp
+    unsigned int occlusion_group;
+};
+
+extern std::vector<StaticBatch> static_batches;
+
+// returns the index of an identical material if there is one. the textures must outlive the batches
+unsigned int static_batch_material(const StaticBatchMaterial& material);
+// only the finest level of detail is used. mesh_data must stay alive until static_batch_build.
+// transform is that of the whole model, and the mesh's offset is applied before it
+void static_batch_add(const MeshData* mesh_data, unsigned int material, const glm::mat4& transform);
+void static_batch_build();
+void static_batch_render();
+// frees every batch and material
+void static_batch_clear();
\ No newline at end of file
@@ -0,0 +1,753 @@
+#include "texture.hpp"
+
+#include "cache.hpp"
+#include "worker.hpp"
+#include "gl_state.hpp"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+// the gl loader only covers the 4.1 core profile, so the S3TC formats and glTexStorage2D/3D are declared here
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+typedef void (APIENTRYP TextureStorage2DFunction)(GLenum target, GLsizei levels, GLenum internal_format, GLsizei width, GLsizei height);
+typedef void (APIENTRYP TextureStorage3DFunction)(GLenum target, GLsizei levels, GLenum internal_format, GLsizei width, GLsizei height, GLsizei depth);
+
+// KTX2 is little endian and so are all of our targets, so the file is read and written in native byte order
+static const unsigned char TEXTURE_KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint32_t TEXTURE_VK_FORMAT_R8G8B8A8_UNORM = 37;
+static const uint32_t TEXTURE_VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+static const uint32_t TEXTURE_VK_FORMAT_BC3_UNORM_BLOCK = 137;
+static const char* TEXTURE_SOURCE_KEY = "AdvancedSource";
+static const char* TEXTURE_WRITER_KEY = "KTXwriter";
+static const char* TEXTURE_WRITER = "advanced texture cooker";
+static const char* TEXTURE_CACHE_EXTENSION = ".ktx2";
+// bump whenever the cooker changes what ends up in the cache
+static const uint32_t TEXTURE_COOK_VERSION = 1;
+static const std::size_t TEXTURE_LEVEL_ALIGNMENT = 16;
+
+struct TextureKtx2Header {
+    unsigned char identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+};
+
+struct TextureKtx2LevelIndex {
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+};
+
+// value of the source key, which ties the cooked file to the image it was cooked from
+struct TextureCookSource {
+    int64_t modified_time;
+    uint64_t size;
+    uint32_t version;
+    uint32_t padding;
+};
+
+bool texture_compression_supported = false;
+bool texture_storage_supported = false;
+TextureStorage2DFunction texture_storage_2d = NULL;
+TextureStorage3DFunction texture_storage_3d = NULL;
+
+bool texture_init() {
+    GLint major_version;
+    GLint minor_version;
+    glGetIntegerv(GL_MAJOR_VERSION, &major_version);
+    glGetIntegerv(GL_MINOR_VERSION, &minor_version);
+    texture_storage_supported = major_version > 4 || (major_version == 4 && minor_version >= 2);
+
+    GLint extension_count;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+    for (GLint i = 0; i < extension_count; i++) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0) {
+            texture_compression_supported = true;
+        } else if (strcmp(extension, "GL_ARB_texture_storage") == 0) {
+            texture_storage_supported = true;
+        }
+    }
+    if (texture_storage_supported) {
+        texture_storage_2d = (TextureStorage2DFunction)SDL_GL_GetProcAddress("glTexStorage2D");
+        texture_storage_3d = (TextureStorage3DFunction)SDL_GL_GetProcAddress("glTexStorage3D");
+        texture_storage_supported = texture_storage_2d != NULL && texture_storage_3d != NULL;
+    }
+
+    printf("Texture compression %s, immutable texture storage %s\n", texture_compression_supported ? "S3TC" : "unavailable", texture_storage_supported ? "available" : "unavailable");
+
+    return true;
+}
+
+static unsigned int texture_format_block_dimension(TextureFormat format) {
+    return format == TEXTURE_FORMAT_RGBA8 ? 1 : 4;
+}
+
+static unsigned int texture_format_block_size(TextureFormat format) {
+    if (format == TEXTURE_FORMAT_BC1) {
+        return 8;
+    } else if (format == TEXTURE_FORMAT_BC3) {
+        return 16;
+    }
+    return 4;
+}
+
+static GLenum texture_format_internal_format(TextureFormat format) {
+    if (format == TEXTURE_FORMAT_BC1) {
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    } else if (format == TEXTURE_FORMAT_BC3) {
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+    return GL_RGBA8;
+}
+
+static uint32_t texture_format_vk_format(TextureFormat format) {
+    if (format == TEXTURE_FORMAT_BC1) {
+        return TEXTURE_VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    } else if (format == TEXTURE_FORMAT_BC3) {
+        return TEXTURE_VK_FORMAT_BC3_UNORM_BLOCK;
+    }
+    return TEXTURE_VK_FORMAT_R8G8B8A8_UNORM;
+}
+
+static std::size_t texture_format_level_size(TextureFormat format, unsigned int width, unsigned int height) {
+    unsigned int block_dimension = texture_format_block_dimension(format);
+    return (std::size_t)((width + block_dimension - 1) / block_dimension) * ((height + block_dimension - 1) / block_dimension) * texture_format_block_size(format);
+}
+
+static std::size_t texture_align(std::size_t offset) {
+    return (offset + TEXTURE_LEVEL_ALIGNMENT - 1) & ~(TEXTURE_LEVEL_ALIGNMENT - 1);
+}
+
+unsigned int texture_level_row_count(const TextureData& texture_data, unsigned int level) {
+    unsigned int block_dimension = texture_format_block_dimension(texture_data.format);
+    return (texture_data.level[level].height + block_dimension - 1) / block_dimension;
+}
+
+std::size_t texture_level_row_size(const TextureData& texture_data, unsigned int level) {
+    unsigned int block_dimension = texture_format_block_dimension(texture_data.format);
+    return (std::size_t)((texture_data.level[level].width + block_dimension - 1) / block_dimension) * texture_format_block_size(texture_data.format);
+}
+
+// box filters down to the next level, repeating the last row or column of odd sized levels
+static void texture_downsample(std::vector<unsigned char>* output, const std::vector<unsigned char>& input, unsigned int width, unsigned int height) {
+    unsigned int output_width = std::max(width / 2, 1u);
+    unsigned int output_height = std::max(height / 2, 1u);
+    output->resize((std::size_t)output_width * output_height * 4);
+    for (unsigned int y = 0; y < output_height; y++) {
+        unsigned int y0 = std::min(y * 2, height - 1);
+        unsigned int y1 = std::min((y * 2) + 1, height - 1);
+        for (unsigned int x = 0; x < output_width; x++) {
+            unsigned int x0 = std::min(x * 2, width - 1);
+            unsigned int x1 = std::min((x * 2) + 1, width - 1);
+            for (unsigned int channel = 0; channel < 4; channel++) {
+                unsigned int sum = input[(((std::size_t)y0 * width) + x0) * 4 + channel] + input[(((std::size_t)y0 * width) + x1) * 4 + channel] +
+                                   input[(((std::size_t)y1 * width) + x0) * 4 + channel] + input[(((std::size_t)y1 * width) + x1) * 4 + channel];
+                (*output)[(((std::size_t)y * output_width) + x) * 4 + channel] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+static uint16_t texture_pack_565(const float color[3]) {
+    int r = (int)(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void texture_unpack_565(uint16_t packed, int color[3]) {
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+static void texture_write_u16(unsigned char* output, uint16_t value) {
+    output[0] = value & 0xff;
+    output[1] = value >> 8;
+}
+
+// BC1 color block. the endpoints are the extremes of the block along its principal axis, pulled in a little since the extremes are rarely hit exactly
+static void texture_encode_color_block(const unsigned char block[16][4], unsigned char* output) {
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (unsigned int i = 0; i < 16; i++) {
+        for (unsigned int channel = 0; channel < 3; channel++) {
+            mean[channel] += block[i][channel] / 16.0f;
+        }
+    }
+    float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (unsigned int i = 0; i < 16; i++) {
+        float r = block[i][0] - mean[0];
+        float g = block[i][1] - mean[1];
+        float b = block[i][2] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+
+    // power iteration for the principal axis
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (unsigned int iteration = 0; iteration < 4; iteration++) {
+        float next[3] = {
+            (axis[0] * covariance[0]) + (axis[1] * covariance[1]) + (axis[2] * covariance[2]),
+            (axis[0] * covariance[1]) + (axis[1] * covariance[3]) + (axis[2] * covariance[4]),
+            (axis[0] * covariance[2]) + (axis[1] * covariance[4]) + (axis[2] * covariance[5])
+        };
+        float length = std::max(std::abs(next[0]), std::max(std::abs(next[1]), std::abs(next[2])));
+        if (length == 0.0f) {
+            break;
+        }
+        for (unsigned int channel = 0; channel < 3; channel++) {
+            axis[channel] = next[channel] / length;
+        }
+    }
+    float axis_length_squared = (axis[0] * axis[0]) + (axis[1] * axis[1]) + (axis[2] * axis[2]);
+
+    float min_t = 0.0f;
+    float max_t = 0.0f;
+    for (unsigned int i = 0; i < 16; i++) {
+        float t = (((block[i][0] - mean[0]) * axis[0]) + ((block[i][1] - mean[1]) * axis[1]) + ((block[i][2] - mean[2]) * axis[2])) / axis_length_squared;
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+    float inset = (max_t - min_t) / 16.0f;
+    min_t += inset;
+    max_t -= inset;
+
+    float endpoint0[3];
+    float endpoint1[3];
+    for (unsigned int channel = 0; channel < 3; channel++) {
+        endpoint0[channel] = mean[channel] + (axis[channel] * max_t);
+        endpoint1[channel] = mean[channel] + (axis[channel] * min_t);
+    }
+    uint16_t color0 = texture_pack_565(endpoint0);
+    uint16_t color1 = texture_pack_565(endpoint1);
+    // color0 > color1 selects the four color mode
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+
+    int palette[4][3];
+    texture_unpack_565(color0, palette[0]);
+    texture_unpack_565(color1, palette[1]);
+    for (unsigned int channel = 0; channel < 3; channel++) {
+        palette[2][channel] = ((2 * palette[0][channel]) + palette[1][channel]) / 3;
+        palette[3][channel] = (palette[0][channel] + (2 * palette[1][channel])) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        for (unsigned int i = 0; i < 16; i++) {
+            unsigned int best_index = 0;
+            int best_distance = 0x7fffffff;
+            for (unsigned int index = 0; index < 4; index++) {
+                int dr = block[i][0] - palette[index][0];
+                int dg = block[i][1] - palette[index][1];
+                int db = block[i][2] - palette[index][2];
+                int distance = (dr * dr) + (dg * dg) + (db * db);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best_index = index;
+                }
+            }
+            indices |= best_index << (i * 2);
+        }
+    }
+
+    texture_write_u16(output, color0);
+    texture_write_u16(output + 2, color1);
+    texture_write_u16(output + 4, indices & 0xffff);
+    texture_write_u16(output + 6, indices >> 16);
+}
+
+// BC3 alpha block, always in the eight value mode
+static void texture_encode_alpha_block(const unsigned char block[16][4], unsigned char* output) {
+    int alpha0 = 0;
+    int alpha1 = 255;
+    for (unsigned int i = 0; i < 16; i++) {
+        alpha0 = std::max(alpha0, (int)block[i][3]);
+        alpha1 = std::min(alpha1, (int)block[i][3]);
+    }
+
+    int palette[8];
+    palette[0] = alpha0;
+    palette[1] = alpha1;
+    for (int i = 1; i < 7; i++) {
+        palette[i + 1] = (((7 - i) * alpha0) + (i * alpha1)) / 7;
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1) {
+        for (unsigned int i = 0; i < 16; i++) {
+            uint64_t best_index = 0;
+            int best_distance = 256;
+            for (unsigned int index = 0; index < 8; index++) {
+                int distance = std::abs(block[i][3] - palette[index]);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best_index = index;
+                }
+            }
+            indices |= best_index << (i * 3);
+        }
+    }
+
+    output[0] = (unsigned char)alpha0;
+    output[1] = (unsigned char)alpha1;
+    for (unsigned int i = 0; i < 6; i++) {
+        output[2 + i] = (unsigned char)(indices >> (i * 8));
+    }
+}
+
+static void texture_encode_level(unsigned char* output, const std::vector<unsigned char>& pixels, unsigned int width, unsigned int height, TextureFormat format) {
+    if (format == TEXTURE_FORMAT_RGBA8) {
+        std::memcpy(output, &pixels[0], pixels.size());
+        return;
+    }
+
+    unsigned int block_columns = (width + 3) / 4;
+    unsigned int block_rows = (height + 3) / 4;
+    unsigned int block_size = texture_format_block_size(format);
+    worker_parallel_for(block_rows, [&](unsigned int block_row) {
+        unsigned char block[16][4];
+        for (unsigned int block_column = 0; block_column < block_columns; block_column++) {
+            // blocks hanging over the edge of the level repeat the last row and column
+            for (unsigned int i = 0; i < 16; i++) {
+                unsigned int x = std::min((block_column * 4) + (i % 4), width - 1);
+                unsigned int y = std::min((block_row * 4) + (i / 4), height - 1);
+                std::memcpy(block[i], &pixels[(((std::size_t)y * width) + x) * 4], 4);
+            }
+
+            unsigned char* block_output = output + ((((std::size_t)block_row * block_columns) + block_column) * block_size);
+            if (format == TEXTURE_FORMAT_BC3) {
+                texture_encode_alpha_block(block, block_output);
+                block_output += 8;
+            }
+            texture_encode_color_block(block, block_output);
+        }
+    });
+}
+
+// data format descriptor, which KTX2 requires to describe the texel layout
+static void texture_write_dfd(std::vector<unsigned char>* dfd, TextureFormat format) {
+    struct DfdSample {
+        uint32_t bit_offset;
+        uint32_t bit_length;
+        uint32_t channel;
+        uint32_t upper;
+    };
+    std::vector<DfdSample> samples;
+    uint32_t color_model;
+    if (format == TEXTURE_FORMAT_BC1) {
+        color_model = 128;
+        samples.push_back((DfdSample) { .bit_offset = 0, .bit_length = 64, .channel = 0, .upper = 0xffffffff });
+    } else if (format == TEXTURE_FORMAT_BC3) {
+        color_model = 130;
+        samples.push_back((DfdSample) { .bit_offset = 0, .bit_length = 64, .channel = 15, .upper = 0xffffffff });
+        samples.push_back((DfdSample) { .bit_offset = 64, .bit_length = 64, .channel = 0, .upper = 0xffffffff });
+    } else {
+        color_model = 1;
+        samples.push_back((DfdSample) { .bit_offset = 0, .bit_length = 8, .channel = 0, .upper = 255 });
+        samples.push_back((DfdSample) { .bit_offset = 8, .bit_length = 8, .channel = 1, .upper = 255 });
+        samples.push_back((DfdSample) { .bit_offset = 16, .bit_length = 8, .channel = 2, .upper = 255 });
+        samples.push_back((DfdSample) { .bit_offset = 24, .bit_length = 8, .channel = 15, .upper = 255 });
+    }
+
+    uint32_t block_size = 24 + (16 * samples.size());
+    std::vector<uint32_t> words;
+    words.push_back(4 + block_size);
+    // vendor 0 (Khronos), descriptor type 0 (basic), version 2
+    words.push_back(0);
+    words.push_back(2 | (block_size << 16));
+    // color model, BT709 primaries, linear transfer, straight alpha
+    words.push_back(color_model | (1 << 8) | (1 << 16));
+    uint32_t block_dimension = texture_format_block_dimension(format) - 1;
+    words.push_back(block_dimension | (block_dimension << 8));
+    words.push_back(texture_format_block_size(format));
+    words.push_back(0);
+    for (const DfdSample& sample : samples) {
+        words.push_back(sample.bit_offset | ((sample.bit_length - 1) << 16) | (sample.channel << 24));
+        words.push_back(0);
+        words.push_back(0);
+        words.push_back(sample.upper);
+    }
+
+    dfd->resize(words.size() * sizeof(uint32_t));
+    std::memcpy(&(*dfd)[0], &words[0], dfd->size());
+}
+
+static void texture_write_kvd_entry(std::vector<unsigned char>* kvd, const char* key, const void* value, std::size_t value_size) {
+    uint32_t length = strlen(key) + 1 + value_size;
+    std::size_t offset = kvd->size();
+    kvd->resize(offset + sizeof(uint32_t) + length);
+    std::memcpy(&(*kvd)[offset], &length, sizeof(uint32_t));
+    std::memcpy(&(*kvd)[offset + sizeof(uint32_t)], key, strlen(key) + 1);
+    std::memcpy(&(*kvd)[offset + sizeof(uint32_t) + strlen(key) + 1], value, value_size);
+    kvd->resize((kvd->size() + 3) & ~(std::size_t)3, 0);
+}
+
+static void texture_cook(std::vector<unsigned char>* output, std::vector<unsigned char> pixels, unsigned int width, unsigned int height, TextureFormat format, const TextureCookSource& source) {
+    unsigned int level_count = 1;
+    while ((width >> level_count) != 0 || (height >> level_count) != 0) {
+        level_count++;
+    }
+
+    std::vector<unsigned char> dfd;
+    texture_write_dfd(&dfd, format);
+    // keys have to be sorted
+    std::vector<unsigned char> kvd;
+    texture_write_kvd_entry(&kvd, TEXTURE_SOURCE_KEY, &source, sizeof(source));
+    texture_write_kvd_entry(&kvd, TEXTURE_WRITER_KEY, TEXTURE_WRITER, strlen(TEXTURE_WRITER) + 1);
+
+    TextureKtx2Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.identifier, TEXTURE_KTX2_IDENTIFIER, sizeof(TEXTURE_KTX2_IDENTIFIER));
+    header.vk_format = texture_format_vk_format(format);
+    header.type_size = 1;
+    header.pixel_width = width;
+    header.pixel_height = height;
+    header.face_count = 1;
+    header.level_count = level_count;
+    header.dfd_byte_offset = sizeof(TextureKtx2Header) + (level_count * sizeof(TextureKtx2LevelIndex));
+    header.dfd_byte_length = dfd.size();
+    header.kvd_byte_offset = header.dfd_byte_offset + header.dfd_byte_length;
+    header.kvd_byte_length = kvd.size();
+
+    // KTX2 stores the smallest level first
+    std::vector<TextureKtx2LevelIndex> level_index(level_count);
+    std::size_t offset = header.kvd_byte_offset + header.kvd_byte_length;
+    for (int level = level_count - 1; level >= 0; level--) {
+        offset = texture_align(offset);
+        level_index[level].byte_offset = offset;
+        level_index[level].byte_length = texture_format_level_size(format, std::max(width >> level, 1u), std::max(height >> level, 1u));
+        level_index[level].uncompressed_byte_length = level_index[level].byte_length;
+        offset += level_index[level].byte_length;
+    }
+
+    output->assign(offset, 0);
+    std::memcpy(&(*output)[0], &header, sizeof(header));
+    std::memcpy(&(*output)[sizeof(header)], &level_index[0], level_count * sizeof(TextureKtx2LevelIndex));
+    std::memcpy(&(*output)[header.dfd_byte_offset], &dfd[0], dfd.size());
+    std::memcpy(&(*output)[header.kvd_byte_offset], &kvd[0], kvd.size());
+
+    unsigned int level_width = width;
+    unsigned int level_height = height;
+    for (unsigned int level = 0; level < level_count; level++) {
+        if (level != 0) {
+            std::vector<unsigned char> next_pixels;
+            texture_downsample(&next_pixels, pixels, level_width, level_height);
+            pixels.swap(next_pixels);
+            level_width = std::max(level_width / 2, 1u);
+            level_height = std::max(level_height / 2, 1u);
+        }
+        texture_encode_level(&(*output)[level_index[level].byte_offset], pixels, level_width, level_height, format);
+    }
+}
+
+static bool texture_data_parse(TextureData* texture_data, const unsigned char* data, std::size_t size, std::string source_path) {
+    texture_data->level.clear();
+    if (size < sizeof(TextureKtx2Header)) {
+        return false;
+    }
+    const TextureKtx2Header* header = (const TextureKtx2Header*)data;
+    bool valid = std::memcmp(header->identifier, TEXTURE_KTX2_IDENTIFIER, sizeof(TEXTURE_KTX2_IDENTIFIER)) == 0;
+    valid = valid && header->supercompression_scheme == 0 && header->face_count == 1 && header->layer_count == 0 && header->pixel_depth == 0;
+    valid = valid && header->level_count != 0 && header->level_count <= 32 && header->pixel_width != 0 && header->pixel_height != 0;
+    valid = valid && sizeof(TextureKtx2Header) + (header->level_count * sizeof(TextureKtx2LevelIndex)) <= size;
+    valid = valid && header->kvd_byte_offset <= size && header->kvd_byte_length <= size - header->kvd_byte_offset;
+    if (!valid) {
+        return false;
+    }
+
+    // only use the file if it's in the format that would be cooked right now
+    if (header->vk_format == TEXTURE_VK_FORMAT_BC1_RGB_UNORM_BLOCK && texture_compression_supported) {
+        texture_data->format = TEXTURE_FORMAT_BC1;
+    } else if (header->vk_format == TEXTURE_VK_FORMAT_BC3_UNORM_BLOCK && texture_compression_supported) {
+        texture_data->format = TEXTURE_FORMAT_BC3;
+    } else if (header->vk_format == TEXTURE_VK_FORMAT_R8G8B8A8_UNORM && !texture_compression_supported) {
+        texture_data->format = TEXTURE_FORMAT_RGBA8;
+    } else {
+        return false;
+    }
+
+    // make sure it was cooked by this cooker from the current version of the image
+    bool source_valid = false;
+    std::size_t kvd_offset = header->kvd_byte_offset;
+    std::size_t kvd_end = header->kvd_byte_offset + header->kvd_byte_length;
+    std::size_t key_length = strlen(TEXTURE_SOURCE_KEY) + 1;
+    while (kvd_offset + sizeof(uint32_t) <= kvd_end) {
+        uint32_t length;
+        std::memcpy(&length, data + kvd_offset, sizeof(uint32_t));
+        kvd_offset += sizeof(uint32_t);
+        if (length > kvd_end - kvd_offset) {
+            break;
+        }
+        if (length == key_length + sizeof(TextureCookSource) && std::memcmp(data + kvd_offset, TEXTURE_SOURCE_KEY, key_length) == 0) {
+            TextureCookSource source;
+            std::memcpy(&source, data + kvd_offset + key_length, sizeof(source));
+            int64_t modified_time;
+            uint64_t source_size;
+            source_valid = source.version == TEXTURE_COOK_VERSION && cache_file_stat(source_path, &modified_time, &source_size);
+            source_valid = source_valid && source.modified_time == modified_time && source.size == source_size;
+        }
+        kvd_offset = (kvd_offset + length + 3) & ~(std::size_t)3;
+    }
+    if (!source_valid) {
+        return false;
+    }
+
+    const TextureKtx2LevelIndex* level_index = (const TextureKtx2LevelIndex*)(data + sizeof(TextureKtx2Header));
+    for (unsigned int level = 0; level < header->level_count; level++) {
+        unsigned int width = std::max(header->pixel_width >> level, 1u);
+        unsigned int height = std::max(header->pixel_height >> level, 1u);
+        if (level_index[level].byte_offset > size || level_index[level].byte_length > size - level_index[level].byte_offset ||
+            level_index[level].byte_length != texture_format_level_size(texture_data->format, width, height)) {
+            texture_data->level.clear();
+            return false;
+        }
+        texture_data->level.push_back((TextureLevel) {
+            .width = width,
+            .height = height,
+            .data = data + level_index[level].byte_offset,
+            .size = (std::size_t)level_index[level].byte_length
+        });
+    }
+
+    return true;
+}
+
+// decodes the image into tightly packed RGBA bytes
+static bool texture_image_decode(std::vector<unsigned char>* pixels, unsigned int* width, unsigned int* height, std::string path) {
+    SDL_Surface* texture_surface = IMG_Load(path.c_str());
+    if (texture_surface == NULL) {
+        printf("Unable to load texture at path %s: %s\n", path.c_str(), IMG_GetError());
+        return false;
+    }
+    SDL_Surface* rgba_surface = SDL_ConvertSurfaceFormat(texture_surface, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(texture_surface);
+    if (rgba_surface == NULL) {
+        printf("Texture format of texture %s not recognized: %s\n", path.c_str(), SDL_GetError());
+        return false;
+    }
+
+    *width = rgba_surface->w;
+    *height = rgba_surface->h;
+    pixels->resize((std::size_t)rgba_surface->w * rgba_surface->h * 4);
+    for (int y = 0; y < rgba_surface->h; y++) {
+        std::memcpy(&(*pixels)[(std::size_t)y * rgba_surface->w * 4], (const unsigned char*)rgba_surface->pixels + ((std::size_t)y * rgba_surface->pitch), rgba_surface->w * 4);
+    }
+    SDL_FreeSurface(rgba_surface);
+
+    return true;
+}
+
+bool texture_data_load(TextureData* texture_data, std::string path) {
+    texture_data->memory.clear();
+    texture_data->level.clear();
+    std::string cooked_path = cache_path(path, TEXTURE_CACHE_EXTENSION);
+    if (mapped_file_open(&texture_data->file, cooked_path)) {
+        if (texture_data_parse(texture_data, (const unsigned char*)texture_data->file.data, texture_data->file.size, path)) {
+            return true;
+        }
+        mapped_file_close(&texture_data->file);
+    }
+
+    TextureCookSource source;
+    std::memset(&source, 0, sizeof(source));
+    source.version = TEXTURE_COOK_VERSION;
+    if (!cache_file_stat(path, &source.modified_time, &source.size)) {
+        printf("Unable to load texture at path %s\n", path.c_str());
+        return false;
+    }
+    std::vector<unsigned char> pixels;
+    unsigned int width;
+    unsigned int height;
+    if (!texture_image_decode(&pixels, &width, &height, path)) {
+        return false;
+    }
+
+    TextureFormat format = TEXTURE_FORMAT_RGBA8;
+    if (texture_compression_supported) {
+        format = TEXTURE_FORMAT_BC1;
+        for (std::size_t i = 3; i < pixels.size(); i += 4) {
+            if (pixels[i] != 255) {
+                format = TEXTURE_FORMAT_BC3;
+                break;
+            }
+        }
+    }
+    texture_cook(&texture_data->memory, pixels, width, height, format, source);
+    // failing to save the cooked copy only costs cooking it again next time
+    cache_write(cooked_path, &texture_data->memory[0], texture_data->memory.size());
+    if (!texture_data_parse(texture_data, &texture_data->memory[0], texture_data->memory.size(), path)) {
+        texture_data->memory.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void texture_data_close(TextureData* texture_data) {
+    if (texture_data->memory.empty()) {
+        mapped_file_close(&texture_data->file);
+    }
+    texture_data->memory.clear();
+    texture_data->level.clear();
+}
+
+void texture_create(GLuint* texture, const TextureData& texture_data) {
+    GLenum internal_format = texture_format_internal_format(texture_data.format);
+    glGenTextures(1, texture);
+
+    gl_state_bind_texture(0, *texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture_data.level.size() - 1);
+    if (texture_storage_supported) {
+        texture_storage_2d(GL_TEXTURE_2D, texture_data.level.size(), internal_format, texture_data.level[0].width, texture_data.level[0].height);
+    } else {
+        // without immutable storage every level has to be specified on its own. with no unpack buffer bound,
+        // NULL allocates compressed levels without uploading anything, so streaming keeps to its per frame budget
+        for (unsigned int level = 0; level < texture_data.level.size(); level++) {
+            const TextureLevel& texture_level = texture_data.level[level];
+            if (texture_data.format == TEXTURE_FORMAT_RGBA8) {
+                glTexImage2D(GL_TEXTURE_2D, level, internal_format, texture_level.width, texture_level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            } else {
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, internal_format, texture_level.width, texture_level.height, 0, texture_level.size, NULL);
+            }
+        }
+    }
+}
+
+void texture_upload_rows(const TextureData& texture_data, unsigned int level, unsigned int first_row, unsigned int row_count, const void* pixels) {
+    const TextureLevel& texture_level = texture_data.level[level];
+    unsigned int block_dimension = texture_format_block_dimension(texture_data.format);
+    unsigned int y = first_row * block_dimension;
+    unsigned int height = std::min(row_count * block_dimension, texture_level.height - y);
+    if (texture_data.format == TEXTURE_FORMAT_RGBA8) {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, y, texture_level.width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    } else {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, texture_level.width, height, texture_format_internal_format(texture_data.format), row_count * texture_level_row_size(texture_data, level), pixels);
+    }
+}
+
+bool texture_array_load(GLuint* texture, const std::vector<std::string>& paths) {
+    // loaded in place, since the levels point into the data
+    std::vector<TextureData> layers(paths.size());
+    unsigned int loaded = 0;
+    bool valid = !paths.empty();
+    while (valid && loaded < paths.size()) {
+        if (!texture_data_load(&layers[loaded], paths[loaded])) {
+            valid = false;
+            break;
+        }
+        const TextureData& layer = layers[loaded];
+        loaded++;
+        if (layer.format != layers[0].format || layer.level.size() != layers[0].level.size() || layer.level[0].width != layers[0].level[0].width || layer.level[0].height != layers[0].level[0].height) {
+            printf("Texture %s doesn't match the size and format of %s, so they can't share a texture array\n", paths[loaded - 1].c_str(), paths[0].c_str());
+            valid = false;
+        }
+    }
+    if (!valid) {
+        for (unsigned int i = 0; i < loaded; i++) {
+            texture_data_close(&layers[i]);
+        }
+        return false;
+    }
+
+    const TextureData& first = layers[0];
+    GLenum internal_format = texture_format_internal_format(first.format);
+    glGenTextures(1, texture);
+    gl_state_bind_texture_array(0, *texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, first.level.size() - 1);
+    if (texture_storage_supported) {
+        texture_storage_3d(GL_TEXTURE_2D_ARRAY, first.level.size(), internal_format, first.level[0].width, first.level[0].height, layers.size());
+    } else {
+        for (unsigned int level = 0; level < first.level.size(); level++) {
+            const TextureLevel& texture_level = first.level[level];
+            if (first.format == TEXTURE_FORMAT_RGBA8) {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internal_format, texture_level.width, texture_level.height, layers.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            } else {
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internal_format, texture_level.width, texture_level.height, layers.size(), 0, texture_level.size * layers.size(), NULL);
+            }
+        }
+    }
+
+    for (unsigned int layer = 0; layer < layers.size(); layer++) {
+        for (unsigned int level = 0; level < layers[layer].level.size(); level++) {
+            const TextureLevel& texture_level = layers[layer].level[level];
+            if (first.format == TEXTURE_FORMAT_RGBA8) {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, texture_level.width, texture_level.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, texture_level.data);
+            } else {
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, texture_level.width, texture_level.height, 1, internal_format, texture_level.size, texture_level.data);
+            }
+        }
+        texture_data_close(&layers[layer]);
+    }
+
+    return true;
+}
+
+std::size_t texture_size(GLuint texture) {
+    if (texture == 0) {
+        return 0;
+    }
+
+    std::size_t size = 0;
+    GLint max_level;
+    gl_state_bind_texture(0, texture);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &max_level);
+    for (GLint level = 0; level <= max_level; level++) {
+        GLint width;
+        GLint height;
+        GLint compressed;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (width == 0) {
+            break;
+        }
+        if (compressed) {
+            GLint compressed_size;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressed_size);
+            size += compressed_size;
+        } else {
+            size += (std::size_t)width * height * 4;
+        }
+    }
+
+    return size;
+}
\ No newline at end of file
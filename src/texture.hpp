@@ -0,0 +1,55 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Cooked textures: a full mip chain, block compressed whenever the driver supports it, stored as KTX2 in ./cache/.
+// A cooked texture is only used while its source image and the cooker version are unchanged and it's in the format currently wanted.
+
+enum TextureFormat {
+    TEXTURE_FORMAT_RGBA8,
+    // S3TC. BC1 for opaque images and BC3 for anything with alpha
+    TEXTURE_FORMAT_BC1,
+    TEXTURE_FORMAT_BC3
+};
+
+struct TextureLevel {
+    unsigned int width;
+    unsigned int height;
+    // points into the cooked data and is only valid until texture_data_close
+    const unsigned char* data;
+    std::size_t size;
+};
+
+struct TextureData {
+    MappedFile file;
+    // holds the cooked data instead of file when the texture had to be cooked by texture_data_load
+    std::vector<unsigned char> memory;
+    TextureFormat format;
+    std::vector<TextureLevel> level;
+};
+
+// set by texture_init
+extern bool texture_compression_supported;
+extern bool texture_storage_supported;
+
+bool texture_init();
+// cooks the image first if the cached copy is missing or stale. safe to call from worker threads
+bool texture_data_load(TextureData* texture_data, std::string path);
+void texture_data_close(TextureData* texture_data);
+// textures are uploaded in rows of blocks, which are 4 pixels high when compressed and 1 pixel high otherwise
+unsigned int texture_level_row_count(const TextureData& texture_data, unsigned int level);
+std::size_t texture_level_row_size(const TextureData& texture_data, unsigned int level);
+// allocates every level of the texture with uninitialized contents
+void texture_create(GLuint* texture, const TextureData& texture_data);
+// uploads rows of blocks to the currently bound texture. pixels is an offset when a pixel unpack buffer is bound
+void texture_upload_rows(const TextureData& texture_data, unsigned int level, unsigned int first_row, unsigned int row_count, const void* pixels);
+// loads images of the same size and format into the layers of a GL_TEXTURE_2D_ARRAY, in order.
+// unlike other textures these are loaded right away rather than streamed
+bool texture_array_load(GLuint* texture, const std::vector<std::string>& paths);
+// GPU memory used by a texture made with texture_create
+std::size_t texture_size(GLuint texture);
\ No newline at end of file
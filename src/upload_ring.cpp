@@ -0,0 +1,144 @@
+#include "upload_ring.hpp"
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+// how long to block in glClientWaitSync before checking again, in nanoseconds
+const GLuint64 UPLOAD_RING_WAIT_TIMEOUT = 1000000000;
+
+std::size_t upload_ring_uniform_alignment = 256;
+
+GLuint upload_ring_buffer = 0;
+std::size_t upload_ring_frame_size;
+unsigned int upload_ring_frame = 0;
+// the next free byte of the current frame's region, relative to its start
+std::size_t upload_ring_head;
+GLsync upload_ring_fence[UPLOAD_RING_FRAMES];
+// buffers the ring grew out of this frame, which draws may still be about to read from
+std::vector<GLuint> upload_ring_retired_buffers;
+UploadRingStats upload_ring_current_stats;
+UploadRingStats upload_ring_last_stats;
+
+static void upload_ring_create(std::size_t frame_size) {
+    upload_ring_frame_size = frame_size;
+    glGenBuffers(1, &upload_ring_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, upload_ring_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, upload_ring_frame_size * UPLOAD_RING_FRAMES, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    for (unsigned int i = 0; i < UPLOAD_RING_FRAMES; i++) {
+        upload_ring_fence[i] = NULL;
+    }
+}
+
+bool upload_ring_init() {
+    GLint uniform_alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+    upload_ring_uniform_alignment = std::max(uniform_alignment, 16);
+    upload_ring_create(UPLOAD_RING_INITIAL_FRAME_SIZE);
+    upload_ring_head = 0;
+    upload_ring_current_stats = (UploadRingStats) { .bytes = 0, .stalls = 0, .stall_milliseconds = 0.0f };
+    upload_ring_last_stats = upload_ring_current_stats;
+
+    return true;
+}
+
+static void upload_ring_delete_fences() {
+    for (unsigned int i = 0; i < UPLOAD_RING_FRAMES; i++) {
+        if (upload_ring_fence[i] != NULL) {
+            glDeleteSync(upload_ring_fence[i]);
+            upload_ring_fence[i] = NULL;
+        }
+    }
+}
+
+void upload_ring_quit() {
+    upload_ring_delete_fences();
+    glDeleteBuffers(1, &upload_ring_buffer);
+    if (!upload_ring_retired_buffers.empty()) {
+        glDeleteBuffers(upload_ring_retired_buffers.size(), &upload_ring_retired_buffers[0]);
+    }
+}
+
+void upload_ring_frame_begin() {
+    upload_ring_frame = (upload_ring_frame + 1) % UPLOAD_RING_FRAMES;
+    upload_ring_head = 0;
+    GLsync fence = upload_ring_fence[upload_ring_frame];
+    if (fence == NULL) {
+        return;
+    }
+
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        Uint64 wait_start_time = SDL_GetPerformanceCounter();
+        while (result == GL_TIMEOUT_EXPIRED) {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UPLOAD_RING_WAIT_TIMEOUT);
+        }
+        upload_ring_current_stats.stalls++;
+        upload_ring_current_stats.stall_milliseconds += (float)(SDL_GetPerformanceCounter() - wait_start_time) * 1000.0f / (float)SDL_GetPerformanceFrequency();
+    }
+    if (result == GL_WAIT_FAILED) {
+        printf("Waiting on the upload ring fence failed\n");
+    }
+    glDeleteSync(fence);
+    upload_ring_fence[upload_ring_frame] = NULL;
+}
+
+void upload_ring_frame_end() {
+    upload_ring_fence[upload_ring_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // every draw reading them has been issued by now, and the driver holds on to them until those are done
+    if (!upload_ring_retired_buffers.empty()) {
+        glDeleteBuffers(upload_ring_retired_buffers.size(), &upload_ring_retired_buffers[0]);
+        upload_ring_retired_buffers.clear();
+    }
+    upload_ring_last_stats = upload_ring_current_stats;
+    upload_ring_current_stats = (UploadRingStats) { .bytes = 0, .stalls = 0, .stall_milliseconds = 0.0f };
+}
+
+// ranges handed out earlier this frame keep pointing at the old buffer, so it's only deleted once the frame ends
+static void upload_ring_grow(std::size_t size) {
+    std::size_t frame_size = upload_ring_frame_size;
+    while (frame_size < size) {
+        frame_size *= 2;
+    }
+    frame_size *= 2;
+    printf("Upload ring grew from %u to %u bytes per frame\n", (unsigned int)upload_ring_frame_size, (unsigned int)frame_size);
+
+    upload_ring_delete_fences();
+    upload_ring_retired_buffers.push_back(upload_ring_buffer);
+    upload_ring_create(frame_size);
+    upload_ring_head = 0;
+}
+
+UploadRingRange upload_ring_upload(const void* data, std::size_t size, std::size_t alignment) {
+    std::size_t offset = (upload_ring_head + alignment - 1) & ~(alignment - 1);
+    if (offset + size > upload_ring_frame_size) {
+        upload_ring_grow(size);
+        offset = 0;
+    }
+    upload_ring_head = offset + size;
+    offset += (std::size_t)upload_ring_frame * upload_ring_frame_size;
+
+    // the fence already guarantees the GPU is done with this region, so the map doesn't need to wait on anything
+    glBindBuffer(GL_COPY_WRITE_BUFFER, upload_ring_buffer);
+    void* mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (mapped != NULL) {
+        std::memcpy(mapped, data, size);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    } else {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    upload_ring_current_stats.bytes += size;
+
+    return (UploadRingRange) {
+        .buffer = upload_ring_buffer,
+        .offset = offset
+    };
+}
+
+UploadRingStats upload_ring_stats() {
+    return upload_ring_last_stats;
+}
\ No newline at end of file
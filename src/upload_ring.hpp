@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+
+// Every piece of data uploaded to the GPU each frame goes through here: instances, indirect commands, glyphs and uniform blocks.
+// One buffer is split into a region per frame in flight. Each frame bump allocates from its own region,
+// writing through unsynchronized maps, and fences the region when it ends, so a frame only ever waits
+// when the GPU is still reading the region from three frames ago. Those waits are counted as stalls.
+// Data handed out is only valid for the frame it was uploaded in.
+
+const unsigned int UPLOAD_RING_FRAMES = 3;
+// starting size of each frame's region. a frame that outgrows it moves the ring into a buffer twice the size
+const std::size_t UPLOAD_RING_INITIAL_FRAME_SIZE = 4 << 20;
+
+struct UploadRingRange {
+    GLuint buffer;
+    std::size_t offset;
+};
+
+struct UploadRingStats {
+    std::size_t bytes;
+    unsigned int stalls;
+    float stall_milliseconds;
+};
+
+// set by upload_ring_init, the alignment ranges bound as uniform blocks need
+extern std::size_t upload_ring_uniform_alignment;
+
+bool upload_ring_init();
+void upload_ring_quit();
+// waits for the GPU to finish with the region this frame is about to reuse
+void upload_ring_frame_begin();
+// fences off everything uploaded this frame, call after its last draw
+void upload_ring_frame_end();
+// copies the data into this frame's region. the offset of the range is a multiple of alignment, which must be a power of two
+UploadRingRange upload_ring_upload(const void* data, std::size_t size, std::size_t alignment);
+// the last frame to end
+UploadRingStats upload_ring_stats();
\ No newline at end of file
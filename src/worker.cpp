@@ -0,0 +1,140 @@
+#include "worker.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <cstdio>
+
+struct WorkerBatch {
+    unsigned int remaining;
+};
+
+struct WorkerTask {
+    std::function<void()> run;
+    WorkerBatch* batch;
+};
+
+std::vector<std::thread> worker_threads;
+std::deque<WorkerTask> worker_queue;
+std::mutex worker_mutex;
+std::condition_variable worker_task_condition;
+std::condition_variable worker_batch_condition;
+bool worker_quitting = false;
+
+void worker_thread_main();
+
+bool worker_init() {
+    // the thread calling worker_parallel_for helps out, so leave a core for it
+    unsigned int core_count = std::thread::hardware_concurrency();
+    unsigned int thread_count = core_count > 1 ? core_count - 1 : 0;
+
+    worker_quitting = false;
+    for (unsigned int i = 0; i < thread_count; i++) {
+        worker_threads.push_back(std::thread(worker_thread_main));
+    }
+
+    return true;
+}
+
+void worker_quit() {
+    {
+        std::lock_guard<std::mutex> lock(worker_mutex);
+        worker_quitting = true;
+    }
+    worker_task_condition.notify_all();
+    for (std::thread& thread : worker_threads) {
+        thread.join();
+    }
+    worker_threads.clear();
+}
+
+unsigned int worker_thread_count() {
+    return worker_threads.size() + 1;
+}
+
+// must be called with worker_mutex held
+void worker_task_finish(const WorkerTask& task) {
+    if (task.batch == NULL) {
+        return;
+    }
+    task.batch->remaining--;
+    if (task.batch->remaining == 0) {
+        worker_batch_condition.notify_all();
+    }
+}
+
+void worker_thread_main() {
+    std::unique_lock<std::mutex> lock(worker_mutex);
+    while (true) {
+        worker_task_condition.wait(lock, [] { return worker_quitting || !worker_queue.empty(); });
+        if (worker_quitting && worker_queue.empty()) {
+            return;
+        }
+
+        WorkerTask task = worker_queue.front();
+        worker_queue.pop_front();
+        lock.unlock();
+        task.run();
+        lock.lock();
+        worker_task_finish(task);
+    }
+}
+
+void worker_parallel_for(unsigned int job_count, std::function<void(unsigned int)> job) {
+    if (worker_threads.empty() || job_count <= 1) {
+        for (unsigned int i = 0; i < job_count; i++) {
+            job(i);
+        }
+        return;
+    }
+
+    WorkerBatch batch;
+    batch.remaining = job_count;
+
+    std::unique_lock<std::mutex> lock(worker_mutex);
+    for (unsigned int i = 0; i < job_count; i++) {
+        worker_queue.push_back((WorkerTask) {
+            .run = std::bind(job, i),
+            .batch = &batch
+        });
+    }
+    worker_task_condition.notify_all();
+
+    // help drain the queue instead of sleeping. this also keeps nested parallel fors from deadlocking.
+    // only this batch's tasks are picked up, so that the caller never gets stuck running a long background task
+    while (batch.remaining > 0) {
+        std::deque<WorkerTask>::iterator it = worker_queue.begin();
+        while (it != worker_queue.end() && it->batch != &batch) {
+            ++it;
+        }
+        if (it == worker_queue.end()) {
+            worker_batch_condition.wait(lock);
+            continue;
+        }
+
+        WorkerTask task = *it;
+        worker_queue.erase(it);
+        lock.unlock();
+        task.run();
+        lock.lock();
+        worker_task_finish(task);
+    }
+}
+
+void worker_submit(std::function<void()> task) {
+    if (worker_threads.empty()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(worker_mutex);
+        worker_queue.push_back((WorkerTask) {
+            .run = task,
+            .batch = NULL
+        });
+    }
+    worker_task_condition.notify_one();
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <functional>
+
+// Pool of background threads shared by everything that wants to spread work across cores.
+// If the pool was never initialized all work simply runs on the calling thread.
+
+bool worker_init();
+void worker_quit();
+// number of threads that take part in a parallel for, including the calling thread
+unsigned int worker_thread_count();
+// runs job(0) .. job(job_count - 1) across the pool and returns once all of them are done
+void worker_parallel_for(unsigned int job_count, std::function<void(unsigned int)> job);
+// queues task to run in the background and returns right away. the task is responsible for reporting back its own results
+void worker_submit(std::function<void()> task);
\ No newline at end of file